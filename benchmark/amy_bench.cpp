@@ -0,0 +1,848 @@
+// amy-bench: a load generator driving a weighted mix of query templates over
+// a number of connections, and reporting throughput and latency percentiles
+// per template.  Run with -h for its options.
+//
+// Closed-loop runs (the default) issue the next query of a connection as soon
+// as the previous one completes.  Open-loop runs (--rate) issue queries at
+// Poisson-distributed arrival times, whether the previous ones completed or
+// not, and measure latencies from the intended arrival time, so that a slow
+// server shows up in the percentiles rather than in a lower rate of queries.
+
+#include "benchmark_support.hpp"
+#include "fake_server.hpp"
+#include "utils.hpp"
+
+#include <amy/connector.hpp>
+
+#if defined(AMY_BENCHMARK_MARIADB)
+#include <amy/mariadb_connector.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+global_options opts;
+
+/// Options of the benchmark itself, on top of the connection ones.
+struct bench_options {
+    /// "blocking", "mysql" or "mariadb".
+    std::string backend = "mysql";
+
+    int connections = 8;
+
+    /// Number of io_service instances, each run by a thread of its own.
+    int threads = 1;
+
+    /// Queries per second over all the connections, 0 for a closed loop.
+    double rate = 0.0;
+
+    double duration = 10.0;
+
+    /// Initial seconds left out of the results.
+    double warmup = 1.0;
+
+    /// Runs against an in-process fake server, to measure amy alone.
+    bool fake = false;
+
+    bool json = false;
+
+    /// Query templates, each prefixed with its weight and a colon.
+    std::vector<std::string> queries;
+
+}; // struct bench_options
+
+static bench_options bench;
+
+/// A statement with placeholders, rendered anew for each query:
+///
+/// - {seq} the number of the query on its connection,
+/// - {conn} the number of the connection,
+/// - {rand:LO:HI} a uniformly distributed integer within [LO, HI].
+class query_template {
+public:
+    explicit query_template(std::string const& spec) :
+        weight_(1.0),
+        errors_(0u),
+        rows_(0u)
+    {
+        std::size_t colon = spec.find(':');
+        std::size_t digits = spec.find_first_not_of("0123456789.");
+
+        if (colon != std::string::npos && colon == digits && colon > 0u) {
+            weight_ = std::stod(spec.substr(0u, colon));
+            text_ = spec.substr(colon + 1u);
+        } else {
+            text_ = spec;
+        }
+
+        parse();
+    }
+
+    std::string const& text() const {
+        return text_;
+    }
+
+    double weight() const {
+        return weight_;
+    }
+
+    template<typename Random>
+    void render(std::string& out, uint64_t seq, int conn, Random& random) const
+    {
+        out.clear();
+
+        for (segment const& s : segments_) {
+            switch (s.kind) {
+            case segment::literal:
+                out += s.text;
+                break;
+            case segment::sequence:
+                out += std::to_string(seq);
+                break;
+            case segment::connection:
+                out += std::to_string(conn);
+                break;
+            case segment::random:
+                out += std::to_string(
+                        std::uniform_int_distribution<long long>(
+                            s.low, s.high)(random));
+                break;
+            }
+        }
+    }
+
+    void record(clock_type::duration latency,
+                AMY_SYSTEM_NS::error_code const& ec,
+                uint64_t rows)
+    {
+        latency_.record(latency);
+
+        if (ec) {
+            errors_.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        rows_.fetch_add(rows, std::memory_order_relaxed);
+    }
+
+    amy::histogram_snapshot latency() const {
+        return latency_.snapshot();
+    }
+
+    uint64_t errors() const {
+        return errors_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t rows() const {
+        return rows_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct segment {
+        enum kind_type { literal, sequence, connection, random };
+
+        kind_type kind;
+        std::string text;
+        long long low;
+        long long high;
+    };
+
+    double weight_;
+    std::string text_;
+    std::vector<segment> segments_;
+
+    amy::latency_histogram latency_;
+    std::atomic<uint64_t> errors_;
+    std::atomic<uint64_t> rows_;
+
+    void parse() {
+        std::size_t pos = 0u;
+
+        while (pos < text_.size()) {
+            std::size_t open = text_.find('{', pos);
+            std::size_t close = open == std::string::npos
+                ? std::string::npos
+                : text_.find('}', open);
+
+            if (close == std::string::npos) {
+                add(segment::literal, text_.substr(pos));
+                break;
+            }
+
+            if (open > pos) {
+                add(segment::literal, text_.substr(pos, open - pos));
+            }
+
+            std::string name = text_.substr(open + 1u, close - open - 1u);
+            pos = close + 1u;
+
+            if (name == "seq") {
+                add(segment::sequence);
+            } else if (name == "conn") {
+                add(segment::connection);
+            } else if (name.compare(0u, 5u, "rand:") == 0) {
+                std::size_t colon = name.find(':', 5u);
+
+                if (colon == std::string::npos) {
+                    throw std::invalid_argument("bad placeholder: " + name);
+                }
+
+                add(segment::random);
+                segments_.back().low = std::stoll(name.substr(5u, colon - 5u));
+                segments_.back().high = std::stoll(name.substr(colon + 1u));
+            } else {
+                throw std::invalid_argument("unknown placeholder: " + name);
+            }
+        }
+    }
+
+    void add(segment::kind_type kind, std::string text = std::string()) {
+        segments_.push_back(segment { kind, std::move(text), 0, 0 });
+    }
+
+}; // class query_template
+
+/// The templates of the run, their weights and the time window measured.
+class workload {
+public:
+    typedef std::discrete_distribution<std::size_t> distribution_type;
+
+    explicit workload(std::vector<std::string> const& specs) {
+        std::vector<double> weights;
+
+        for (std::string const& spec : specs) {
+            templates_.emplace_back(new query_template(spec));
+            weights.push_back(templates_.back()->weight());
+        }
+
+        distribution_ = distribution_type(weights.begin(), weights.end());
+    }
+
+    /// Starts the run, once all the connections are open.
+    void start() {
+        started_ = clock_type::now();
+        measured_ = started_ + to_duration(bench.warmup);
+        ended_ = measured_ + to_duration(bench.duration);
+    }
+
+    static clock_type::duration to_duration(double seconds) {
+        return std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(seconds));
+    }
+
+    /// The weights of the templates, to be copied by each connection, since
+    /// drawing from a distribution is not thread safe.
+    distribution_type const& distribution() const {
+        return distribution_;
+    }
+
+    template<typename Random>
+    query_template& pick(distribution_type& distribution, Random& random) {
+        return *templates_[distribution(random)];
+    }
+
+    clock_type::time_point started() const {
+        return started_;
+    }
+
+    clock_type::time_point ended() const {
+        return ended_;
+    }
+
+    /// Records the query issued, or meant to be issued, at \p intended.
+    void record(query_template& t,
+                clock_type::time_point intended,
+                AMY_SYSTEM_NS::error_code const& ec,
+                uint64_t rows)
+    {
+        if (intended < measured_) {
+            return;
+        }
+
+        clock_type::duration latency = clock_type::now() - intended;
+        t.record(latency, ec, rows);
+        total_.record(latency);
+    }
+
+    std::vector<std::unique_ptr<query_template>> const& templates() const {
+        return templates_;
+    }
+
+    amy::histogram_snapshot total() const {
+        return total_.snapshot();
+    }
+
+private:
+    std::vector<std::unique_ptr<query_template>> templates_;
+    distribution_type distribution_;
+    amy::latency_histogram total_;
+    clock_type::time_point started_;
+    clock_type::time_point measured_;
+    clock_type::time_point ended_;
+
+}; // class workload
+
+/// The arrival times of the queries of one connection.
+class arrivals {
+public:
+    /// \p rate is in queries per second, 0 for a closed loop.
+    arrivals(double rate, clock_type::time_point started, unsigned seed) :
+        open_(rate > 0.0),
+        gaps_(open_ ? rate : 1.0),
+        random_(seed),
+        next_(started)
+    {
+        advance();
+    }
+
+    bool open_loop() const {
+        return open_;
+    }
+
+    /// The next arrival time, in an open loop.
+    clock_type::time_point next() const {
+        return next_;
+    }
+
+    void advance() {
+        next_ += workload::to_duration(gaps_(random_));
+    }
+
+private:
+    bool open_;
+    std::exponential_distribution<double> gaps_;
+    std::mt19937_64 random_;
+    clock_type::time_point next_;
+
+}; // class arrivals
+
+template<typename Connector>
+static void connect(Connector& connector) {
+    connector.connect(opts.tcp_endpoint(),
+                      opts.auth_info(),
+                      opts.schema,
+                      amy::client_multi_statements);
+}
+
+/// A connection issuing queries through the asynchronous operations of
+/// \c Connector, run by a single thread.
+template<typename Connector>
+class async_client {
+public:
+    async_client(AMY_ASIO_NS::io_service& io_service,
+                 workload& load,
+                 int index) :
+        connector_(io_service),
+        timer_(io_service),
+        load_(load),
+        index_(index),
+        random_(index),
+        distribution_(load.distribution()),
+        arrivals_(0.0, clock_type::time_point(), 0u),
+        busy_(false),
+        seq_(0u),
+        backlog_(0u)
+    {
+        connect(connector_);
+    }
+
+    void start() {
+        arrivals_ = arrivals(bench.rate / bench.connections, load_.started(),
+                             index_ + 1u);
+
+        if (arrivals_.open_loop()) {
+            wait_for_arrival();
+        } else {
+            issue(clock_type::now());
+        }
+    }
+
+    /// Arrivals left unserved at the end of the run, in an open loop.
+    std::size_t backlog() const {
+        return backlog_;
+    }
+
+private:
+    Connector connector_;
+    AMY_ASIO_NS::steady_timer timer_;
+    workload& load_;
+    int index_;
+    std::mt19937_64 random_;
+    workload::distribution_type distribution_;
+    arrivals arrivals_;
+    bool busy_;
+    uint64_t seq_;
+    std::deque<clock_type::time_point> pending_;
+    std::size_t backlog_;
+    std::string stmt_;
+
+    void wait_for_arrival() {
+        if (arrivals_.next() >= load_.ended()) {
+            return;
+        }
+
+        timer_.expires_at(arrivals_.next());
+        timer_.async_wait([this](AMY_SYSTEM_NS::error_code const& ec) {
+            if (ec) {
+                return;
+            }
+
+            clock_type::time_point intended = arrivals_.next();
+            arrivals_.advance();
+
+            if (busy_) {
+                pending_.push_back(intended);
+            } else {
+                issue(intended);
+            }
+
+            wait_for_arrival();
+        });
+    }
+
+    void issue(clock_type::time_point intended) {
+        query_template& t = load_.pick(distribution_, random_);
+        t.render(stmt_, seq_++, index_, random_);
+        busy_ = true;
+
+        connector_.async_query_result(
+                stmt_,
+                [this, &t, intended](AMY_SYSTEM_NS::error_code const& ec,
+                                     amy::result_set rs)
+                {
+                    handle_result(t, intended, ec, ec ? 0u : rs.size());
+                });
+    }
+
+    /// Stores the results of the further statements of a multi-statement
+    /// template, so that the connection is ready for the next query.
+    void handle_result(query_template& t,
+                       clock_type::time_point intended,
+                       AMY_SYSTEM_NS::error_code const& ec,
+                       uint64_t rows)
+    {
+        if (!ec && connector_.has_more_results()) {
+            connector_.async_store_result(
+                    [this, &t, intended, rows](
+                            AMY_SYSTEM_NS::error_code const& ec,
+                            amy::result_set rs)
+                    {
+                        handle_result(t, intended, ec,
+                                      ec ? rows : rows + rs.size());
+                    });
+            return;
+        }
+
+        busy_ = false;
+        load_.record(t, intended, ec, rows);
+
+        if (clock_type::now() >= load_.ended()) {
+            backlog_ = pending_.size();
+            pending_.clear();
+        } else if (!arrivals_.open_loop()) {
+            issue(clock_type::now());
+        } else if (!pending_.empty()) {
+            clock_type::time_point next = pending_.front();
+            pending_.pop_front();
+            issue(next);
+        }
+    }
+
+}; // class async_client
+
+/// Runs \c bench.connections asynchronous clients over \c bench.threads
+/// io_service instances, and returns the unserved arrivals.
+template<typename Connector>
+static std::size_t run_async(workload& load) {
+    std::vector<std::unique_ptr<AMY_ASIO_NS::io_service>> io_services;
+    std::vector<std::unique_ptr<async_client<Connector>>> clients;
+
+    for (int i = 0; i < bench.threads; ++i) {
+        io_services.emplace_back(new AMY_ASIO_NS::io_service);
+    }
+
+    for (int i = 0; i < bench.connections; ++i) {
+        clients.emplace_back(new async_client<Connector>(
+                    *io_services[i % bench.threads], load, i));
+    }
+
+    load.start();
+
+    for (auto& client : clients) {
+        client->start();
+    }
+
+    std::vector<std::thread> threads;
+
+    for (auto& io_service : io_services) {
+        AMY_ASIO_NS::io_service* s = io_service.get();
+        threads.emplace_back([s] { s->run(); });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::size_t backlog = 0u;
+
+    for (auto& client : clients) {
+        backlog += client->backlog();
+    }
+
+    return backlog;
+}
+
+/// Runs \c bench.connections blocking connections, each on a thread of its
+/// own.
+static std::size_t run_blocking(workload& load) {
+    AMY_ASIO_NS::io_service io_service;
+    std::vector<std::unique_ptr<amy::connector>> connectors;
+
+    for (int i = 0; i < bench.connections; ++i) {
+        connectors.emplace_back(new amy::connector(io_service));
+        connect(*connectors.back());
+    }
+
+    load.start();
+
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> backlog(0u);
+
+    for (int i = 0; i < bench.connections; ++i) {
+        amy::connector& connector = *connectors[i];
+
+        threads.emplace_back([&load, &backlog, &connector, i] {
+            std::mt19937_64 random(i);
+            workload::distribution_type distribution = load.distribution();
+            arrivals schedule(bench.rate / bench.connections, load.started(),
+                              i + 1u);
+            std::string stmt;
+            uint64_t seq = 0u;
+
+            for (;;) {
+                clock_type::time_point intended = clock_type::now();
+
+                if (schedule.open_loop()) {
+                    intended = schedule.next();
+
+                    if (intended >= load.ended()) {
+                        break;
+                    }
+
+                    std::this_thread::sleep_until(intended);
+                    schedule.advance();
+                } else if (intended >= load.ended()) {
+                    break;
+                }
+
+                query_template& t = load.pick(distribution, random);
+                t.render(stmt, seq++, i, random);
+
+                AMY_SYSTEM_NS::error_code ec;
+                uint64_t rows = 0u;
+
+                connector.query(stmt, ec);
+
+                while (!ec) {
+                    rows += connector.store_result(ec).size();
+
+                    if (!connector.has_more_results()) {
+                        break;
+                    }
+                }
+
+                load.record(t, intended, ec, rows);
+
+                if (clock_type::now() >= load.ended()) {
+                    break;
+                }
+            }
+
+            // Arrivals past due when the run ended.
+            while (schedule.open_loop() && schedule.next() < load.ended()) {
+                schedule.advance();
+                ++backlog;
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return backlog;
+}
+
+static std::string json_escape(std::string const& s) {
+    std::ostringstream out;
+
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << int(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+
+    return out.str();
+}
+
+static void print_text(std::string const& name,
+                       amy::histogram_snapshot const& h,
+                       uint64_t errors,
+                       uint64_t rows)
+{
+    std::cout
+        << name << "\n"
+        << "  queries: " << h.count()
+        << " (" << h.count() / bench.duration << "/s), errors: " << errors
+        << ", rows: " << rows << "\n"
+        << "  latency (us): ";
+    print_latency_text(std::cout, h);
+    std::cout << std::endl;
+}
+
+static void print_json_stats(amy::histogram_snapshot const& h,
+                             uint64_t errors,
+                             uint64_t rows)
+{
+    std::cout
+        << "\"queries\": " << h.count()
+        << ", \"qps\": " << h.count() / bench.duration
+        << ", \"errors\": " << errors
+        << ", \"rows\": " << rows
+        << ", \"latency_us\": ";
+    print_latency_json(std::cout, h);
+}
+
+static void report(workload const& load, std::size_t backlog) {
+    uint64_t errors = 0u;
+    uint64_t rows = 0u;
+
+    for (auto const& t : load.templates()) {
+        errors += t->errors();
+        rows += t->rows();
+    }
+
+    if (!bench.json) {
+        std::cout
+            << "backend: " << bench.backend
+            << ", connections: " << bench.connections
+            << ", threads: " << bench.threads
+            << ", rate: " << (bench.rate > 0.0
+                              ? std::to_string(bench.rate) + "/s"
+                              : std::string("closed loop"))
+            << ", duration: " << bench.duration << "s\n" << std::endl;
+
+        for (auto const& t : load.templates()) {
+            print_text(t->text(), t->latency(), t->errors(), t->rows());
+        }
+
+        print_text("total", load.total(), errors, rows);
+
+        if (backlog) {
+            std::cout << "unserved arrivals: " << backlog << std::endl;
+        }
+
+        return;
+    }
+
+    std::cout
+        << "{\n  \"backend\": \"" << bench.backend << "\""
+        << ",\n  \"connections\": " << bench.connections
+        << ",\n  \"threads\": " << bench.threads
+        << ",\n  \"rate\": " << bench.rate
+        << ",\n  \"duration\": " << bench.duration
+        << ",\n  \"unserved_arrivals\": " << backlog
+        << ",\n  \"templates\": [";
+
+    for (std::size_t i = 0; i < load.templates().size(); ++i) {
+        query_template const& t = *load.templates()[i];
+
+        std::cout
+            << (i ? ",\n" : "\n")
+            << "    { \"query\": \"" << json_escape(t.text()) << "\", ";
+        print_json_stats(t.latency(), t.errors(), t.rows());
+        std::cout << " }";
+    }
+
+    std::cout << "\n  ],\n  \"total\": { ";
+    print_json_stats(load.total(), errors, rows);
+    std::cout << " }\n}" << std::endl;
+}
+
+static std::string usage = std::string(
+    "usage: amy-bench [options]\n"
+    "Available options:\n") + connection_usage +
+    "  -b [ --backend ] arg (=mysql)   blocking, mysql (mysql_service) or\n"
+    "                                  mariadb (mariadb_service).\n"
+    "  -c [ --connections ] arg (=8)   Number of connections.\n"
+    "  -t [ --threads ] arg (=1)       Number of io_service threads, for\n"
+    "                                  the asynchronous backends.\n"
+    "  -r [ --rate ] arg (=0)          Queries per second over all the\n"
+    "                                  connections, 0 for a closed loop.\n"
+    "  -d [ --duration ] arg (=10)     Seconds measured.\n"
+    "  -w [ --warmup ] arg (=1)        Seconds run before measuring.\n"
+    "  -q [ --query ] arg (=SELECT 1)  [WEIGHT:]TEMPLATE, repeatable, with\n"
+    "                                  {seq}, {conn} and {rand:LO:HI}\n"
+    "                                  placeholders.\n"
+    "  -f [ --query-file ] arg         A [WEIGHT:]TEMPLATE per line.\n"
+    "  -F [ --fake ]                   Run against an in-process fake\n"
+    "                                  server replying a row per query.\n"
+    "  -j [ --json ]                   Report as JSON.";
+
+static std::vector<option> options = long_options({
+    { "backend",     required_argument, NULL, 'b' },
+    { "connections", required_argument, NULL, 'c' },
+    { "threads",     required_argument, NULL, 't' },
+    { "rate",        required_argument, NULL, 'r' },
+    { "duration",    required_argument, NULL, 'd' },
+    { "warmup",      required_argument, NULL, 'w' },
+    { "query",       required_argument, NULL, 'q' },
+    { "query-file",  required_argument, NULL, 'f' },
+    { "fake",        no_argument,       NULL, 'F' },
+    { "json",        no_argument,       NULL, 'j' }
+});
+
+static std::string optstring =
+    std::string(connection_optstring) + "b:c:t:r:d:w:q:f:Fj";
+
+static void parse_options(int argc, char* argv[]) {
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, optstring.c_str(),
+                             options.data(), NULL)) != -1)
+    {
+        switch (ch) {
+            case 'h':
+                std::cout << usage << std::endl;
+                exit(EXIT_SUCCESS);
+                break;
+
+            case 'b':
+                bench.backend = optarg;
+                break;
+
+            case 'c':
+                bench.connections = atoi(optarg);
+                break;
+
+            case 't':
+                bench.threads = atoi(optarg);
+                break;
+
+            case 'r':
+                bench.rate = atof(optarg);
+                break;
+
+            case 'd':
+                bench.duration = atof(optarg);
+                break;
+
+            case 'w':
+                bench.warmup = atof(optarg);
+                break;
+
+            case 'q':
+                bench.queries.push_back(optarg);
+                break;
+
+            case 'f': {
+                std::ifstream in(optarg);
+                std::string line;
+
+                if (!in) {
+                    std::cerr << "Cannot read " << optarg << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                while (std::getline(in, line)) {
+                    if (!line.empty() && line[0] != '#') {
+                        bench.queries.push_back(line);
+                    }
+                }
+
+                break;
+            }
+
+            case 'F':
+                bench.fake = true;
+                break;
+
+            case 'j':
+                bench.json = true;
+                break;
+
+            default:
+                if (!parse_connection_option(ch, optarg)) {
+                    std::cerr << usage << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+        }
+    }
+
+    if (bench.connections < 1 || bench.threads < 1 || bench.duration <= 0.0)
+    {
+        std::cerr << "Connections, threads and duration must be positive."
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench.queries.empty()) {
+        bench.queries.push_back("SELECT 1");
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    parse_options(argc, argv);
+
+    std::unique_ptr<amy::test::fake_server> fake;
+
+    if (bench.fake) {
+        fake.reset(new amy::test::fake_server(
+                    amy::test::fake_result::rows({ "1" }, { { "1" } })));
+        opts.host = fake->endpoint().address().to_string();
+        opts.port = fake->endpoint().port();
+    }
+
+    workload load(bench.queries);
+    std::size_t backlog = 0u;
+
+    if (bench.backend == "blocking") {
+        backlog = run_blocking(load);
+    } else if (bench.backend == "mysql") {
+        backlog = run_async<amy::connector>(load);
+#if defined(AMY_BENCHMARK_MARIADB)
+    } else if (bench.backend == "mariadb") {
+        backlog = run_async<amy::mariadb_connector>(load);
+#endif
+    } else {
+        std::cerr << "Unsupported backend: " << bench.backend << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    report(load, backlog);
+    return EXIT_SUCCESS;
+} catch (AMY_SYSTEM_NS::system_error const& e) {
+    report_system_error(e);
+    return EXIT_FAILURE;
+} catch (std::exception const& e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
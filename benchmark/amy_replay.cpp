@@ -0,0 +1,478 @@
+// amy-replay: replays a workload captured by amy::workload_recorder, and
+// compares the latencies and result shapes of the replay with the captured
+// ones.  Run with -h for its options.
+//
+// Each captured connection is replayed by a connection of its own, issuing
+// its statements in the captured order, at their captured times scaled down
+// by --speed.  A statement is never issued before the previous one of its
+// connection completed, so that a slower server shows up as lag behind the
+// captured schedule.  Latencies are measured from issuing each statement to
+// running its handler, like in the capture.
+
+#include "benchmark_support.hpp"
+#include "fake_server.hpp"
+#include "utils.hpp"
+
+#include <amy/connector.hpp>
+#include <amy/workload_capture.hpp>
+
+#if defined(AMY_BENCHMARK_MARIADB)
+#include <amy/mariadb_connector.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+global_options opts;
+
+/// Options of the replay itself, on top of the connection ones.
+struct replay_options {
+    /// "mysql" or "mariadb".
+    std::string backend = "mysql";
+
+    /// Number of io_service instances, each run by a thread of its own.
+    int threads = 1;
+
+    /// How many times faster than captured to replay, 0 to issue each
+    /// statement as soon as the previous one of its connection completes.
+    double speed = 1.0;
+
+    /// Runs against an in-process fake server, to measure amy alone.
+    bool fake = false;
+
+    bool json = false;
+
+    std::string capture;
+
+}; // struct replay_options
+
+static replay_options replay;
+
+/// The captured statements, per connection, and the figures of the replay.
+class workload {
+public:
+    typedef std::vector<amy::workload_record> statements_type;
+
+    explicit workload(std::string const& path) :
+        span_(clock_type::duration::zero()),
+        statements_(0u),
+        errors_(0u),
+        mismatches_(0u),
+        captured_errors_(0u)
+    {
+        std::ifstream in(path, std::ios::binary);
+
+        if (!in) {
+            throw std::runtime_error("cannot read " + path);
+        }
+
+        amy::workload_reader reader(in);
+        std::map<uint64_t, statements_type> connections;
+        amy::workload_record record;
+
+        while (reader.next(record)) {
+            captured_.record(record.latency);
+            captured_errors_ += record.error ? 1u : 0u;
+            span_ = std::max(span_, std::chrono::duration_cast<
+                                 clock_type::duration>(record.issued));
+            connections[record.connection].push_back(std::move(record));
+        }
+
+        for (auto& connection : connections) {
+            statements_type& s = connection.second;
+
+            // Records are written as statements complete.
+            std::stable_sort(s.begin(), s.end(),
+                             [](amy::workload_record const& a,
+                                amy::workload_record const& b) {
+                                 return a.issued < b.issued;
+                             });
+            connections_.push_back(std::move(s));
+        }
+    }
+
+    std::vector<statements_type> const& connections() const {
+        return connections_;
+    }
+
+    /// Starts the replay, once all the connections are open.
+    void start() {
+        started_ = clock_type::now();
+    }
+
+    clock_type::time_point started() const {
+        return started_;
+    }
+
+    /// The time to issue \p record at.
+    clock_type::time_point scheduled(amy::workload_record const& record) const
+    {
+        if (replay.speed <= 0.0) {
+            return started_;
+        }
+
+        return started_ + std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(record.issued) / replay.speed);
+    }
+
+    /// Records the replay of \p record, issued at \p issued.
+    void record(amy::workload_record const& record,
+                clock_type::time_point scheduled,
+                clock_type::time_point issued,
+                AMY_SYSTEM_NS::error_code const& ec,
+                amy::result_set const& rs)
+    {
+        replayed_.record(clock_type::now() - issued);
+        statements_.fetch_add(1u, std::memory_order_relaxed);
+
+        if (ec) {
+            errors_.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        // Statements captured from async_query have no result shape.
+        bool mismatch = ec.value() != record.error ||
+            (!ec && record.fields &&
+             (rs.size() != record.rows || rs.field_count() != record.fields));
+
+        if (mismatch) {
+            mismatches_.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        if (replay.speed > 0.0) {
+            lag_.record(std::max(issued - scheduled,
+                                 clock_type::duration::zero()));
+        }
+    }
+
+    /// Time from the first captured statement to the last one.
+    clock_type::duration span() const {
+        return span_;
+    }
+
+    amy::histogram_snapshot captured() const {
+        return captured_.snapshot();
+    }
+
+    amy::histogram_snapshot replayed() const {
+        return replayed_.snapshot();
+    }
+
+    amy::histogram_snapshot lag() const {
+        return lag_.snapshot();
+    }
+
+    uint64_t statements() const {
+        return statements_.load();
+    }
+
+    uint64_t errors() const {
+        return errors_.load();
+    }
+
+    uint64_t captured_errors() const {
+        return captured_errors_;
+    }
+
+    uint64_t mismatches() const {
+        return mismatches_.load();
+    }
+
+private:
+    std::vector<statements_type> connections_;
+    clock_type::duration span_;
+    clock_type::time_point started_;
+    std::atomic<uint64_t> statements_;
+    std::atomic<uint64_t> errors_;
+    std::atomic<uint64_t> mismatches_;
+    uint64_t captured_errors_;
+    amy::latency_histogram captured_;
+    amy::latency_histogram replayed_;
+    amy::latency_histogram lag_;
+
+}; // class workload
+
+/// Replays the statements of a captured connection.
+template<typename Connector>
+class replay_client {
+public:
+    replay_client(AMY_ASIO_NS::io_service& io_service,
+                  workload& load,
+                  workload::statements_type const& statements) :
+        connector_(io_service),
+        timer_(io_service),
+        load_(load),
+        statements_(statements),
+        next_(0u)
+    {
+        connector_.connect(opts.tcp_endpoint(),
+                           opts.auth_info(),
+                           opts.schema,
+                           amy::default_flags);
+    }
+
+    void start() {
+        if (next_ == statements_.size()) {
+            return;
+        }
+
+        clock_type::time_point scheduled =
+            load_.scheduled(statements_[next_]);
+
+        if (scheduled <= clock_type::now()) {
+            issue(scheduled);
+            return;
+        }
+
+        timer_.expires_at(scheduled);
+        timer_.async_wait([this, scheduled](
+                    AMY_SYSTEM_NS::error_code const& ec) {
+            if (!ec) {
+                issue(scheduled);
+            }
+        });
+    }
+
+private:
+    Connector connector_;
+    AMY_ASIO_NS::steady_timer timer_;
+    workload& load_;
+    workload::statements_type const& statements_;
+    std::size_t next_;
+
+    void issue(clock_type::time_point scheduled) {
+        amy::workload_record const& record = statements_[next_++];
+        clock_type::time_point issued = clock_type::now();
+
+        connector_.async_query_result(
+                record.statement,
+                [this, &record, scheduled, issued](
+                    AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs)
+                {
+                    load_.record(record, scheduled, issued, ec, rs);
+                    start();
+                });
+    }
+
+}; // class replay_client
+
+/// Replays the captured connections over \c replay.threads io_service
+/// instances, and returns the time it took.
+template<typename Connector>
+static clock_type::duration run(workload& load) {
+    std::vector<std::unique_ptr<AMY_ASIO_NS::io_service>> io_services;
+    std::vector<std::unique_ptr<replay_client<Connector>>> clients;
+
+    for (int i = 0; i < replay.threads; ++i) {
+        io_services.emplace_back(new AMY_ASIO_NS::io_service);
+    }
+
+    for (std::size_t i = 0; i < load.connections().size(); ++i) {
+        clients.emplace_back(new replay_client<Connector>(
+                    *io_services[i % replay.threads], load,
+                    load.connections()[i]));
+    }
+
+    load.start();
+
+    for (auto& client : clients) {
+        client->start();
+    }
+
+    std::vector<std::thread> threads;
+
+    for (auto& io_service : io_services) {
+        AMY_ASIO_NS::io_service* s = io_service.get();
+        threads.emplace_back([s] { s->run(); });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return clock_type::now() - load.started();
+}
+
+static void print_text(char const* name, amy::histogram_snapshot const& h) {
+    std::cout << name << " latency (us): ";
+    print_latency_text(std::cout, h);
+    std::cout << std::endl;
+}
+
+static void print_json_latency(char const* name,
+                               amy::histogram_snapshot const& h)
+{
+    std::cout << ",\n  \"" << name << "_us\": ";
+    print_latency_json(std::cout, h);
+}
+
+static void report(workload const& load, clock_type::duration elapsed) {
+    if (!replay.json) {
+        std::cout
+            << "backend: " << replay.backend
+            << ", connections: " << load.connections().size()
+            << ", threads: " << replay.threads
+            << ", speed: " << (replay.speed > 0.0
+                               ? std::to_string(replay.speed) + "x"
+                               : std::string("unpaced")) << "\n"
+            << "statements: " << load.statements()
+            << ", errors: " << load.errors()
+            << " (captured: " << load.captured_errors() << ")"
+            << ", mismatched results: " << load.mismatches() << "\n"
+            << "duration: " << seconds(elapsed)
+            << "s (captured: " << seconds(load.span()) << "s)\n"
+            << std::endl;
+
+        print_text("captured", load.captured());
+        print_text("replayed", load.replayed());
+
+        if (replay.speed > 0.0) {
+            print_text("lag", load.lag());
+        }
+
+        return;
+    }
+
+    std::cout
+        << "{\n  \"backend\": \"" << replay.backend << "\""
+        << ",\n  \"connections\": " << load.connections().size()
+        << ",\n  \"threads\": " << replay.threads
+        << ",\n  \"speed\": " << replay.speed
+        << ",\n  \"statements\": " << load.statements()
+        << ",\n  \"errors\": " << load.errors()
+        << ",\n  \"captured_errors\": " << load.captured_errors()
+        << ",\n  \"mismatches\": " << load.mismatches()
+        << ",\n  \"duration\": " << seconds(elapsed)
+        << ",\n  \"captured_duration\": " << seconds(load.span());
+
+    print_json_latency("captured", load.captured());
+    print_json_latency("replayed", load.replayed());
+
+    if (replay.speed > 0.0) {
+        print_json_latency("lag", load.lag());
+    }
+
+    std::cout << "\n}" << std::endl;
+}
+
+static std::string usage = std::string(
+    "usage: amy-replay [options] CAPTURE\n"
+    "Available options:\n") + connection_usage +
+    "  -b [ --backend ] arg (=mysql)   mysql (mysql_service) or mariadb\n"
+    "                                  (mariadb_service).\n"
+    "  -t [ --threads ] arg (=1)       Number of io_service threads.\n"
+    "  -x [ --speed ] arg (=1)         Times faster than captured, 0 to\n"
+    "                                  issue statements back to back.\n"
+    "  -F [ --fake ]                   Replay against an in-process fake\n"
+    "                                  server replying a row per query.\n"
+    "  -j [ --json ]                   Report as JSON.";
+
+static std::vector<option> options = long_options({
+    { "backend",  required_argument, NULL, 'b' },
+    { "threads",  required_argument, NULL, 't' },
+    { "speed",    required_argument, NULL, 'x' },
+    { "fake",     no_argument,       NULL, 'F' },
+    { "json",     no_argument,       NULL, 'j' }
+});
+
+static std::string optstring = std::string(connection_optstring) + "b:t:x:Fj";
+
+static void parse_options(int argc, char* argv[]) {
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, optstring.c_str(),
+                             options.data(), NULL)) != -1)
+    {
+        switch (ch) {
+            case 'h':
+                std::cout << usage << std::endl;
+                exit(EXIT_SUCCESS);
+                break;
+
+            case 'b':
+                replay.backend = optarg;
+                break;
+
+            case 't':
+                replay.threads = atoi(optarg);
+                break;
+
+            case 'x':
+                replay.speed = atof(optarg);
+                break;
+
+            case 'F':
+                replay.fake = true;
+                break;
+
+            case 'j':
+                replay.json = true;
+                break;
+
+            default:
+                if (!parse_connection_option(ch, optarg)) {
+                    std::cerr << usage << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+        }
+    }
+
+    if (optind + 1 != argc) {
+        std::cerr << usage << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    replay.capture = argv[optind];
+
+    if (replay.threads < 1 || replay.speed < 0.0) {
+        std::cerr << "Threads must be positive, and speed not negative."
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char* argv[]) try {
+    parse_options(argc, argv);
+
+    std::unique_ptr<amy::test::fake_server> fake;
+
+    if (replay.fake) {
+        fake.reset(new amy::test::fake_server(
+                    amy::test::fake_result::rows({ "1" }, { { "1" } })));
+        opts.host = fake->endpoint().address().to_string();
+        opts.port = fake->endpoint().port();
+    }
+
+    workload load(replay.capture);
+    clock_type::duration elapsed;
+
+    if (replay.backend == "mysql") {
+        elapsed = run<amy::connector>(load);
+#if defined(AMY_BENCHMARK_MARIADB)
+    } else if (replay.backend == "mariadb") {
+        elapsed = run<amy::mariadb_connector>(load);
+#endif
+    } else {
+        std::cerr << "Unsupported backend: " << replay.backend << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    report(load, elapsed);
+    return EXIT_SUCCESS;
+} catch (AMY_SYSTEM_NS::system_error const& e) {
+    report_system_error(e);
+    return EXIT_FAILURE;
+} catch (std::exception const& e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,197 @@
+#ifndef __AMY_BENCHMARK_SUPPORT_HPP__
+#define __AMY_BENCHMARK_SUPPORT_HPP__
+
+// Timing, reporting and command line helpers shared by the benchmark tools.
+
+#include "utils.hpp"
+
+#include <amy/asio.hpp>
+#include <amy/latency_histogram.hpp>
+#include <amy/placeholders.hpp>
+#include <amy/result_set.hpp>
+
+#include <getopt.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock clock_type;
+
+inline double seconds(clock_type::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+inline double seconds_since(clock_type::time_point started) {
+    return seconds(clock_type::now() - started);
+}
+
+inline double micros(std::chrono::nanoseconds d) {
+    return d.count() / 1e3;
+}
+
+/// A figure of a benchmark suite, reported by \c print_json.
+struct measurement {
+    std::string name;
+    double value;
+    char const* unit;
+};
+
+inline std::vector<measurement>& measurements() {
+    static std::vector<measurement> results;
+    return results;
+}
+
+inline void record(std::string const& name, double value, char const* unit) {
+    measurements().push_back(measurement { name, value, unit });
+}
+
+/// Prints the recorded measurements, as read by run_benchmarks.sh.
+inline void print_json() {
+    std::vector<measurement> const& results = measurements();
+
+    std::cout << "{\n  \"benchmarks\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        measurement const& m = results[i];
+
+        std::cout
+            << (i ? ",\n" : "\n")
+            << "    { \"name\": \"" << m.name
+            << "\", \"value\": " << m.value
+            << ", \"unit\": \"" << m.unit << "\" }";
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+/// Prints the mean, percentiles and maximum of \p h, in microseconds.
+inline void print_latency_text(std::ostream& out,
+                               amy::histogram_snapshot const& h)
+{
+    out << "mean " << micros(h.mean())
+        << ", p50 " << micros(h.percentile(50))
+        << ", p90 " << micros(h.percentile(90))
+        << ", p99 " << micros(h.percentile(99))
+        << ", p99.9 " << micros(h.percentile(99.9))
+        << ", max " << micros(h.max());
+}
+
+/// Same as \c print_latency_text, as a JSON object.
+inline void print_latency_json(std::ostream& out,
+                               amy::histogram_snapshot const& h)
+{
+    out << "{ \"mean\": " << micros(h.mean())
+        << ", \"p50\": " << micros(h.percentile(50))
+        << ", \"p90\": " << micros(h.percentile(90))
+        << ", \"p99\": " << micros(h.percentile(99))
+        << ", \"p999\": " << micros(h.percentile(99.9))
+        << ", \"max\": " << micros(h.max()) << " }";
+}
+
+/// Issues \c SELECT \c 1 queries back to back over a connector.
+template<typename Connector>
+class select_one_client {
+public:
+    select_one_client(Connector& connector, int queries) :
+        connector_(connector),
+        remaining_(queries)
+    {}
+
+    void start() {
+        connector_.async_query_result(
+                "SELECT 1",
+                std::bind(&select_one_client::handle_query_result,
+                          this,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+private:
+    Connector& connector_;
+    int remaining_;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set)
+    {
+        if (ec) {
+            throw AMY_SYSTEM_NS::system_error(ec);
+        }
+
+        if (--remaining_ > 0) {
+            start();
+        }
+    }
+
+}; // class select_one_client
+
+// Command line options of the connection, which the tools taking options of
+// their own complete.
+
+/// Short options of the connection, for \c getopt_long.
+static char const connection_optstring[] = "hH:P:u:p:s:";
+
+static char const connection_usage[] =
+    "  -h [ --help ]                   Show this help message\n"
+    "  -H [ --host ] arg (=127.0.0.1)  MySQL server host.\n"
+    "  -P [ --port ] arg (=3306)       MySQL server port.\n"
+    "  -u [ --user ] arg (=amy)        Login user.\n"
+    "  -p [ --password ] arg (=amy)    Login password.\n"
+    "  -s [ --schema ] arg (=test_amy) Default schema to use.\n";
+
+/// Long options of the connection followed by \p extra, terminated for \c
+/// getopt_long.
+inline std::vector<option> long_options(std::initializer_list<option> extra) {
+    std::vector<option> options = {
+        { "help",     no_argument,       NULL, 'h' },
+        { "host",     required_argument, NULL, 'H' },
+        { "port",     required_argument, NULL, 'P' },
+        { "user",     required_argument, NULL, 'u' },
+        { "password", required_argument, NULL, 'p' },
+        { "schema",   required_argument, NULL, 's' }
+    };
+
+    options.insert(options.end(), extra.begin(), extra.end());
+    options.push_back(option { NULL, 0, NULL, 0 });
+    return options;
+}
+
+/// Applies the connection option \p ch to \c opts.
+/**
+ * \return false if \p ch is not a connection option.
+ */
+inline bool parse_connection_option(int ch, char const* arg) {
+    switch (ch) {
+        case 'H':
+            opts.host = arg;
+            return true;
+
+        case 'P':
+            opts.port = atoi(arg);
+            return true;
+
+        case 'u':
+            opts.user = arg;
+            return true;
+
+        case 'p':
+            opts.password = arg;
+            return true;
+
+        case 's':
+            opts.schema = arg;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+#endif // __AMY_BENCHMARK_SUPPORT_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,171 @@
+// Compares the throughput and the heap allocations per query of callback and
+// coroutine based code issuing queries on a single mariadb_connector.
+
+#include "utils.hpp"
+
+#include <amy/mariadb_connector.hpp>
+#include <amy/placeholders.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+
+global_options opts;
+
+static std::atomic<std::size_t> allocations(0);
+
+void* operator new(std::size_t size) {
+    ++allocations;
+
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static const int queries = 20000;
+static const char* statement = "SELECT 1";
+
+struct result {
+    std::chrono::steady_clock::duration elapsed;
+    std::size_t allocations;
+};
+
+static void report(char const* name, result const& r) {
+    double seconds = std::chrono::duration<double>(r.elapsed).count();
+
+    std::cout
+        << name << ": "
+        << static_cast<int>(queries / seconds) << " queries/s, "
+        << static_cast<double>(r.allocations) / queries << " allocations/query"
+        << std::endl;
+}
+
+class callback_client {
+public:
+    explicit callback_client(amy::mariadb_connector& connector) :
+        connector_(connector),
+        remaining_(queries)
+    {}
+
+    void start() {
+        connector_.async_query_result(
+                statement,
+                std::bind(&callback_client::handle_query_result,
+                          this,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+private:
+    amy::mariadb_connector& connector_;
+    int remaining_;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set)
+    {
+        check_error(ec);
+
+        if (--remaining_ > 0) {
+            start();
+        }
+    }
+
+}; // class callback_client
+
+static result run_callbacks(AMY_ASIO_NS::io_service& io_service,
+                            amy::mariadb_connector& connector)
+{
+    callback_client client(connector);
+
+    std::size_t allocations_before = allocations;
+    auto started = std::chrono::steady_clock::now();
+
+    client.start();
+    io_service.run();
+    io_service.restart();
+
+    return result {
+        std::chrono::steady_clock::now() - started,
+        allocations - allocations_before
+    };
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+static AMY_ASIO_NS::awaitable<void> coroutine_client(
+        amy::mariadb_connector& connector)
+{
+    for (int i = 0; i < queries; ++i) {
+        co_await connector.async_query_result(statement,
+                                              AMY_ASIO_NS::use_awaitable);
+    }
+}
+
+static result run_coroutine(AMY_ASIO_NS::io_service& io_service,
+                            amy::mariadb_connector& connector)
+{
+    std::size_t allocations_before = allocations;
+    auto started = std::chrono::steady_clock::now();
+
+    AMY_ASIO_NS::co_spawn(io_service,
+                          coroutine_client(connector),
+                          AMY_ASIO_NS::detached);
+    io_service.run();
+    io_service.restart();
+
+    return result {
+        std::chrono::steady_clock::now() - started,
+        allocations - allocations_before
+    };
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    parse_command_line_options(argc, argv);
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::mariadb_connector connector(io_service);
+
+    try {
+        connector.connect(opts.tcp_endpoint(),
+                          opts.auth_info(),
+                          opts.schema,
+                          amy::default_flags);
+
+        // Warms up the connection and the allocators.
+        run_callbacks(io_service, connector);
+
+        report("callback", run_callbacks(io_service, connector));
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+        report("coroutine", run_coroutine(io_service, connector));
+#else
+        std::cout << "coroutine: not supported by the compiler" << std::endl;
+#endif
+    } catch (AMY_SYSTEM_NS::system_error const& e) {
+        report_system_error(e);
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
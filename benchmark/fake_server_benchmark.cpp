@@ -0,0 +1,176 @@
+// Measures the client side alone: small query throughput of the services and
+// result set decoding, against the in-process fake server of the tests, so
+// that no database is needed and server time does not blur the results.
+// Prints the results as JSON, like suite_benchmark.
+
+#include "benchmark_support.hpp"
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+
+#if defined(AMY_BENCHMARK_MARIADB)
+#include <amy/mariadb_connector.hpp>
+#endif
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using amy::test::fake_column;
+using amy::test::fake_response;
+using amy::test::fake_result;
+using amy::test::fake_row;
+using amy::test::fake_server;
+
+template<typename Connector>
+static void connect(Connector& connector, fake_server const& server) {
+    connector.connect(server.endpoint(),
+                      amy::auth_info("amy", "amy"),
+                      "",
+                      amy::default_flags);
+}
+
+/// Replies to "rows <rows> <columns>" with as many integer columns and rows,
+/// and to anything else with a single row holding 1.
+static fake_response generate(std::string const& query) {
+    unsigned rows = 1u;
+    unsigned columns = 1u;
+
+    if (query.compare(0, 5, "rows ") == 0) {
+        std::size_t end = 0u;
+        rows = std::stoul(query.substr(5u), &end);
+        columns = std::stoul(query.substr(5u + end));
+    }
+
+    std::vector<fake_column> names;
+
+    for (unsigned i = 0; i < columns; ++i) {
+        names.push_back(fake_column("c" + std::to_string(i), 0x08));
+    }
+
+    return fake_result::rows(std::move(names), rows,
+                             [](std::size_t n, fake_row& row) {
+                                 for (std::size_t i = 0; i < row.size(); ++i) {
+                                     row.set(i, n + 1u);
+                                 }
+                             });
+}
+
+static void bench_blocking_query(fake_server const& server) {
+    static const int queries = 20000;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    auto started = clock_type::now();
+
+    for (int i = 0; i < queries; ++i) {
+        connector.query("SELECT 1");
+        connector.store_result();
+    }
+
+    record("mysql_service.blocking_query", queries / seconds_since(started),
+           "queries/s");
+}
+
+/// Runs \p clients connections at once, each issuing queries back to back.
+template<typename Connector>
+static void bench_async_query(fake_server const& server,
+                              std::string const& name,
+                              int clients)
+{
+    static const int queries = 20000;
+
+    AMY_ASIO_NS::io_service io_service;
+    std::vector<std::unique_ptr<Connector>> connectors;
+    std::vector<std::unique_ptr<select_one_client<Connector>>> async_clients;
+
+    for (int i = 0; i < clients; ++i) {
+        connectors.emplace_back(new Connector(io_service));
+        connect(*connectors.back(), server);
+        async_clients.emplace_back(new select_one_client<Connector>(
+                    *connectors.back(), queries / clients));
+    }
+
+    auto started = clock_type::now();
+
+    for (auto& client : async_clients) {
+        client->start();
+    }
+
+    io_service.run();
+
+    record(name + ".async_query.x" + std::to_string(clients),
+           queries / seconds_since(started),
+           "queries/s");
+}
+
+/// Times the transfer and decoding of result sets, without server time.
+static void bench_store_result(fake_server const& server) {
+    static const int iterations = 20;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    for (int rows : { 10, 1000, 100000 }) {
+        for (int columns : { 1, 8, 32 }) {
+            std::string stmt = "rows " + std::to_string(rows) + " " +
+                               std::to_string(columns);
+            double elapsed = 0.0;
+            amy::sql_bigint sum = 0;
+
+            for (int i = 0; i < iterations; ++i) {
+                auto started = clock_type::now();
+                amy::result_set rs = connector.query_result(stmt);
+
+                for (auto const& row : rs) {
+                    for (auto const& field : row) {
+                        sum += field.as<amy::sql_bigint>();
+                    }
+                }
+
+                elapsed += seconds_since(started);
+            }
+
+            record("decode." + std::to_string(rows) + "x" +
+                       std::to_string(columns),
+                   rows * iterations / elapsed,
+                   "rows/s");
+
+            if (sum == 0) {
+                std::cerr << "unexpected sum" << std::endl;
+            }
+        }
+    }
+}
+
+int main() {
+    fake_server server(&generate);
+
+    try {
+        bench_blocking_query(server);
+
+        for (int clients : { 1, 8 }) {
+            bench_async_query<amy::connector>(server, "mysql_service",
+                                              clients);
+#if defined(AMY_BENCHMARK_MARIADB)
+            bench_async_query<amy::mariadb_connector>(server,
+                                                      "mariadb_service",
+                                                      clients);
+#endif
+        }
+
+        bench_store_result(server);
+    } catch (AMY_SYSTEM_NS::system_error const& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    print_json();
+    return 0;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Bootstraps a throwaway MariaDB or MySQL server into a temporary directory,
+# runs the benchmark suite against it and writes its JSON report.
+#
+# usage: run_benchmarks.sh SUITE_BENCHMARK [REPORT]
+#
+# The report goes to stdout unless REPORT is given.  AMY_BENCHMARK_PORT
+# overrides the TCP port of the server, 13306 by default.
+
+set -e
+
+bench=$1
+report=${2:-/dev/stdout}
+port=${AMY_BENCHMARK_PORT:-13306}
+
+if [ -z "$bench" ]; then
+    echo "usage: $0 SUITE_BENCHMARK [REPORT]" >&2
+    exit 2
+fi
+
+server=$(command -v mariadbd || command -v mysqld || true)
+client=$(command -v mariadb || command -v mysql || true)
+
+if [ -z "$server" ] || [ -z "$client" ]; then
+    echo "$0: mariadbd/mysqld and the mariadb/mysql client are required" >&2
+    exit 1
+fi
+
+dir=$(mktemp -d)
+pid=
+
+cleanup() {
+    if [ -n "$pid" ]; then
+        kill "$pid" 2>/dev/null || true
+        wait "$pid" 2>/dev/null || true
+    fi
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+install_db=$(command -v mariadb-install-db || command -v mysql_install_db || true)
+
+if [ -n "$install_db" ] && "$server" --version | grep -qi mariadb; then
+    "$install_db" --no-defaults --datadir="$dir/data" --user="$(id -un)" \
+        --auth-root-authentication-method=normal >"$dir/install.log" 2>&1
+else
+    "$server" --no-defaults --initialize-insecure --datadir="$dir/data" \
+        --user="$(id -un)" >"$dir/install.log" 2>&1
+fi
+
+"$server" --no-defaults --datadir="$dir/data" --user="$(id -un)" \
+    --socket="$dir/mysqld.sock" --port="$port" --bind-address=127.0.0.1 \
+    --pid-file="$dir/mysqld.pid" --log-error="$dir/error.log" &
+pid=$!
+
+tries=0
+until "$client" --no-defaults -S "$dir/mysqld.sock" -uroot \
+        -e 'SELECT 1' >/dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ "$tries" -ge 60 ]; then
+        echo "$0: server did not start, see below" >&2
+        cat "$dir/error.log" >&2
+        exit 1
+    fi
+    sleep 0.5
+done
+
+"$client" --no-defaults -S "$dir/mysqld.sock" -uroot <<EOF
+CREATE DATABASE test_amy;
+CREATE USER 'amy'@'127.0.0.1' IDENTIFIED BY 'amy';
+GRANT ALL ON test_amy.* TO 'amy'@'127.0.0.1';
+EOF
+
+"$bench" --host 127.0.0.1 --port "$port" --user amy --password amy \
+    --schema test_amy >"$report"
@@ -0,0 +1,183 @@
+// Measures connect latency, small query throughput, result set transfer and
+// decoding, value_cast per type and the overhead of the asynchronous
+// services, and prints the results as JSON.  See run_benchmarks.sh for
+// running it against a throwaway server.
+
+#include "benchmark_support.hpp"
+#include "utils.hpp"
+
+#include <amy/connector.hpp>
+
+#if defined(AMY_BENCHMARK_MARIADB)
+#include <amy/mariadb_connector.hpp>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+global_options opts;
+
+template<typename Connector>
+static void connect(Connector& connector) {
+    connector.connect(opts.tcp_endpoint(),
+                      opts.auth_info(),
+                      opts.schema,
+                      amy::default_flags);
+}
+
+template<typename Connector>
+static void bench_connect(std::string const& name) {
+    static const int connects = 50;
+
+    AMY_ASIO_NS::io_service io_service;
+    std::vector<double> samples;
+
+    for (int i = 0; i < connects; ++i) {
+        Connector connector(io_service);
+
+        auto started = clock_type::now();
+        connect(connector);
+        samples.push_back(seconds_since(started) * 1e6);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    record(name + ".connect.p50", samples[samples.size() / 2], "us");
+    record(name + ".connect.p99", samples[samples.size() * 99 / 100], "us");
+}
+
+template<typename Connector>
+static void bench_blocking_query(std::string const& name) {
+    static const int queries = 5000;
+
+    AMY_ASIO_NS::io_service io_service;
+    Connector connector(io_service);
+    connect(connector);
+
+    auto started = clock_type::now();
+
+    for (int i = 0; i < queries; ++i) {
+        connector.query("SELECT 1");
+        connector.store_result();
+    }
+
+    record(name + ".blocking_query", queries / seconds_since(started),
+           "queries/s");
+}
+
+template<typename Connector>
+static void bench_async_query(std::string const& name) {
+    static const int queries = 5000;
+
+    AMY_ASIO_NS::io_service io_service;
+    Connector connector(io_service);
+    connect(connector);
+
+    select_one_client<Connector> client(connector, queries);
+
+    auto started = clock_type::now();
+    client.start();
+    io_service.run();
+
+    record(name + ".async_query", queries / seconds_since(started),
+           "queries/s");
+}
+
+/// A statement generating \p rows rows of \p columns integer columns.
+static std::string generate_rows(int rows, int columns) {
+    std::string stmt =
+        "WITH RECURSIVE s(n) AS (SELECT 1 UNION ALL "
+        "SELECT n + 1 FROM s WHERE n < " + std::to_string(rows) + ") SELECT ";
+
+    for (int i = 0; i < columns; ++i) {
+        stmt += (i ? ", n AS c" : "n AS c") + std::to_string(i);
+    }
+
+    return stmt + " FROM s";
+}
+
+/// Times \c store_result, i.e. the transfer of the rows and the building of
+/// the \c row and \c field wrappers by \c result_set::assign.
+static void bench_store_result() {
+    static const int iterations = 20;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector);
+
+    for (int rows : { 10, 100, 1000 }) {
+        for (int columns : { 1, 8, 32 }) {
+            std::string stmt = generate_rows(rows, columns);
+            double elapsed = 0.0;
+
+            for (int i = 0; i < iterations; ++i) {
+                connector.query(stmt);
+
+                auto started = clock_type::now();
+                connector.store_result();
+                elapsed += seconds_since(started);
+            }
+
+            record("store_result." + std::to_string(rows) + "x" +
+                       std::to_string(columns),
+                   rows * iterations / elapsed,
+                   "rows/s");
+        }
+    }
+}
+
+template<typename SQLType>
+static void bench_value_cast(std::string const& type, char const* value) {
+    static const int casts = 1000000;
+
+    amy::field f(value);
+    std::size_t sink = 0;
+
+    auto started = clock_type::now();
+
+    for (int i = 0; i < casts; ++i) {
+        sink += sizeof(f.as<SQLType>());
+    }
+
+    double elapsed = seconds_since(started);
+
+    record("value_cast." + type, elapsed * 1e9 / casts, "ns");
+
+    if (sink == 0) {
+        std::cerr << "unexpected sink value" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    parse_command_line_options(argc, argv);
+
+    try {
+        bench_connect<amy::connector>("mysql_service");
+        bench_blocking_query<amy::connector>("mysql_service");
+        bench_async_query<amy::connector>("mysql_service");
+
+#if defined(AMY_BENCHMARK_MARIADB)
+        bench_connect<amy::mariadb_connector>("mariadb_service");
+        bench_async_query<amy::mariadb_connector>("mariadb_service");
+#endif
+
+        bench_store_result();
+    } catch (AMY_SYSTEM_NS::system_error const& e) {
+        report_system_error(e);
+        return 1;
+    }
+
+    bench_value_cast<amy::sql_bigint>("bigint", "1234567890123");
+    bench_value_cast<amy::sql_int>("int", "123456");
+    bench_value_cast<amy::sql_double>("double", "3.14159265358979");
+    bench_value_cast<amy::sql_varchar>("varchar", "the quick brown fox");
+    bench_value_cast<amy::sql_datetime>("datetime", "2020-02-29 12:34:56");
+    bench_value_cast<amy::sql_time>("time", "12:34:56");
+
+    print_json();
+    return 0;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,143 @@
+// Counts the reactor system calls issued per query by mariadb_connector, by
+// interposing epoll_ctl and timerfd_settime.  Linux only.
+
+#include "utils.hpp"
+
+#include <amy/mariadb_connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+global_options opts;
+
+static std::atomic<std::size_t> epoll_ctl_calls[4];
+static std::atomic<std::size_t> timerfd_settime_calls(0);
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    typedef int (*epoll_ctl_type)(int, int, int, struct epoll_event*);
+    static epoll_ctl_type next =
+        reinterpret_cast<epoll_ctl_type>(dlsym(RTLD_NEXT, "epoll_ctl"));
+
+    ++epoll_ctl_calls[op >= 1 && op <= 3 ? op : 0];
+    return next(epfd, op, fd, event);
+}
+
+extern "C" int timerfd_settime(int fd,
+                               int flags,
+                               struct itimerspec const* new_value,
+                               struct itimerspec* old_value)
+{
+    typedef int (*timerfd_settime_type)(int,
+                                        int,
+                                        struct itimerspec const*,
+                                        struct itimerspec*);
+    static timerfd_settime_type next =
+        reinterpret_cast<timerfd_settime_type>(
+                dlsym(RTLD_NEXT, "timerfd_settime"));
+
+    ++timerfd_settime_calls;
+    return next(fd, flags, new_value, old_value);
+}
+
+static const int queries = 20000;
+
+struct counters {
+    std::size_t add;
+    std::size_t mod;
+    std::size_t del;
+    std::size_t timer;
+
+    static counters now() {
+        return counters {
+            epoll_ctl_calls[EPOLL_CTL_ADD],
+            epoll_ctl_calls[EPOLL_CTL_MOD],
+            epoll_ctl_calls[EPOLL_CTL_DEL],
+            timerfd_settime_calls
+        };
+    }
+
+}; // struct counters
+
+class client {
+public:
+    explicit client(amy::mariadb_connector& connector) :
+        connector_(connector),
+        remaining_(queries)
+    {}
+
+    void start() {
+        connector_.async_query_result(
+                "SELECT 1",
+                std::bind(&client::handle_query_result,
+                          this,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+private:
+    amy::mariadb_connector& connector_;
+    int remaining_;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set)
+    {
+        check_error(ec);
+
+        if (--remaining_ > 0) {
+            start();
+        }
+    }
+
+}; // class client
+
+int main(int argc, char* argv[]) {
+    parse_command_line_options(argc, argv);
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::mariadb_connector connector(io_service);
+
+    try {
+        connector.connect(opts.tcp_endpoint(),
+                          opts.auth_info(),
+                          opts.schema,
+                          amy::default_flags);
+
+        client c(connector);
+
+        counters before = counters::now();
+        auto started = std::chrono::steady_clock::now();
+
+        c.start();
+        io_service.run();
+
+        double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - started).count();
+        counters after = counters::now();
+
+        std::cout
+            << static_cast<int>(queries / seconds) << " queries/s\n"
+            << "epoll_ctl ADD/query: "
+            << double(after.add - before.add) / queries << "\n"
+            << "epoll_ctl MOD/query: "
+            << double(after.mod - before.mod) / queries << "\n"
+            << "epoll_ctl DEL/query: "
+            << double(after.del - before.del) / queries << "\n"
+            << "timerfd_settime/query: "
+            << double(after.timer - before.timer) / queries
+            << std::endl;
+    } catch (AMY_SYSTEM_NS::system_error const& e) {
+        report_system_error(e);
+        return 1;
+    }
+
+    return 0;
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -33,13 +33,14 @@ static struct option options[] = {
     { "port",     required_argument, NULL, 'P' },
     { "user",     required_argument, NULL, 'u' },
     { "password", required_argument, NULL, 'p' },
-    { "schema",   required_argument, NULL, 's' }
+    { "schema",   required_argument, NULL, 's' },
+    { NULL,       0,                 NULL, 0   }
 };
 
 void parse_command_line_options(int argc, char* argv[]) {
     char ch;
 
-    while ((ch = getopt_long(argc, argv, "hH:P:u:P:s:", options, NULL)) != -1) {
+    while ((ch = getopt_long(argc, argv, "hH:P:u:p:s:", options, NULL)) != -1) {
         switch (ch) {
             case 'h':
                 std::cout << usage << std::endl;
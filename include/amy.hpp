@@ -1,23 +1,38 @@
 #ifndef __AMY_AMY_HPP__
 #define __AMY_AMY_HPP__
 
+#include <amy/admission_controller.hpp>
+#include <amy/allocation_accounting.hpp>
 #include <amy/auth_info.hpp>
 #include <amy/basic_connector.hpp>
+#include <amy/basic_connector_group.hpp>
+#include <amy/basic_insert_batcher.hpp>
+#include <amy/basic_load_balancer.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/basic_query_router.hpp>
 #include <amy/basic_results_iterator.hpp>
 #include <amy/client_flags.hpp>
 #include <amy/connector.hpp>
+#include <amy/digest_table.hpp>
 #include <amy/endpoint_traits.hpp>
 #include <amy/error.hpp>
 #include <amy/execute.hpp>
 #include <amy/field.hpp>
 #include <amy/field_info.hpp>
+#include <amy/latency_histogram.hpp>
+#include <amy/load_data.hpp>
 #include <amy/mysql_service.hpp>
 #include <amy/options.hpp>
 #include <amy/placeholders.hpp>
+#include <amy/query_metrics.hpp>
+#include <amy/query_trace.hpp>
+#include <amy/reconnect_policy.hpp>
 #include <amy/result_set.hpp>
 #include <amy/row.hpp>
 #include <amy/sql_types.hpp>
+#include <amy/statement_digest.hpp>
 #include <amy/system_error.hpp>
+#include <amy/workload_capture.hpp>
 
 #endif // __AMY_AMY_HPP__
 
@@ -0,0 +1,263 @@
+#ifndef __AMY_ADMISSION_CONTROLLER_HPP__
+#define __AMY_ADMISSION_CONTROLLER_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/error.hpp>
+#include <amy/result_set.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace amy {
+
+/// Bounds the queries outstanding against a set of connectors sharing an
+/// endpoint, with a limit adapting to the observed latency.
+/**
+ * \c async_query_result forwards a statement to a target, i.e. a connector or
+ * any of the connector sets providing \c async_query_result, as long as fewer
+ * than \c limit statements admitted by the controller are outstanding.  Once
+ * the limit is reached, up to \c max_queued statements wait for a slot, and
+ * the others complete right away with \c amy::error::busy, so that overload
+ * is turned into fast failures instead of unbounded latency.
+ *
+ * The limit follows a gradient algorithm.  The controller tracks the
+ * smallest smoothed latency, standing for the latency of an idle server, and
+ * the short-term smoothed latency.  Their ratio, within [0.5, 1], scales the
+ * limit down as latency rises, while a headroom of <tt>sqrt(limit)</tt> lets
+ * the limit probe upwards when latency stays flat and at least half of the
+ * limit is in use.  Connection-level failures halve the limit.
+ *
+ * The controller is not thread safe and must only be used from the thread
+ * running its \c io_service.  Completion handlers must be copyable.
+ */
+class admission_controller : private detail::noncopyable {
+public:
+    typedef std::chrono::steady_clock clock_type;
+
+    explicit admission_controller(AMY_ASIO_NS::io_service& io_service,
+                                  std::size_t initial_limit = 16u,
+                                  std::size_t min_limit = 1u,
+                                  std::size_t max_limit = 1024u) :
+        io_service_(io_service),
+        min_limit_(static_cast<double>(std::max<std::size_t>(min_limit, 1u))),
+        max_limit_(static_cast<double>(std::max(max_limit, min_limit))),
+        limit_(std::min(std::max(static_cast<double>(initial_limit),
+                                 min_limit_),
+                        max_limit_)),
+        smoothing_(0.2),
+        short_rtt_(0.0),
+        long_rtt_(0.0),
+        in_flight_(0u),
+        max_queued_(0u),
+        rejected_(0u)
+    {}
+
+    AMY_ASIO_NS::io_service& get_io_service() {
+        return io_service_;
+    }
+
+    /// Current number of statements admitted at once.
+    std::size_t limit() const {
+        return static_cast<std::size_t>(limit_);
+    }
+
+    /// Number of admitted statements not completed yet.
+    std::size_t in_flight() const {
+        return in_flight_;
+    }
+
+    /// Number of statements waiting for a slot.
+    std::size_t queued() const {
+        return queued_.size();
+    }
+
+    /// Number of statements rejected with \c busy so far.
+    std::size_t rejected() const {
+        return rejected_;
+    }
+
+    /// Maximum number of statements waiting for a slot, 0 by default.
+    void max_queued(std::size_t n) {
+        max_queued_ = n;
+    }
+
+    /// Adapts the limit to the outcome of a statement, as done for each
+    /// admitted statement on completion.
+    /**
+     * Statements run on the target without going through the controller may
+     * be accounted for this way.  Such statements do not count as in flight.
+     */
+    void record(AMY_SYSTEM_NS::error_code const& ec,
+                clock_type::duration latency)
+    {
+        if (ec) {
+            // Statement errors are not a sign of overload, lost connections
+            // and timeouts are.
+            if (!amy::error::detail::is_server_error(ec)) {
+                update_limit(limit_ / 2.0);
+            }
+        } else {
+            adapt(std::chrono::duration<double>(latency).count());
+        }
+    }
+
+    /// Runs \p stmt on \p target if admitted, fails with \c busy otherwise.
+    /**
+     * \p target must outlive the operation.
+     */
+    template<typename Target, typename QueryResultHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(Target& target,
+                       std::string const& stmt,
+                       QueryResultHandler handler)
+    {
+        typedef AMY_ASIO_NS::async_completion<QueryResultHandler,
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)> completion_type;
+
+        completion_type init(handler);
+
+        typedef typename std::decay<
+            typename completion_type::completion_handler_type>::type
+            handler_type;
+
+        start_query<Target, handler_type> start(
+                *this, target, stmt, init.completion_handler);
+
+        if (in_flight_ < limit()) {
+            start();
+        } else if (queued_.size() < max_queued_) {
+            queued_.push_back(start);
+        } else {
+            ++rejected_;
+            io_service_.post(std::bind(init.completion_handler,
+                                       AMY_SYSTEM_NS::error_code(
+                                           amy::error::busy),
+                                       result_set::empty_set()));
+        }
+
+        return init.result.get();
+    }
+
+private:
+    template<typename Handler>
+    class complete_query {
+    public:
+        complete_query(admission_controller& controller,
+                       Handler const& handler) :
+            controller_(&controller),
+            started_(clock_type::now()),
+            handler_(handler)
+        {}
+
+        void operator()(AMY_SYSTEM_NS::error_code const& ec,
+                        result_set rs)
+        {
+            controller_->release(ec, clock_type::now() - started_);
+            handler_(ec, rs);
+        }
+
+    private:
+        admission_controller* controller_;
+        clock_type::time_point started_;
+        Handler handler_;
+
+    }; // class complete_query
+
+    template<typename Target, typename Handler>
+    class start_query {
+    public:
+        start_query(admission_controller& controller,
+                    Target& target,
+                    std::string const& stmt,
+                    Handler const& handler) :
+            controller_(&controller),
+            target_(&target),
+            stmt_(stmt),
+            handler_(handler)
+        {}
+
+        void operator()() {
+            ++controller_->in_flight_;
+            target_->async_query_result(
+                    stmt_, complete_query<Handler>(*controller_, handler_));
+        }
+
+    private:
+        admission_controller* controller_;
+        Target* target_;
+        std::string stmt_;
+        Handler handler_;
+
+    }; // class start_query
+
+    AMY_ASIO_NS::io_service& io_service_;
+    double min_limit_;
+    double max_limit_;
+    double limit_;
+    double smoothing_;
+
+    /// Short-term smoothed latency, in seconds.
+    double short_rtt_;
+
+    /// Smallest smoothed latency, slowly forgotten, in seconds.
+    double long_rtt_;
+
+    std::size_t in_flight_;
+    std::size_t max_queued_;
+    std::size_t rejected_;
+    std::deque<std::function<void ()> > queued_;
+
+    void release(AMY_SYSTEM_NS::error_code const& ec,
+                 clock_type::duration elapsed)
+    {
+        --in_flight_;
+        record(ec, elapsed);
+
+        while (!queued_.empty() && in_flight_ < limit()) {
+            std::function<void ()> next = std::move(queued_.front());
+            queued_.pop_front();
+            next();
+        }
+    }
+
+    void adapt(double rtt) {
+        short_rtt_ = short_rtt_ == 0.0
+            ? rtt
+            : short_rtt_ + smoothing_ * (rtt - short_rtt_);
+
+        // Drifts up slowly, so that a persistent change of the idle latency
+        // is eventually accepted.
+        long_rtt_ = long_rtt_ == 0.0 || short_rtt_ < long_rtt_
+            ? short_rtt_
+            : long_rtt_ + 0.01 * (short_rtt_ - long_rtt_);
+
+        double gradient = std::max(0.5, std::min(1.0, long_rtt_ / short_rtt_));
+        double target = limit_ * gradient + std::sqrt(limit_);
+
+        // Only probes upwards when the limit is actually what holds back
+        // the load.
+        if (target > limit_ && (in_flight_ + 1u) * 2u < limit_) {
+            target = limit_;
+        }
+
+        update_limit(limit_ + smoothing_ * (target - limit_));
+    }
+
+    void update_limit(double limit) {
+        limit_ = std::min(std::max(limit, min_limit_), max_limit_);
+    }
+
+}; // class admission_controller
+
+} // namespace amy
+
+#endif // __AMY_ADMISSION_CONTROLLER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
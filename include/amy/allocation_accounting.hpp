@@ -0,0 +1,208 @@
+#ifndef __AMY_ALLOCATION_ACCOUNTING_HPP__
+#define __AMY_ALLOCATION_ACCOUNTING_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace amy {
+
+/// Allocations and copies made by amy, see \c allocation_scope.
+struct allocation_counters {
+    allocation_counters() :
+        allocations(0u),
+        deallocations(0u),
+        bytes(0u),
+        copies(0u)
+    {}
+
+    uint64_t allocations;
+    uint64_t deallocations;
+
+    /// Bytes allocated, whether freed since or not.
+    uint64_t bytes;
+
+    /// Copies of \c result_set, \c row and \c auth_info instances.
+    uint64_t copies;
+
+    allocation_counters& operator+=(allocation_counters const& other) {
+        allocations += other.allocations;
+        deallocations += other.deallocations;
+        bytes += other.bytes;
+        copies += other.copies;
+        return *this;
+    }
+
+}; // struct allocation_counters
+
+/// Accounts the allocations and copies made by amy on the current thread
+/// into a set of counters, for as long as the scope lives.
+/**
+ * Accounting is opt-in: it only happens when \c AMY_ALLOCATION_ACCOUNTING is
+ * defined to a non-zero value, the same way in all the translation units of
+ * a program.  amy then allocates the memory of \c result_set, \c row and of
+ * the statements kept by asynchronous operations through \c
+ * accounting_allocator, and counts the copies of its value types.  Otherwise
+ * it uses \c std::allocator and scopes count nothing.
+ *
+ * \code
+ * amy::allocation_counters counters;
+ *
+ * {
+ *     amy::allocation_scope scope(counters);
+ *     connector.query_result("SELECT * FROM t");
+ * }
+ * \endcode
+ *
+ * Scopes nest, and enclosing scopes count what their inner scopes count.
+ * Asynchronous statements of an observed \c basic_connector account the work
+ * done on their behalf by the service in \c query_trace::allocations.
+ */
+class allocation_scope : private detail::noncopyable {
+public:
+    explicit allocation_scope(allocation_counters& counters) :
+        counters_(counters),
+        parent_(current())
+    {
+        current() = this;
+    }
+
+    ~allocation_scope() {
+        current() = parent_;
+    }
+
+    /// Whether amy was built with accounting.
+    static bool enabled() {
+#if defined(AMY_ALLOCATION_ACCOUNTING) && AMY_ALLOCATION_ACCOUNTING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static void allocated(std::size_t bytes) {
+        for (allocation_scope* s = current(); s; s = s->parent_) {
+            ++s->counters_.allocations;
+            s->counters_.bytes += bytes;
+        }
+    }
+
+    static void deallocated() {
+        for (allocation_scope* s = current(); s; s = s->parent_) {
+            ++s->counters_.deallocations;
+        }
+    }
+
+    static void copied() {
+        for (allocation_scope* s = current(); s; s = s->parent_) {
+            ++s->counters_.copies;
+        }
+    }
+
+private:
+    allocation_counters& counters_;
+    allocation_scope* parent_;
+
+    static allocation_scope*& current() {
+        static thread_local allocation_scope* scope = nullptr;
+        return scope;
+    }
+
+}; // class allocation_scope
+
+/// A \c std::allocator reporting to the \c allocation_scope of the thread.
+template<typename T>
+class accounting_allocator {
+public:
+    typedef T value_type;
+
+    accounting_allocator() noexcept {}
+
+    template<typename U>
+    accounting_allocator(accounting_allocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        allocation_scope::allocated(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        allocation_scope::deallocated();
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    struct rebind {
+        typedef accounting_allocator<U> other;
+    };
+
+}; // class accounting_allocator
+
+template<typename T, typename U>
+bool operator==(accounting_allocator<T> const&,
+                accounting_allocator<U> const&) noexcept
+{
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(accounting_allocator<T> const&,
+                accounting_allocator<U> const&) noexcept
+{
+    return false;
+}
+
+namespace detail {
+
+#if defined(AMY_ALLOCATION_ACCOUNTING) && AMY_ALLOCATION_ACCOUNTING
+
+/// The allocator of amy's own containers.
+template<typename T>
+using allocator = accounting_allocator<T>;
+
+inline void account_copy() {
+    allocation_scope::copied();
+}
+
+#else
+
+template<typename T>
+using allocator = std::allocator<T>;
+
+inline void account_copy() {}
+
+#endif
+
+/// Statements kept by asynchronous operations.
+typedef std::basic_string<char, std::char_traits<char>, allocator<char>>
+    string;
+
+/// An empty base counting the copies of the classes deriving from it.
+struct copy_accounted {
+    copy_accounted() = default;
+
+    copy_accounted(copy_accounted const&) {
+        account_copy();
+    }
+
+    copy_accounted(copy_accounted&&) = default;
+
+    copy_accounted& operator=(copy_accounted const&) {
+        account_copy();
+        return *this;
+    }
+
+    copy_accounted& operator=(copy_accounted&&) = default;
+
+}; // struct copy_accounted
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_ALLOCATION_ACCOUNTING_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
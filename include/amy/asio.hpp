@@ -8,12 +8,25 @@
 #include <asio/ip/tcp.hpp>
 #include <asio/local/stream_protocol.hpp>
 #include <asio/placeholders.hpp>
+#include <asio/version.hpp>
 
 #include <system_error>
 
 #define AMY_ASIO_NS ::asio
 #define AMY_SYSTEM_NS ::std
 
+#if ASIO_VERSION >= 101400
+#define AMY_ASIO_HAS_ASYNC_INITIATE 1
+#endif
+
+#if ASIO_VERSION >= 101900
+#define AMY_ASIO_HAS_CANCELLATION_SLOT 1
+#endif
+
+#if ASIO_VERSION >= 102800
+#define AMY_ASIO_HAS_IMMEDIATE_EXECUTOR 1
+#endif
+
 #else
 
 #include <boost/asio/basic_io_object.hpp>
@@ -21,11 +34,24 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/version.hpp>
 #include <boost/system/system_error.hpp>
 
 #define AMY_ASIO_NS ::boost::asio
 #define AMY_SYSTEM_NS ::boost::system
 
+#if BOOST_ASIO_VERSION >= 101400
+#define AMY_ASIO_HAS_ASYNC_INITIATE 1
+#endif
+
+#if BOOST_ASIO_VERSION >= 101900
+#define AMY_ASIO_HAS_CANCELLATION_SLOT 1
+#endif
+
+#if BOOST_ASIO_VERSION >= 102800
+#define AMY_ASIO_HAS_IMMEDIATE_EXECUTOR 1
+#endif
+
 #endif
 
 #endif // __AMY_ASIO_HPP__
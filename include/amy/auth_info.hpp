@@ -1,6 +1,8 @@
 #ifndef __AMY_AUTH_INFO_HPP__
 #define __AMY_AUTH_INFO_HPP__
 
+#include <amy/allocation_accounting.hpp>
+
 #include <memory>
 #include <string>
 
@@ -50,6 +52,8 @@ public:
         if (that.password()) {
             password_.reset(new std::string(that.password()));
         }
+
+        detail::account_copy();
     }
 
     /// Sets the user.
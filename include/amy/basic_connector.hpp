@@ -1,19 +1,50 @@
 #ifndef __AMY_BASIC_CONNECTOR_HPP__
 #define __AMY_BASIC_CONNECTOR_HPP__
 
+#include <amy/detail/async_initiate.hpp>
+#include <amy/detail/observed_handler.hpp>
+#include <amy/detail/reconnect_handler.hpp>
 #include <amy/detail/throw_error.hpp>
+#include <amy/detail/unique_handler.hpp>
 
 #include <amy/asio.hpp>
 #include <amy/auth_info.hpp>
 #include <amy/client_flags.hpp>
+#include <amy/error.hpp>
+#include <amy/load_data.hpp>
+#include <amy/query_trace.hpp>
+#include <amy/reconnect_policy.hpp>
 #include <amy/result_set.hpp>
 
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/steady_timer.hpp>
+#else
+#include <boost/asio/steady_timer.hpp>
+#endif
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace amy {
 
 /// Provides MySQL client functionalities.
-template<typename MySQLService>
+/**
+ * With an \p Observer other than \c null_observer, the asynchronous
+ * statements of \c async_query and \c async_query_result are traced, and
+ * the observer receives the \c query_trace of each statement right before
+ * its completion handler runs.  With \c null_observer, the default, nothing
+ * is traced nor allocated.
+ *
+ * The observer is shared with the handlers of pending statements, so that
+ * the statements still pending when the connector is destroyed are traced as
+ * they complete with \c operation_aborted.  Idempotent statements run again
+ * after a reconnection are traced as statements of their own.
+ */
+template<typename MySQLService, typename Observer = null_observer>
 class basic_connector : public AMY_ASIO_NS::basic_io_object<MySQLService> {
 public:
     /// The type of the service that provides actual MySQL client
@@ -23,11 +54,21 @@ public:
     /// The native MySQL connection handle type.
     typedef typename service_type::native_type native_type;
 
+    typedef Observer observer_type;
+
     /// Constructs a \c basic_connector without opening it.
-    explicit basic_connector(AMY_ASIO_NS::io_service& io_service) :
-        AMY_ASIO_NS::basic_io_object<MySQLService>(io_service)
+    explicit basic_connector(AMY_ASIO_NS::io_service& io_service,
+                             Observer const& observer = Observer()) :
+        AMY_ASIO_NS::basic_io_object<MySQLService>(io_service),
+        observer_(make_observer(observer, unobserved())),
+        last_statement_id_(0u),
+        reconnect_attempt_(0u)
     {}
 
+    observer_type& observer() {
+        return *observer_;
+    }
+
     native_type native() {
         return this->get_service().native(this->get_implementation());
     }
@@ -54,6 +95,11 @@ public:
         this->get_service().close(this->get_implementation());
     }
 
+    /// Client flags of the last connect operation.
+    client_flags flags() const {
+        return this->get_implementation().flags;
+    }
+
     template<typename Option>
     void set_option(Option const& option) {
         AMY_SYSTEM_NS::error_code ec;
@@ -73,6 +119,35 @@ public:
         this->get_service().cancel(this->get_implementation());
     }
 
+    /// Sets how asynchronous queries reestablish a lost connection.
+    /**
+     * Reconnections go to the endpoint of the last connect operation, with
+     * the options set on the connection, including \c init_command
+     * statements, which the client library runs again.  The connector must
+     * not be moved once connected with an enabled policy.
+     */
+    void set_reconnect_policy(reconnect_policy const& policy) {
+        reconnect_policy_ = policy;
+        reconnect_random_.seed(std::random_device()());
+    }
+
+    reconnect_policy const& get_reconnect_policy() const {
+        return reconnect_policy_;
+    }
+
+    /// Reconnects to the endpoint of the last connect operation.
+    /**
+     * Follows the backoff of the reconnect policy, making at least one
+     * attempt.  Concurrent calls share the same reconnection.
+     */
+    template<typename ReconnectHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(ReconnectHandler,
+                                  void (AMY_SYSTEM_NS::error_code))
+    async_reconnect(ReconnectHandler handler) {
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_reconnect(this), handler);
+    }
+
     template<typename Endpoint>
     void connect(Endpoint const& endpoint,
                  auth_info const& auth,
@@ -91,6 +166,7 @@ public:
                                       client_flags flags,
                                       AMY_SYSTEM_NS::error_code& ec)
     {
+        remember_endpoint(endpoint, auth, database, flags);
         return this->get_service().connect(
                 this->get_implementation(),
                 endpoint, auth, database, flags, ec);
@@ -105,14 +181,10 @@ public:
                        client_flags flags,
                        ConnectHandler handler)
     {
-        AMY_ASIO_NS::async_completion<ConnectHandler,
-            void (AMY_SYSTEM_NS::error_code)> init(handler);
-
-        this->get_service().async_connect(
-                this->get_implementation(),
-                endpoint, auth, database, flags, init.completion_handler);
-
-        return init.result.get();
+        remember_endpoint(endpoint, auth, database, flags);
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_connect(this), handler,
+                endpoint, auth, database, flags);
     }
 
     void query(std::string const& stmt) {
@@ -140,44 +212,122 @@ public:
         return store_result(ec);
     }
 
+    /// Streams the rows of \p producer into \p table with \c LOAD \c DATA
+    /// \c LOCAL \c INFILE, without going through a file.
+    /**
+     * \p producer is called with a \c load_data_row to fill with the fields
+     * of the next row, as in \c bool(load_data_row&), and returns false,
+     * leaving the row empty, once there are no more rows.  Rows are formatted
+     * as tab-separated values into a buffer reused for the whole load, and
+     * streamed as the client library asks for them, so that the rows need not
+     * be held in memory all at once; see also \c produce_rows.
+     *
+     * \p table is inserted verbatim after \c INTO \c TABLE, and may be
+     * followed by a column list or by other clauses of \c LOAD \c DATA.  The
+     * connection must allow local files, i.e. have the \c
+     * options::local_infile option set, and so must the server.  The number
+     * of rows loaded is then given by \c affected_rows.
+     *
+     * Exceptions thrown by \p producer abort the load, and are rethrown.
+     */
+    template<typename Producer>
+    void load_data(std::string const& table, Producer producer) {
+        AMY_SYSTEM_NS::error_code ec;
+        detail::throw_error(load_data(table, std::move(producer), ec),
+                            &(this->get_implementation().mysql));
+    }
+
+    template<typename Producer>
+    AMY_SYSTEM_NS::error_code load_data(std::string const& table,
+                                        Producer producer,
+                                        AMY_SYSTEM_NS::error_code& ec)
+    {
+        detail::local_infile_source<Producer> source(
+                &(this->get_implementation().mysql), producer);
+        query("LOAD DATA LOCAL INFILE 'amy' INTO TABLE " + table, ec);
+        source.rethrow();
+        return ec;
+    }
+
     template<typename QueryHandler>
     BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler,
         void (AMY_SYSTEM_NS::error_code))
     async_query(std::string const& stmt, QueryHandler handler) {
-        AMY_ASIO_NS::async_completion<QueryHandler,
-            void (AMY_SYSTEM_NS::error_code)> init(handler);
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_query(this), handler, stmt);
+    }
 
-        this->get_service().async_query(
-                this->get_implementation(), stmt, init.completion_handler);
+    /// Starts an asynchronous query which is run again if the connection
+    /// is lost and reestablished by the reconnect policy.
+    template<typename QueryHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler,
+        void (AMY_SYSTEM_NS::error_code))
+    async_query(idempotent_statement const& stmt, QueryHandler handler) {
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_query(this, true), handler, stmt.str());
+    }
 
-        return init.result.get();
+    /// Starts an asynchronous query that must complete before \p deadline.
+    /**
+     * Only available with services supporting per-operation deadlines.
+     */
+    template<typename TimePoint, typename QueryHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler,
+        void (AMY_SYSTEM_NS::error_code))
+    async_query(std::string const& stmt,
+                TimePoint const& deadline,
+                QueryHandler handler)
+    {
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_query(this), handler, stmt, deadline);
     }
 
 	template<typename Handler>
     BOOST_ASIO_INITFN_RESULT_TYPE(Handler,
         void (AMY_SYSTEM_NS::error_code))
 	async_queries(std::vector<std::string>const& stmts, Handler handler) {
-        AMY_ASIO_NS::async_completion<Handler,
-            void (AMY_SYSTEM_NS::error_code)> init(handler);
-
-		this->get_service().async_queries(
-			this->get_implementation(), stmts, init.completion_handler);
-
-		return init.result.get();
+		return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+			initiate_async_queries(this), handler, stmts);
 	}
 
     template<typename Handler>
     BOOST_ASIO_INITFN_RESULT_TYPE(Handler,
         void (AMY_SYSTEM_NS::error_code, amy::result_set))
     async_query_result(std::string const& stmt, Handler handler) {
-        AMY_ASIO_NS::async_completion<Handler,
-            void(AMY_SYSTEM_NS::error_code, amy::result_set)>
-          init(handler);
+        return detail::async_initiate<
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)>(
+                initiate_async_query_result(this), handler, stmt);
+    }
 
-      this->get_service().async_query_result(
-          this->get_implementation(), stmt, init.completion_handler);
+    template<typename Handler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(Handler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(idempotent_statement const& stmt, Handler handler) {
+        return detail::async_initiate<
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)>(
+                initiate_async_query_result(this, true), handler, stmt.str());
+    }
+
+    template<typename TimePoint, typename Handler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(Handler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(std::string const& stmt,
+                       TimePoint const& deadline,
+                       Handler handler)
+    {
+        return detail::async_initiate<
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)>(
+                initiate_async_query_result(this), handler, stmt, deadline);
+    }
 
-      return init.result.get();
+    /// Kills the statement currently executed by this connection on the
+    /// server, through a separate connection.
+    template<typename KillHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(KillHandler,
+        void (AMY_SYSTEM_NS::error_code))
+    async_kill_query(KillHandler handler) {
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_kill_query(this), handler);
     }
 
     bool has_more_results() const {
@@ -199,13 +349,9 @@ public:
     BOOST_ASIO_INITFN_RESULT_TYPE(StoreResultHandler,
         void (AMY_SYSTEM_NS::error_code, amy::result_set))
     async_store_result(StoreResultHandler handler) {
-        AMY_ASIO_NS::async_completion<StoreResultHandler,
-            void (AMY_SYSTEM_NS::error_code, amy::result_set)> init(handler);
-
-        this->get_service().async_store_result(
-                this->get_implementation(), init.completion_handler);
-
-        return init.result.get();
+        return detail::async_initiate<
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)>(
+                initiate_async_store_result(this), handler);
     }
 
     void autocommit(bool mode) {
@@ -245,6 +391,346 @@ public:
         return this->get_service().affected_rows(this->get_implementation());
     }
 
+private:
+    template<typename, typename>
+    friend class detail::reconnect_query_handler;
+
+    template<typename, typename>
+    friend class detail::reconnect_query_result_handler;
+
+    typedef std::function<void (AMY_SYSTEM_NS::error_code const&)>
+        reconnect_callback;
+
+    typedef std::is_same<Observer, null_observer> unobserved;
+
+    std::shared_ptr<Observer> observer_;
+    uint64_t last_statement_id_;
+
+    reconnect_policy reconnect_policy_;
+
+    /// Connects again to the endpoint of the last connect operation.
+    std::function<void (basic_connector&, reconnect_callback const&)>
+        reconnect_;
+
+    std::unique_ptr<AMY_ASIO_NS::steady_timer> reconnect_timer_;
+
+    /// Handlers waiting for the reconnection in progress, if any.
+    std::vector<detail::unique_handler> reconnect_waiters_;
+
+    std::size_t reconnect_attempt_;
+    std::minstd_rand reconnect_random_;
+
+    template<typename Endpoint>
+    void remember_endpoint(Endpoint const& endpoint,
+                           auth_info const& auth,
+                           std::string const& database,
+                           client_flags flags)
+    {
+        // Keeps the options of the connection across failed attempts.
+        flags |= client_remember_options;
+
+        reconnect_ = [endpoint, auth, database, flags](
+                basic_connector& self, reconnect_callback const& handler)
+        {
+            self.get_service().async_connect(self.get_implementation(),
+                                             endpoint, auth, database, flags,
+                                             handler);
+        };
+    }
+
+    void schedule_reconnect() {
+        using namespace std::placeholders;
+
+        if (!reconnect_timer_) {
+            reconnect_timer_.reset(
+                    new AMY_ASIO_NS::steady_timer(this->get_io_service()));
+        }
+
+        reconnect_timer_->expires_at(
+                std::chrono::steady_clock::now() +
+                reconnect_policy_.backoff(reconnect_attempt_,
+                                          reconnect_random_));
+        reconnect_timer_->async_wait(
+                std::bind(&basic_connector::handle_reconnect_timer, this, _1));
+    }
+
+    void handle_reconnect_timer(AMY_SYSTEM_NS::error_code const& ec) {
+        using namespace std::placeholders;
+
+        if (ec) {
+            finish_reconnect(ec);
+        } else {
+            reconnect_(*this, std::bind(&basic_connector::handle_reconnect,
+                                        this, _1));
+        }
+    }
+
+    void handle_reconnect(AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec && ++reconnect_attempt_ < reconnect_policy_.max_attempts()) {
+            schedule_reconnect();
+        } else {
+            finish_reconnect(ec);
+        }
+    }
+
+    void start_reconnect(detail::unique_handler handler) {
+        if (!reconnect_) {
+            handler.post(this->get_io_service(),
+                         AMY_SYSTEM_NS::error_code(
+                             amy::error::not_initialized));
+            return;
+        }
+
+        reconnect_waiters_.push_back(std::move(handler));
+
+        if (reconnect_waiters_.size() == 1u) {
+            reconnect_attempt_ = 0u;
+            schedule_reconnect();
+        }
+    }
+
+    void finish_reconnect(AMY_SYSTEM_NS::error_code const& ec) {
+        std::vector<detail::unique_handler> waiters;
+        waiters.swap(reconnect_waiters_);
+
+        for (auto& waiter : waiters) {
+            waiter(ec);
+        }
+    }
+
+    static std::shared_ptr<Observer> make_observer(Observer const& observer,
+                                                   std::false_type)
+    {
+        return std::make_shared<Observer>(observer);
+    }
+
+    /// Points to a single \c null_observer, which has no state to share.
+    static std::shared_ptr<Observer> make_observer(Observer const&,
+                                                   std::true_type)
+    {
+        static Observer observer;
+        return std::shared_ptr<Observer>(std::shared_ptr<Observer>(),
+                                         &observer);
+    }
+
+    /// Leaves the handler of a statement as is without an observer.
+    template<typename Handler>
+    Handler&& observe(std::string const&, Handler&& handler, std::true_type) {
+        return std::forward<Handler>(handler);
+    }
+
+    /// Wraps the handler of a statement so that the statement is traced.
+    template<typename Handler>
+    detail::observed_handler<Observer, typename std::decay<Handler>::type>
+    observe(std::string const& stmt, Handler&& handler, std::false_type) {
+        return detail::observed_handler<
+            Observer, typename std::decay<Handler>::type>(
+                observer_, ++last_statement_id_, stmt,
+                std::forward<Handler>(handler));
+    }
+
+    /// Runs an idempotent statement again, traced as a new statement.
+    template<typename Handler>
+    void reissue_query(std::string const& stmt, Handler&& handler) {
+        this->get_service().async_query(
+                this->get_implementation(),
+                stmt,
+                observe(stmt, std::forward<Handler>(handler), unobserved()));
+    }
+
+    template<typename Handler>
+    void reissue_query_result(std::string const& stmt, Handler&& handler) {
+        this->get_service().async_query_result(
+                this->get_implementation(),
+                stmt,
+                observe(stmt, std::forward<Handler>(handler), unobserved()));
+    }
+
+    // Initiation function objects of the asynchronous operations, invoked
+    // with the completion handler followed by the operation arguments.
+
+    class initiate_async_connect {
+    public:
+        explicit initiate_async_connect(basic_connector* self) :
+            self_(self)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler, Args const&... args) const {
+            self_->get_service().async_connect(
+                    self_->get_implementation(),
+                    args...,
+                    std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_connector* self_;
+
+    }; // class initiate_async_connect
+
+    class initiate_async_reconnect {
+    public:
+        explicit initiate_async_reconnect(basic_connector* self) :
+            self_(self)
+        {}
+
+        template<typename Handler>
+        void operator()(Handler&& handler) const {
+            self_->start_reconnect(std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_connector* self_;
+
+    }; // class initiate_async_reconnect
+
+    class initiate_async_query {
+    public:
+        explicit initiate_async_query(basic_connector* self,
+                             bool idempotent = false) :
+            self_(self),
+            idempotent_(idempotent)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler,
+                        std::string const& stmt,
+                        Args const&... args) const
+        {
+            typedef detail::reconnect_query_handler<
+                basic_connector, typename std::decay<Handler>::type>
+                reconnect_handler_type;
+
+            if (self_->reconnect_policy_.enabled()) {
+                self_->get_service().async_query(
+                        self_->get_implementation(),
+                        stmt,
+                        args...,
+                        self_->observe(
+                            stmt,
+                            reconnect_handler_type(
+                                *self_, stmt, idempotent_,
+                                std::forward<Handler>(handler)),
+                            unobserved()));
+            } else {
+                self_->get_service().async_query(
+                        self_->get_implementation(),
+                        stmt,
+                        args...,
+                        self_->observe(stmt,
+                                       std::forward<Handler>(handler),
+                                       unobserved()));
+            }
+        }
+
+    private:
+        basic_connector* self_;
+        bool idempotent_;
+
+    }; // class initiate_async_query
+
+    class initiate_async_queries {
+    public:
+        explicit initiate_async_queries(basic_connector* self) :
+            self_(self)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler, Args const&... args) const {
+            self_->get_service().async_queries(
+                    self_->get_implementation(),
+                    args...,
+                    std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_connector* self_;
+
+    }; // class initiate_async_queries
+
+    class initiate_async_query_result {
+    public:
+        explicit initiate_async_query_result(basic_connector* self,
+                             bool idempotent = false) :
+            self_(self),
+            idempotent_(idempotent)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler,
+                        std::string const& stmt,
+                        Args const&... args) const
+        {
+            typedef detail::reconnect_query_result_handler<
+                basic_connector, typename std::decay<Handler>::type>
+                reconnect_handler_type;
+
+            if (self_->reconnect_policy_.enabled()) {
+                self_->get_service().async_query_result(
+                        self_->get_implementation(),
+                        stmt,
+                        args...,
+                        self_->observe(
+                            stmt,
+                            reconnect_handler_type(
+                                *self_, stmt, idempotent_,
+                                std::forward<Handler>(handler)),
+                            unobserved()));
+            } else {
+                self_->get_service().async_query_result(
+                        self_->get_implementation(),
+                        stmt,
+                        args...,
+                        self_->observe(stmt,
+                                       std::forward<Handler>(handler),
+                                       unobserved()));
+            }
+        }
+
+    private:
+        basic_connector* self_;
+        bool idempotent_;
+
+    }; // class initiate_async_query_result
+
+    class initiate_async_store_result {
+    public:
+        explicit initiate_async_store_result(basic_connector* self) :
+            self_(self)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler, Args const&... args) const {
+            self_->get_service().async_store_result(
+                    self_->get_implementation(),
+                    args...,
+                    std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_connector* self_;
+
+    }; // class initiate_async_store_result
+
+    class initiate_async_kill_query {
+    public:
+        explicit initiate_async_kill_query(basic_connector* self) :
+            self_(self)
+        {}
+
+        template<typename Handler, typename... Args>
+        void operator()(Handler&& handler, Args const&... args) const {
+            self_->get_service().async_kill_query(
+                    self_->get_implementation(),
+                    args...,
+                    std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_connector* self_;
+
+    }; // class initiate_async_kill_query
+
 }; // class basic_connector
 
 } // namespace amy
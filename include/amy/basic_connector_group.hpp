@@ -0,0 +1,296 @@
+#ifndef __AMY_BASIC_CONNECTOR_GROUP_HPP__
+#define __AMY_BASIC_CONNECTOR_GROUP_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/auth_info.hpp>
+#include <amy/basic_connector.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/result_set.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/associated_executor.hpp>
+#include <asio/dispatch.hpp>
+#else
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#endif
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace amy {
+
+/// Shards connections over several \c io_service instances, each run by its
+/// own thread.
+/**
+ * A \c basic_connector_group owns one \c io_service and one thread per shard,
+ * typically one per core, and a fixed number of connections per shard.  Each
+ * connection is only ever used from the thread of its shard, so that shards
+ * share nothing but their load counters.
+ *
+ * \c async_query_result routes each statement to the least loaded shard,
+ * looking at the number of statements in flight on each shard.  The counters
+ * are relaxed atomics, so that routing takes no lock and never writes to a
+ * cache line shared with other dispatching threads.  Within a shard, the
+ * statement goes to the connection with the fewest queued statements,
+ * through a \c basic_query_queue.
+ *
+ * Completion handlers run on the thread of the shard which executed the
+ * statement, unless they have an associated executor, and must be copyable.
+ */
+template<typename MySQLService>
+class basic_connector_group : private detail::noncopyable {
+public:
+    /// The type of the connectors of the group.
+    typedef basic_connector<MySQLService> connector_type;
+
+    /// The type of the queues serializing statements per connection.
+    typedef basic_query_queue<MySQLService> query_queue_type;
+
+    /// Creates \p shards shards of \p connections unconnected connections.
+    /**
+     * \param shards The number of shards, defaults to the number of hardware
+     * threads.
+     * \param connections The number of connections per shard.
+     */
+    explicit basic_connector_group(std::size_t shards = 0u,
+                                   std::size_t connections = 1u)
+    {
+        if (!shards) {
+            shards = std::thread::hardware_concurrency();
+        }
+
+        shards = shards ? shards : 1u;
+        connections = connections ? connections : 1u;
+
+        shards_.reserve(shards);
+
+        for (std::size_t i = 0; i < shards; ++i) {
+            shards_.emplace_back(new shard(connections));
+        }
+    }
+
+    /// Stops and joins the threads of the shards.
+    ~basic_connector_group() {
+        stop();
+    }
+
+    /// Number of shards.
+    std::size_t size() const {
+        return shards_.size();
+    }
+
+    /// Number of connections per shard.
+    std::size_t connections() const {
+        return shards_.front()->connectors.size();
+    }
+
+    AMY_ASIO_NS::io_service& get_io_service(std::size_t shard) {
+        return shards_[shard]->io_service;
+    }
+
+    connector_type& connector(std::size_t shard, std::size_t connection) {
+        return *shards_[shard]->connectors[connection];
+    }
+
+    /// Number of statements routed to \p shard and not completed yet.
+    std::size_t load(std::size_t shard) const {
+        return shards_[shard]->in_flight.load(std::memory_order_relaxed);
+    }
+
+    /// Connects all connections of all shards.
+    /**
+     * Must be called before \c run, from any single thread.
+     */
+    template<typename Endpoint>
+    void connect(Endpoint const& endpoint,
+                 auth_info const& auth,
+                 std::string const& database,
+                 client_flags flags)
+    {
+        for (auto& s : shards_) {
+            for (auto& c : s->connectors) {
+                c->connect(endpoint, auth, database, flags);
+            }
+        }
+    }
+
+    /// Starts one thread per shard, running the shard's \c io_service.
+    void run() {
+        for (auto& s : shards_) {
+            if (!s->thread.joinable()) {
+                shard* p = s.get();
+                p->thread = std::thread([p] { p->io_service.run(); });
+            }
+        }
+    }
+
+    /// Stops all shards and joins their threads.
+    /**
+     * Statements still in flight are abandoned.
+     */
+    void stop() {
+        for (auto& s : shards_) {
+            s->work.reset();
+            s->io_service.stop();
+        }
+
+        for (auto& s : shards_) {
+            if (s->thread.joinable()) {
+                s->thread.join();
+            }
+        }
+    }
+
+    /// Runs \p stmt on the least loaded shard.
+    /**
+     * May be called from any thread.
+     */
+    template<typename QueryResultHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(std::string const& stmt, QueryResultHandler handler) {
+        typedef AMY_ASIO_NS::async_completion<QueryResultHandler,
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)> completion_type;
+
+        completion_type init(handler);
+
+        typedef typename std::decay<
+            typename completion_type::completion_handler_type>::type
+            handler_type;
+
+        shard& s = *shards_[least_loaded()];
+        s.in_flight.fetch_add(1u, std::memory_order_relaxed);
+
+        s.io_service.post(
+                start_query<handler_type>(s, stmt, init.completion_handler));
+
+        return init.result.get();
+    }
+
+private:
+    struct shard : private detail::noncopyable {
+        explicit shard(std::size_t connections) :
+            work(new AMY_ASIO_NS::io_service::work(io_service)),
+            in_flight(0u)
+        {
+            connectors.reserve(connections);
+            queues.reserve(connections);
+
+            for (std::size_t i = 0; i < connections; ++i) {
+                connectors.emplace_back(new connector_type(io_service));
+                queues.emplace_back(new query_queue_type(*connectors.back()));
+            }
+        }
+
+        /// The connection with the fewest queued statements.
+        query_queue_type& least_busy_queue() {
+            query_queue_type* best = queues.front().get();
+
+            for (auto& q : queues) {
+                if (q->size() < best->size()) {
+                    best = q.get();
+                }
+            }
+
+            return *best;
+        }
+
+        AMY_ASIO_NS::io_service io_service;
+        std::unique_ptr<AMY_ASIO_NS::io_service::work> work;
+        std::vector<std::unique_ptr<connector_type> > connectors;
+        std::vector<std::unique_ptr<query_queue_type> > queues;
+        std::thread thread;
+
+        /// Written by dispatching threads and the shard's thread only, kept
+        /// on its own cache line.
+        alignas(64) std::atomic<std::size_t> in_flight;
+
+    }; // struct shard
+
+    template<typename Handler>
+    class complete_query {
+    public:
+        complete_query(shard& s, Handler const& handler) :
+            shard_(&s),
+            handler_(handler)
+        {}
+
+        void operator()(AMY_SYSTEM_NS::error_code const& ec,
+                        result_set rs)
+        {
+            shard_->in_flight.fetch_sub(1u, std::memory_order_relaxed);
+            AMY_ASIO_NS::dispatch(
+                    AMY_ASIO_NS::get_associated_executor(
+                        handler_, shard_->io_service.get_executor()),
+                    std::bind(handler_, ec, rs));
+        }
+
+    private:
+        shard* shard_;
+        Handler handler_;
+
+    }; // class complete_query
+
+    template<typename Handler>
+    class start_query {
+    public:
+        start_query(shard& s, std::string const& stmt, Handler const& handler) :
+            shard_(&s),
+            stmt_(stmt),
+            handler_(handler)
+        {}
+
+        void operator()() {
+            shard_->least_busy_queue().async_query_result(
+                    stmt_, complete_query<Handler>(*shard_, handler_));
+        }
+
+    private:
+        shard* shard_;
+        std::string stmt_;
+        Handler handler_;
+
+    }; // class start_query
+
+    std::vector<std::unique_ptr<shard> > shards_;
+
+    /// Index of the shard with the fewest statements in flight.
+    /**
+     * Scanning starts at a per-thread rotating position, so that ties are
+     * spread over shards without sharing any state between threads.
+     */
+    std::size_t least_loaded() const {
+        static thread_local std::size_t start = 0u;
+
+        std::size_t n = shards_.size();
+        std::size_t first = start++ % n;
+        std::size_t best = first;
+        std::size_t best_load = load(first);
+
+        for (std::size_t i = 1; i < n && best_load; ++i) {
+            std::size_t candidate = (first + i) % n;
+            std::size_t candidate_load = load(candidate);
+
+            if (candidate_load < best_load) {
+                best = candidate;
+                best_load = candidate_load;
+            }
+        }
+
+        return best;
+    }
+
+}; // class basic_connector_group
+
+} // namespace amy
+
+#endif // __AMY_BASIC_CONNECTOR_GROUP_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
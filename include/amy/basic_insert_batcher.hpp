@@ -0,0 +1,407 @@
+#ifndef __AMY_BASIC_INSERT_BATCHER_HPP__
+#define __AMY_BASIC_INSERT_BATCHER_HPP__
+
+#include <amy/detail/async_initiate.hpp>
+#include <amy/detail/mysql_ops.hpp>
+#include <amy/detail/noncopyable.hpp>
+#include <amy/detail/unique_handler.hpp>
+#include <amy/detail/value_format.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/basic_connector.hpp>
+#include <amy/error.hpp>
+#include <amy/sql_types.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/steady_timer.hpp>
+#else
+#include <boost/asio/steady_timer.hpp>
+#endif
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace amy {
+
+/// Accumulates rows of \p Columns and inserts them with multi-row \c INSERT
+/// statements over a single connector.
+/**
+ * Rows are rendered as they are added into a statement made of the prefix
+ * given to the constructor, e.g. <tt>INSERT INTO t (a, b)</tt>, followed by
+ * \c VALUES and the rows.  The statement is sealed into a batch and flushed
+ * when one more row would make it reach \c max_bytes, when it holds \c
+ * max_rows rows, when its first row has waited for \c max_delay if not
+ * zero, or on \c flush and \c async_flush.
+ *
+ * Batches run one at a time over the connector, with \c async_query, in the
+ * order they were sealed.  Batches sealed while one is in flight wait for it
+ * to complete.  Each batch is reported to the handler given to \c on_batch,
+ * if any, with its outcome and number of rows.  Failed batches are not
+ * retried.
+ *
+ * Strings are escaped with \c mysql_real_escape_string, so rows may only be
+ * added once the connector is connected, and not with the \c
+ * NO_BACKSLASH_ESCAPES SQL mode.  \c nullptr stands for \c NULL, as do
+ * infinite and NaN floating point values, which SQL has no literal for, and
+ * \c sql_datetime values are quoted.
+ *
+ * Statements are kept strictly shorter than \c max_bytes, so that passing
+ * the \c max_allowed_packet of the server, see \c max_allowed_packet, keeps
+ * them within a packet.
+ *
+ * The batcher is not thread safe: it must only be used from the thread
+ * running the connector's \c io_service, and it must outlive all of its
+ * pending operations.  The wrapped connector must not be used directly while
+ * a batch is in flight.
+ */
+template<typename MySQLService, typename... Columns>
+class basic_insert_batcher : private amy::detail::noncopyable {
+public:
+    /// The type of the connector the batches are executed on.
+    typedef basic_connector<MySQLService> connector_type;
+
+    typedef std::chrono::steady_clock::duration duration;
+
+    /// Invoked with the outcome of each batch and its number of rows.
+    typedef
+        std::function<void (AMY_SYSTEM_NS::error_code const&, std::size_t)>
+        batch_handler;
+
+    /// Default maximum number of rows per statement.
+    static const std::size_t default_max_rows = 1000;
+
+    /// Default maximum size of statements, the default \c
+    /// max_allowed_packet of MySQL 5.7.
+    static const std::size_t default_max_bytes = 4194304;
+
+    basic_insert_batcher(connector_type& connector,
+                         std::string prefix,
+                         std::size_t max_bytes = default_max_bytes,
+                         std::size_t max_rows = default_max_rows,
+                         duration max_delay = duration::zero()) :
+        connector_(connector),
+        timer_(connector.get_io_service()),
+        prefix_(std::move(prefix)),
+        max_bytes_(max_bytes),
+        max_rows_(max_rows ? max_rows : 1u),
+        max_delay_(max_delay),
+        rows_(0u),
+        sealed_(0u),
+        completed_(0u),
+        busy_(false)
+    {}
+
+    /// Queries the \c max_allowed_packet of the server, blocking.
+    static std::size_t max_allowed_packet(connector_type& connector) {
+        result_set rs = connector.query_result("SELECT @@max_allowed_packet");
+        return static_cast<std::size_t>(rs[0][0].as<sql_bigint_unsigned>());
+    }
+
+    connector_type& connector() {
+        return connector_;
+    }
+
+    void on_batch(batch_handler handler) {
+        on_batch_ = std::move(handler);
+    }
+
+    /// Rows added but not sealed into a batch yet.
+    std::size_t buffered_rows() const {
+        return rows_;
+    }
+
+    /// Batches sealed but not completed yet, including the one in flight.
+    std::size_t queued_batches() const {
+        return batches_.size();
+    }
+
+    /// Whether a batch is currently being executed.
+    bool busy() const {
+        return busy_;
+    }
+
+    /// Adds a row, flushing the rows before it if need be.
+    /**
+     * \throw std::length_error if the row alone does not fit in \c
+     * max_bytes.
+     */
+    void add(Columns const&... values) {
+        row_.assign(1u, '(');
+        append_values(values...);
+        row_ += ')';
+
+        if (rows_ && statement_.size() + 1u + row_.size() >= max_bytes_) {
+            seal();
+        }
+
+        if (!rows_) {
+            statement_.assign(prefix_).append(" VALUES ");
+
+            if (statement_.size() + row_.size() >= max_bytes_) {
+                statement_.clear();
+                throw std::length_error("row larger than max_bytes");
+            }
+
+            arm_timer();
+        } else {
+            statement_ += ',';
+        }
+
+        statement_ += row_;
+
+        if (++rows_ >= max_rows_) {
+            seal();
+        }
+    }
+
+    /// Seals the rows added so far into a batch, to run as soon as the
+    /// connector is available.
+    void flush() {
+        seal();
+    }
+
+    /// Flushes, and waits for all the batches sealed so far.
+    /**
+     * The handler receives the first error among these batches, if any.
+     */
+    template<typename FlushHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(FlushHandler,
+        void (AMY_SYSTEM_NS::error_code))
+    async_flush(FlushHandler handler) {
+        return detail::async_initiate<void (AMY_SYSTEM_NS::error_code)>(
+                initiate_async_flush(this), handler);
+    }
+
+private:
+    struct batch {
+        std::string statement;
+        std::size_t rows;
+    };
+
+    struct waiter {
+        /// The number of batches to complete.
+        uint64_t target;
+        AMY_SYSTEM_NS::error_code ec;
+        detail::unique_handler handler;
+    };
+
+    class initiate_async_flush {
+    public:
+        explicit initiate_async_flush(basic_insert_batcher* self) :
+            self_(self)
+        {}
+
+        template<typename Handler>
+        void operator()(Handler&& handler) const {
+            self_->start_flush(std::forward<Handler>(handler));
+        }
+
+    private:
+        basic_insert_batcher* self_;
+
+    }; // class initiate_async_flush
+
+    connector_type& connector_;
+    AMY_ASIO_NS::steady_timer timer_;
+    std::string prefix_;
+    std::size_t max_bytes_;
+    std::size_t max_rows_;
+    duration max_delay_;
+    batch_handler on_batch_;
+
+    /// The statement being built, and its number of rows.
+    std::string statement_;
+    std::size_t rows_;
+
+    /// Reused buffer rendering the row being added.
+    std::string row_;
+
+    /// The buffer of the last completed batch, reused for the next statement.
+    std::string spare_;
+
+    std::deque<batch> batches_;
+    uint64_t sealed_;
+    uint64_t completed_;
+    bool busy_;
+    std::deque<waiter> waiters_;
+
+    void append_values() {}
+
+    template<typename T, typename... Rest>
+    void append_values(T const& value, Rest const&... rest) {
+        append(value);
+
+        if (sizeof...(Rest)) {
+            row_ += ',';
+        }
+
+        append_values(rest...);
+    }
+
+    void append(char const* value, std::size_t length) {
+        std::size_t at = row_.size();
+        row_.resize(at + 2u * length + 2u);
+        row_[at] = '\'';
+
+        unsigned long n = detail::mysql_ops::mysql_real_escape_string(
+                connector_.native(), &row_[at + 1u], value, length);
+
+        // Fails with the NO_BACKSLASH_ESCAPES SQL mode.
+        if (n == static_cast<unsigned long>(-1)) {
+            row_.resize(at);
+            throw std::runtime_error("cannot escape strings");
+        }
+
+        row_[at + 1u + n] = '\'';
+        row_.resize(at + 2u + n);
+    }
+
+    void append(std::string const& value) {
+        append(value.data(), value.size());
+    }
+
+    void append(char const* value) {
+        append(value, std::strlen(value));
+    }
+
+    void append(std::nullptr_t) {
+        row_ += "NULL";
+    }
+
+    void append(bool value) {
+        row_ += value ? '1' : '0';
+    }
+
+    template<typename Integer>
+    typename std::enable_if<std::is_integral<Integer>::value>::type
+    append(Integer value) {
+        detail::append_integer(row_, value);
+    }
+
+    void append(double value) {
+        append_floating(value, false);
+    }
+
+    void append(float value) {
+        append_floating(value, true);
+    }
+
+    void append_floating(double value, bool single) {
+        if (std::isfinite(value)) {
+            detail::append_floating(row_, value, single);
+        } else {
+            row_ += "NULL";
+        }
+    }
+
+    void append(sql_datetime const& value) {
+        row_ += '\'';
+        detail::append_datetime(row_, value);
+        row_ += '\'';
+    }
+
+    void start_flush(detail::unique_handler handler) {
+        seal();
+
+        if (completed_ == sealed_) {
+            handler.post(connector_.get_io_service(),
+                         AMY_SYSTEM_NS::error_code());
+        } else {
+            waiters_.push_back(waiter{ sealed_, AMY_SYSTEM_NS::error_code(),
+                                       std::move(handler) });
+        }
+    }
+
+    void arm_timer() {
+        using namespace std::placeholders;
+
+        if (max_delay_ == duration::zero()) {
+            return;
+        }
+
+        timer_.expires_at(std::chrono::steady_clock::now() + max_delay_);
+        timer_.async_wait(std::bind(&basic_insert_batcher::handle_timer,
+                                    this, _1, sealed_));
+    }
+
+    /// Seals the batch the timer was armed for, unless sealed already.
+    void handle_timer(AMY_SYSTEM_NS::error_code const& ec,
+                      uint64_t generation)
+    {
+        if (!ec && generation == sealed_) {
+            seal();
+        }
+    }
+
+    void seal() {
+        if (!rows_) {
+            return;
+        }
+
+        batches_.push_back(batch{ std::string(), rows_ });
+        batches_.back().statement.swap(statement_);
+        statement_.swap(spare_);
+        rows_ = 0u;
+        ++sealed_;
+
+        if (max_delay_ != duration::zero()) {
+            timer_.cancel();
+        }
+
+        start();
+    }
+
+    void start() {
+        using namespace std::placeholders;
+
+        if (busy_ || batches_.empty()) {
+            return;
+        }
+
+        busy_ = true;
+        connector_.async_query(
+                batches_.front().statement,
+                std::bind(&basic_insert_batcher::handle_query, this, _1));
+    }
+
+    void handle_query(AMY_SYSTEM_NS::error_code const& ec) {
+        std::size_t rows = batches_.front().rows;
+        spare_.swap(batches_.front().statement);
+        spare_.clear();
+        batches_.pop_front();
+        busy_ = false;
+        ++completed_;
+
+        if (ec) {
+            for (waiter& w : waiters_) {
+                if (!w.ec) {
+                    w.ec = ec;
+                }
+            }
+        }
+
+        if (on_batch_) {
+            on_batch_(ec, rows);
+        }
+
+        while (!waiters_.empty() && waiters_.front().target <= completed_) {
+            waiter w = std::move(waiters_.front());
+            waiters_.pop_front();
+            w.handler(w.ec);
+        }
+
+        start();
+    }
+
+}; // class basic_insert_batcher
+
+} // namespace amy
+
+#endif // __AMY_BASIC_INSERT_BATCHER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,422 @@
+#ifndef __AMY_BASIC_LOAD_BALANCER_HPP__
+#define __AMY_BASIC_LOAD_BALANCER_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/auth_info.hpp>
+#include <amy/basic_connector.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/error.hpp>
+#include <amy/result_set.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace amy {
+
+/// Spreads statements over equivalent endpoints, favoring the fastest ones.
+/**
+ * A \c basic_load_balancer holds one connection per endpoint, e.g. per node of
+ * a Galera cluster, each fronted by a \c basic_query_queue.  It keeps an
+ * exponentially weighted moving average of the latency of each endpoint and
+ * its number of statements in flight, and routes each statement by
+ * power-of-two-choices: of two endpoints picked at random, the one with the
+ * lowest expected wait, i.e. its average latency times its statements in
+ * flight plus one, wins.  Endpoints without a latency sample yet are assumed
+ * to be as fast as the fastest endpoint, so that a new endpoint does not take
+ * every statement until its first one completes.
+ *
+ * An endpoint is ejected from rotation after \c max_failures consecutive
+ * connection-level failures, or when its average latency exceeds \c
+ * eject_ratio times the one of the fastest endpoint.  Once \c eject_duration
+ * has elapsed, the next routed statement triggers a \c SELECT \c 1 probe on
+ * the ejected endpoint, whose outcome decides whether it is reinstated or
+ * ejected again.  An endpoint ejected for failures is first reconnected with
+ * \c basic_connector::async_reconnect, once it has no statement in flight.
+ * The last healthy endpoint is never ejected for latency.
+ *
+ * Like \c basic_query_queue, the balancer is not thread safe and must only be
+ * used from the thread running its \c io_service.  Completion handlers must be
+ * copyable.
+ */
+template<typename MySQLService>
+class basic_load_balancer : private amy::detail::noncopyable {
+public:
+    typedef basic_connector<MySQLService> connector_type;
+
+    typedef basic_query_queue<MySQLService> query_queue_type;
+
+    typedef std::chrono::steady_clock clock_type;
+
+    explicit basic_load_balancer(AMY_ASIO_NS::io_service& io_service) :
+        io_service_(io_service),
+        smoothing_(0.2),
+        eject_ratio_(4.0),
+        max_failures_(3u),
+        eject_duration_(std::chrono::seconds(5)),
+        random_(std::random_device()())
+    {}
+
+    AMY_ASIO_NS::io_service& get_io_service() {
+        return io_service_;
+    }
+
+    /// Connects to a new endpoint and returns its index.
+    template<typename Endpoint>
+    std::size_t add_endpoint(Endpoint const& endpoint,
+                             auth_info const& auth,
+                             std::string const& database,
+                             client_flags flags)
+    {
+        std::unique_ptr<member> m(new member(io_service_));
+        m->connector.connect(endpoint, auth, database, flags);
+        members_.push_back(std::move(m));
+
+        return members_.size() - 1u;
+    }
+
+    /// Number of endpoints.
+    std::size_t size() const {
+        return members_.size();
+    }
+
+    connector_type& connector(std::size_t index) {
+        return members_[index]->connector;
+    }
+
+    /// Average latency of an endpoint.
+    clock_type::duration latency(std::size_t index) const {
+        return std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(members_[index]->latency));
+    }
+
+    /// Number of statements routed to an endpoint and not completed yet.
+    std::size_t in_flight(std::size_t index) const {
+        return members_[index]->in_flight;
+    }
+
+    /// Whether an endpoint is currently out of rotation.
+    bool ejected(std::size_t index) const {
+        return members_[index]->ejected;
+    }
+
+    /// Weight of the latest sample in the latency averages, within (0, 1].
+    void smoothing(double weight) {
+        smoothing_ = weight;
+    }
+
+    void eject_ratio(double ratio) {
+        eject_ratio_ = ratio;
+    }
+
+    void max_failures(std::size_t failures) {
+        max_failures_ = failures ? failures : 1u;
+    }
+
+    void eject_duration(clock_type::duration duration) {
+        eject_duration_ = duration;
+    }
+
+    template<typename QueryResultHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(std::string const& stmt, QueryResultHandler handler) {
+        typedef AMY_ASIO_NS::async_completion<QueryResultHandler,
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)> completion_type;
+
+        completion_type init(handler);
+
+        typedef typename std::decay<
+            typename completion_type::completion_handler_type>::type
+            handler_type;
+
+        clock_type::time_point now = clock_type::now();
+        probe_ejected(now);
+
+        member& m = pick();
+        ++m.in_flight;
+
+        m.queue.async_query_result(
+                stmt,
+                complete_query<handler_type>(
+                    *this, m, now, init.completion_handler));
+
+        return init.result.get();
+    }
+
+private:
+    struct member {
+        explicit member(AMY_ASIO_NS::io_service& io_service) :
+            connector(io_service),
+            queue(connector),
+            latency(0.0),
+            in_flight(0u),
+            failures(0u),
+            ejected(false),
+            probing(false)
+        {}
+
+        connector_type connector;
+        query_queue_type queue;
+
+        /// Average latency, in seconds.
+        double latency;
+
+        std::size_t in_flight;
+        std::size_t failures;
+        bool ejected;
+        bool probing;
+        clock_type::time_point ejected_until;
+
+        /// Expected wait of a new statement, assuming an average latency of
+        /// \p prior when there is no sample yet.
+        double cost(double prior) const {
+            return (latency > 0.0 ? latency : prior) * (in_flight + 1u);
+        }
+
+    }; // struct member
+
+    template<typename Handler>
+    class complete_query {
+    public:
+        complete_query(basic_load_balancer& balancer,
+                       member& m,
+                       clock_type::time_point started,
+                       Handler const& handler) :
+            balancer_(&balancer),
+            member_(&m),
+            started_(started),
+            handler_(handler)
+        {}
+
+        void operator()(AMY_SYSTEM_NS::error_code const& ec,
+                        result_set rs)
+        {
+            --member_->in_flight;
+            balancer_->record(*member_, ec, clock_type::now() - started_);
+            handler_(ec, rs);
+        }
+
+    private:
+        basic_load_balancer* balancer_;
+        member* member_;
+        clock_type::time_point started_;
+        Handler handler_;
+
+    }; // class complete_query
+
+    AMY_ASIO_NS::io_service& io_service_;
+    std::vector<std::unique_ptr<member> > members_;
+    double smoothing_;
+    double eject_ratio_;
+    std::size_t max_failures_;
+    clock_type::duration eject_duration_;
+    std::minstd_rand random_;
+
+    /// Power-of-two-choices among the endpoints in rotation.
+    member& pick() {
+        std::size_t healthy = 0u;
+
+        for (auto const& m : members_) {
+            healthy += !m->ejected;
+        }
+
+        // Without any sample, costs only compare statements in flight.
+        double prior = best_latency();
+
+        if (prior == 0.0) {
+            prior = 1.0;
+        }
+
+        if (!healthy) {
+            return least_cost(prior);
+        }
+
+        std::size_t i = random_() % healthy;
+
+        if (healthy == 1u) {
+            return *nth_healthy(i);
+        }
+
+        // Draws a second, distinct endpoint.
+        std::size_t j = random_() % (healthy - 1u);
+        j += j >= i;
+
+        member* first = nth_healthy(i);
+        member* second = nth_healthy(j);
+
+        return first->cost(prior) <= second->cost(prior) ? *first : *second;
+    }
+
+    member* nth_healthy(std::size_t n) {
+        for (auto const& m : members_) {
+            if (!m->ejected && n-- == 0u) {
+                return m.get();
+            }
+        }
+
+        return members_.front().get();
+    }
+
+    /// Fallback when every endpoint is ejected.
+    member& least_cost(double prior) {
+        member* best = members_.front().get();
+
+        for (auto const& m : members_) {
+            if (m->cost(prior) < best->cost(prior)) {
+                best = m.get();
+            }
+        }
+
+        return *best;
+    }
+
+    /// Average latency of the fastest endpoint in rotation.
+    double best_latency() const {
+        double best = 0.0;
+
+        for (auto const& m : members_) {
+            if (!m->ejected && m->latency > 0.0 &&
+                (best == 0.0 || m->latency < best))
+            {
+                best = m->latency;
+            }
+        }
+
+        return best;
+    }
+
+    void eject(member& m, clock_type::time_point now) {
+        m.ejected = true;
+        m.ejected_until = now + eject_duration_;
+    }
+
+    void record(member& m,
+                AMY_SYSTEM_NS::error_code const& ec,
+                clock_type::duration elapsed)
+    {
+        if (ec && !is_statement_error(ec)) {
+            if (++m.failures >= max_failures_ && !m.ejected) {
+                eject(m, clock_type::now());
+            }
+
+            return;
+        }
+
+        double sample = std::chrono::duration<double>(elapsed).count();
+
+        m.failures = 0u;
+        m.latency = m.latency == 0.0
+            ? sample
+            : m.latency + smoothing_ * (sample - m.latency);
+
+        if (!m.ejected) {
+            eject_slow(clock_type::now());
+        }
+    }
+
+    /// Ejects the endpoints in rotation slower than \c eject_ratio times
+    /// the fastest one, since a new sample may make any of them the fastest.
+    void eject_slow(clock_type::time_point now) {
+        double best = best_latency();
+        std::size_t healthy = 0u;
+
+        for (auto const& m : members_) {
+            healthy += !m->ejected;
+        }
+
+        for (auto const& m : members_) {
+            if (healthy > 1u && !m->ejected && m->latency > eject_ratio_ * best)
+            {
+                eject(*m, now);
+                --healthy;
+            }
+        }
+    }
+
+    /// Starts a probe on every ejected endpoint whose ejection expired.
+    void probe_ejected(clock_type::time_point now) {
+        for (auto const& m : members_) {
+            if (!m->ejected || m->probing || now < m->ejected_until) {
+                continue;
+            }
+
+            if (m->failures < max_failures_) {
+                m->probing = true;
+                probe(m.get(), now);
+            } else if (!m->in_flight) {
+                // Its connection is likely gone, the queue being idle lets
+                // the connector reconnect.
+                m->probing = true;
+                m->connector.async_reconnect(
+                        std::bind(&basic_load_balancer::handle_reconnect,
+                                  this,
+                                  m.get(),
+                                  std::placeholders::_1));
+            }
+        }
+    }
+
+    void probe(member* m, clock_type::time_point started) {
+        m->queue.async_query_result(
+                "SELECT 1",
+                std::bind(&basic_load_balancer::handle_probe,
+                          this,
+                          m,
+                          started,
+                          std::placeholders::_1));
+    }
+
+    void handle_reconnect(member* m, AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec) {
+            m->probing = false;
+            eject(*m, clock_type::now());
+        } else {
+            probe(m, clock_type::now());
+        }
+    }
+
+    void handle_probe(member* m,
+                      clock_type::time_point started,
+                      AMY_SYSTEM_NS::error_code const& ec)
+    {
+        clock_type::time_point now = clock_type::now();
+        m->probing = false;
+
+        if (ec) {
+            eject(*m, now);
+            return;
+        }
+
+        // The probe replaces the stale average of the endpoint.
+        m->latency = std::chrono::duration<double>(now - started).count();
+        m->failures = 0u;
+
+        double best = best_latency();
+
+        if (best == 0.0 || m->latency <= eject_ratio_ * best) {
+            m->ejected = false;
+        } else {
+            eject(*m, now);
+        }
+    }
+
+    /// Whether \c ec is reported by the server for the statement itself,
+    /// rather than a failure of the endpoint.
+    static bool is_statement_error(AMY_SYSTEM_NS::error_code const& ec) {
+        return amy::error::detail::is_server_error(ec);
+    }
+
+}; // class basic_load_balancer
+
+} // namespace amy
+
+#endif // __AMY_BASIC_LOAD_BALANCER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
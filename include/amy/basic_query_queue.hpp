@@ -0,0 +1,269 @@
+#ifndef __AMY_BASIC_QUERY_QUEUE_HPP__
+#define __AMY_BASIC_QUERY_QUEUE_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/basic_connector.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/error.hpp>
+#include <amy/result_set.hpp>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace amy {
+
+/// Queues asynchronous queries issued against a single connector.
+/**
+ * A \c basic_query_queue accepts any number of concurrent \c
+ * async_query_result calls and runs them over the wrapped connector one batch
+ * at a time.  When the connector is connected with \c client_multi_statements,
+ * all statements queued while a batch is in flight are coalesced into a single
+ * multi-statement packet, and the result sets are handed back to each caller's
+ * handler in order.  Otherwise each batch holds exactly one statement, which
+ * still saves callers from serializing their queries by hand.
+ *
+ * Each queued statement must produce exactly one result, i.e. it must be a
+ * single statement and not a \c CALL of a stored procedure.
+ *
+ * When a statement of a coalesced batch fails on the server, its handler
+ * receives the error and the statements queued after it, which the server
+ * never executed, are resubmitted in the next batch.  Any other error (lost
+ * connection, cancellation, etc.) is reported to every statement of the
+ * batch.
+ *
+ * The queue is not thread safe: it must only be used from the thread running
+ * the connector's \c io_service, and it must outlive all of its pending
+ * operations.  The wrapped connector must not be used directly while the
+ * queue is busy.
+ */
+template<typename MySQLService>
+class basic_query_queue : private amy::detail::noncopyable {
+public:
+    /// The type of the connector the statements are executed on.
+    typedef basic_connector<MySQLService> connector_type;
+
+    /// The type-erased completion handler of a queued statement.
+    typedef
+        std::function<void (AMY_SYSTEM_NS::error_code const&, result_set)>
+        handler_type;
+
+    /// Default maximum number of statements coalesced into one packet.
+    static const std::size_t default_max_batch_size = 64;
+
+    explicit basic_query_queue(
+            connector_type& connector,
+            std::size_t max_batch_size = default_max_batch_size)
+      : connector_(connector),
+        max_batch_size_(max_batch_size ? max_batch_size : 1u),
+        next_(0u)
+    {}
+
+    connector_type& connector() {
+        return connector_;
+    }
+
+    std::size_t max_batch_size() const {
+        return max_batch_size_;
+    }
+
+    void max_batch_size(std::size_t size) {
+        max_batch_size_ = size ? size : 1u;
+    }
+
+    /// Whether queued statements are coalesced into multi-statement packets.
+    bool coalescing() const {
+        return !!(connector_.flags() & amy::client_multi_statements);
+    }
+
+    /// Whether a batch is currently being executed.
+    bool busy() const {
+        return !batch_.empty();
+    }
+
+    /// Number of statements either waiting or in flight.
+    std::size_t size() const {
+        return pending_.size() + (batch_.size() - next_);
+    }
+
+    template<typename QueryResultHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(std::string const& stmt, QueryResultHandler handler) {
+        AMY_ASIO_NS::async_completion<QueryResultHandler,
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)> init(handler);
+
+        pending_.push_back(
+                queued_query{ stmt, handler_type(init.completion_handler) });
+
+        if (!busy()) {
+            start_batch();
+        }
+
+        return init.result.get();
+    }
+
+private:
+    struct queued_query {
+        std::string stmt;
+        handler_type handler;
+    };
+
+    connector_type& connector_;
+    std::size_t max_batch_size_;
+
+    /// Statements waiting for the next batch.
+    std::deque<queued_query> pending_;
+
+    /// Statements of the batch in flight.
+    std::vector<queued_query> batch_;
+
+    /// Index of the next result set to be stored within \c batch_.
+    std::size_t next_;
+
+    /// Reused buffer holding the coalesced statement text.
+    std::string packet_;
+
+    void start_batch() {
+        using namespace std::placeholders;
+
+        if (pending_.empty()) {
+            return;
+        }
+
+        std::size_t n = coalescing() ? max_batch_size_ : 1u;
+        batch_.clear();
+        next_ = 0u;
+
+        while (!pending_.empty() && batch_.size() < n) {
+            batch_.push_back(std::move(pending_.front()));
+            pending_.pop_front();
+        }
+
+        std::string const* stmt = &batch_.front().stmt;
+
+        if (batch_.size() > 1u) {
+            packet_.clear();
+
+            for (auto const& q : batch_) {
+                if (!packet_.empty()) {
+                    // The newline terminates any trailing "--" comment.
+                    packet_.append("\n;");
+                }
+
+                append_trimmed(q.stmt);
+            }
+
+            stmt = &packet_;
+        }
+
+        connector_.async_query(
+                *stmt,
+                std::bind(&basic_query_queue::handle_query, this, _1));
+    }
+
+    void append_trimmed(std::string const& stmt) {
+        std::string::size_type n = stmt.find_last_not_of(" \t\r\n;");
+        packet_.append(stmt, 0, n == std::string::npos ? 0 : n + 1);
+    }
+
+    void store_next() {
+        using namespace std::placeholders;
+
+        connector_.async_store_result(
+                std::bind(&basic_query_queue::handle_store_result,
+                          this, _1, _2));
+    }
+
+    void handle_query(AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec) {
+            fail(ec);
+        } else {
+            store_next();
+        }
+    }
+
+    void handle_store_result(AMY_SYSTEM_NS::error_code const& ec,
+                             result_set rs)
+    {
+        if (ec) {
+            fail(ec);
+            return;
+        }
+
+        handler_type handler = std::move(batch_[next_++].handler);
+        handler(ec, rs);
+
+        if (next_ < batch_.size()) {
+            store_next();
+        } else {
+            drain();
+        }
+    }
+
+    /// Discards any unexpected trailing result before the next batch, so that
+    /// the connection never gets out of sync.
+    void drain() {
+        using namespace std::placeholders;
+
+        if (connector_.has_more_results()) {
+            connector_.async_store_result(
+                    std::bind(&basic_query_queue::handle_drain, this, _1));
+        } else {
+            batch_.clear();
+            next_ = 0u;
+            start_batch();
+        }
+    }
+
+    void handle_drain(AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec) {
+            batch_.clear();
+            next_ = 0u;
+            start_batch();
+        } else {
+            drain();
+        }
+    }
+
+    /// Whether \c ec is reported by the server for a single statement, in
+    /// which case the following statements of a multi-statement packet were
+    /// not executed.
+    static bool is_statement_error(AMY_SYSTEM_NS::error_code const& ec) {
+        return amy::error::detail::is_server_error(ec);
+    }
+
+    void fail(AMY_SYSTEM_NS::error_code const& ec) {
+        std::vector<queued_query> batch;
+        batch.swap(batch_);
+
+        std::size_t failed = next_;
+        next_ = 0u;
+
+        if (is_statement_error(ec)) {
+            for (std::size_t i = batch.size(); i > failed + 1; --i) {
+                pending_.push_front(std::move(batch[i - 1]));
+            }
+
+            batch.resize(failed + 1);
+        }
+
+        for (std::size_t i = failed; i < batch.size(); ++i) {
+            batch[i].handler(ec, result_set::empty_set());
+        }
+
+        if (!busy()) {
+            start_batch();
+        }
+    }
+
+}; // class basic_query_queue
+
+} // namespace amy
+
+#endif // __AMY_BASIC_QUERY_QUEUE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
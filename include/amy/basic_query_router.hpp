@@ -0,0 +1,388 @@
+#ifndef __AMY_BASIC_QUERY_ROUTER_HPP__
+#define __AMY_BASIC_QUERY_ROUTER_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+#include <amy/detail/statement_kind.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/auth_info.hpp>
+#include <amy/basic_connector.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/result_set.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace amy {
+
+/// Splits reads and writes over a primary and its replicas.
+/**
+ * A \c basic_query_router holds one connection to a primary and one per
+ * replica, each fronted by a \c basic_query_queue.  \c async_query_result
+ * classifies each statement: reads go to the next available replica in
+ * round-robin order, everything else goes to the primary.  Once a
+ * transaction is opened with \c BEGIN or \c START \c TRANSACTION, all
+ * statements go to the primary until it is closed with \c COMMIT or \c
+ * ROLLBACK, so that a transaction issued through the router reads its own
+ * writes.  The same goes while autocommit is disabled on the primary, with
+ * \c autocommit or a <tt>SET autocommit</tt> statement, since every statement
+ * then runs in a transaction.  These statements only change the state of the
+ * router once they succeed, but statements issued while they are pending go
+ * to the primary already.  Reads fall back to the primary when no replica is
+ * available.
+ *
+ * A replica is unavailable while its replication lag exceeds \c
+ * max_replica_lag, or when its lag is unknown.  Lags are refreshed by \c
+ * async_check_replicas, which reads \c Seconds_Behind_Master from \c SHOW \c
+ * SLAVE \c STATUS, or set by the application with \c replica_lag, e.g. from a
+ * heartbeat table.  Replicas are available until their lag is first checked.
+ *
+ * Like \c basic_query_queue, the router is not thread safe and must only be
+ * used from the thread running its \c io_service.  Completion handlers must be
+ * copyable.
+ */
+template<typename MySQLService>
+class basic_query_router : private amy::detail::noncopyable {
+public:
+    /// The type of the connectors of the router.
+    typedef basic_connector<MySQLService> connector_type;
+
+    /// The type of the queues serializing statements per connection.
+    typedef basic_query_queue<MySQLService> query_queue_type;
+
+    /// The type-erased completion handler of \c async_check_replicas.
+    typedef std::function<void (AMY_SYSTEM_NS::error_code const&)>
+        check_handler_type;
+
+    explicit basic_query_router(AMY_ASIO_NS::io_service& io_service) :
+        io_service_(io_service),
+        primary_(new member(io_service)),
+        max_replica_lag_(std::chrono::seconds(30)),
+        next_replica_(0u),
+        in_transaction_(false),
+        autocommit_(true),
+        pending_(0u)
+    {}
+
+    AMY_ASIO_NS::io_service& get_io_service() {
+        return io_service_;
+    }
+
+    connector_type& primary() {
+        return primary_->connector;
+    }
+
+    connector_type& replica(std::size_t index) {
+        return replicas_[index]->connector;
+    }
+
+    /// Number of replicas.
+    std::size_t replicas() const {
+        return replicas_.size();
+    }
+
+    /// Whether a transaction opened through the router is still open, or
+    /// autocommit is disabled on the primary.
+    bool in_transaction() const {
+        return in_transaction_ || !autocommit_;
+    }
+
+    /// Sets the autocommit mode of the primary, blocking.
+    /**
+     * Like \c connect_primary, must not be called while statements are in
+     * flight on the primary.
+     */
+    void autocommit(bool mode) {
+        primary_->connector.autocommit(mode);
+        set_autocommit(mode);
+    }
+
+    AMY_SYSTEM_NS::error_code autocommit(bool mode,
+                                         AMY_SYSTEM_NS::error_code& ec)
+    {
+        if (!primary_->connector.autocommit(mode, ec)) {
+            set_autocommit(mode);
+        }
+
+        return ec;
+    }
+
+    /// Connects to the primary.
+    template<typename Endpoint>
+    void connect_primary(Endpoint const& endpoint,
+                         auth_info const& auth,
+                         std::string const& database,
+                         client_flags flags)
+    {
+        primary_->connector.connect(endpoint, auth, database, flags);
+    }
+
+    /// Connects to a new replica and returns its index.
+    template<typename Endpoint>
+    std::size_t add_replica(Endpoint const& endpoint,
+                            auth_info const& auth,
+                            std::string const& database,
+                            client_flags flags)
+    {
+        std::unique_ptr<member> m(new member(io_service_));
+        m->connector.connect(endpoint, auth, database, flags);
+        replicas_.push_back(std::move(m));
+
+        return replicas_.size() - 1u;
+    }
+
+    std::chrono::seconds max_replica_lag() const {
+        return max_replica_lag_;
+    }
+
+    void max_replica_lag(std::chrono::seconds lag) {
+        max_replica_lag_ = lag;
+    }
+
+    /// Records the replication lag of a replica.
+    void replica_lag(std::size_t index, std::chrono::seconds lag) {
+        replicas_[index]->lag_known = true;
+        replicas_[index]->lag = lag;
+    }
+
+    /// Marks the replication lag of a replica unknown, excluding it.
+    void replica_lag_unknown(std::size_t index) {
+        replicas_[index]->lag_known = false;
+    }
+
+    /// Whether reads may be routed to a replica.
+    bool replica_available(std::size_t index) const {
+        member const& m = *replicas_[index];
+        return m.lag_known && m.lag <= max_replica_lag_;
+    }
+
+    template<typename QueryResultHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+        void (AMY_SYSTEM_NS::error_code, amy::result_set))
+    async_query_result(std::string const& stmt, QueryResultHandler handler) {
+        typedef AMY_ASIO_NS::async_completion<QueryResultHandler,
+            void (AMY_SYSTEM_NS::error_code, amy::result_set)> completion_type;
+
+        completion_type init(handler);
+
+        typedef typename std::decay<
+            typename completion_type::completion_handler_type>::type
+            handler_type;
+
+        detail::statement_kind kind = detail::classify_statement(stmt);
+
+        switch (kind) {
+        case detail::statement_begin:
+        case detail::statement_end:
+        case detail::statement_autocommit_off:
+        case detail::statement_autocommit_on:
+            ++pending_;
+            primary_->queue.async_query_result(
+                    stmt,
+                    track_transaction<handler_type>(
+                        *this, kind, init.completion_handler));
+            break;
+
+        case detail::statement_read:
+            route_read().async_query_result(stmt, init.completion_handler);
+            break;
+
+        default:
+            primary_->queue.async_query_result(stmt, init.completion_handler);
+        }
+
+        return init.result.get();
+    }
+
+    /// Refreshes the replication lag of all replicas.
+    /**
+     * A replica which cannot be queried, or which does not replicate, gets an
+     * unknown lag.  The handler receives the first error met, if any.
+     */
+    template<typename CheckHandler>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CheckHandler,
+        void (AMY_SYSTEM_NS::error_code))
+    async_check_replicas(CheckHandler handler) {
+        using namespace std::placeholders;
+
+        AMY_ASIO_NS::async_completion<CheckHandler,
+            void (AMY_SYSTEM_NS::error_code)> init(handler);
+
+        std::shared_ptr<lag_check> check(new lag_check(
+                    replicas_.size(),
+                    check_handler_type(init.completion_handler)));
+
+        if (replicas_.empty()) {
+            io_service_.post(std::bind(check->handler,
+                                       AMY_SYSTEM_NS::error_code()));
+        }
+
+        for (std::size_t i = 0; i < replicas_.size(); ++i) {
+            replicas_[i]->queue.async_query_result(
+                    "SHOW SLAVE STATUS",
+                    std::bind(&basic_query_router::handle_check_replica,
+                              this, check, i, _1, _2));
+        }
+
+        return init.result.get();
+    }
+
+private:
+    struct member {
+        explicit member(AMY_ASIO_NS::io_service& io_service) :
+            connector(io_service),
+            queue(connector),
+            lag_known(true),
+            lag(0)
+        {}
+
+        connector_type connector;
+        query_queue_type queue;
+        bool lag_known;
+        std::chrono::seconds lag;
+
+    }; // struct member
+
+    /// Updates the transaction state of the router once a statement opening
+    /// or closing a transaction completes.
+    template<typename Handler>
+    class track_transaction {
+    public:
+        track_transaction(basic_query_router& router,
+                          detail::statement_kind kind,
+                          Handler const& handler) :
+            router_(&router),
+            kind_(kind),
+            handler_(handler)
+        {}
+
+        void operator()(AMY_SYSTEM_NS::error_code const& ec,
+                        result_set rs)
+        {
+            router_->complete_transaction_statement(kind_, ec);
+            handler_(ec, rs);
+        }
+
+    private:
+        basic_query_router* router_;
+        detail::statement_kind kind_;
+        Handler handler_;
+
+    }; // class track_transaction
+
+    struct lag_check {
+        lag_check(std::size_t pending, check_handler_type handler) :
+            pending(pending),
+            handler(std::move(handler))
+        {}
+
+        std::size_t pending;
+        AMY_SYSTEM_NS::error_code error;
+        check_handler_type handler;
+
+    }; // struct lag_check
+
+    AMY_ASIO_NS::io_service& io_service_;
+    std::unique_ptr<member> primary_;
+    std::vector<std::unique_ptr<member> > replicas_;
+    std::chrono::seconds max_replica_lag_;
+    std::size_t next_replica_;
+    bool in_transaction_;
+    bool autocommit_;
+
+    /// Statements opening or closing a transaction not completed yet.
+    std::size_t pending_;
+
+    /// Reads go to the primary within a transaction, and while a statement
+    /// which may open one is pending.
+    query_queue_type& route_read() {
+        return in_transaction() || pending_ ? primary_->queue : next_replica();
+    }
+
+    void set_autocommit(bool mode) {
+        autocommit_ = mode;
+
+        // Enabling autocommit commits the current transaction.
+        if (mode) {
+            in_transaction_ = false;
+        }
+    }
+
+    void complete_transaction_statement(detail::statement_kind kind,
+                                        AMY_SYSTEM_NS::error_code const& ec)
+    {
+        --pending_;
+
+        switch (kind) {
+        case detail::statement_begin:
+            if (!ec) {
+                in_transaction_ = true;
+            }
+            break;
+
+        case detail::statement_end:
+            // A failed COMMIT or ROLLBACK ends the transaction all the same.
+            in_transaction_ = false;
+            break;
+
+        default:
+            if (!ec) {
+                set_autocommit(kind == detail::statement_autocommit_on);
+            }
+        }
+    }
+
+    /// The next available replica, or the primary if there is none.
+    query_queue_type& next_replica() {
+        for (std::size_t i = 0; i < replicas_.size(); ++i) {
+            std::size_t index = next_replica_++ % replicas_.size();
+
+            if (replica_available(index)) {
+                return replicas_[index]->queue;
+            }
+        }
+
+        return primary_->queue;
+    }
+
+    void handle_check_replica(std::shared_ptr<lag_check> check,
+                              std::size_t index,
+                              AMY_SYSTEM_NS::error_code const& ec,
+                              result_set rs)
+    {
+        if (ec && !check->error) {
+            check->error = ec;
+        }
+
+        replica_lag_unknown(index);
+
+        if (!ec && !rs.empty()) {
+            auto const& fields = rs.fields_info();
+
+            for (std::size_t i = 0; i < fields.size(); ++i) {
+                if (fields[i].name() == "Seconds_Behind_Master" &&
+                    !rs[0].at(i).is_null())
+                {
+                    replica_lag(index, std::chrono::seconds(
+                                rs[0].at(i).template as<sql_bigint>()));
+                }
+            }
+        }
+
+        if (--check->pending == 0u) {
+            check->handler(check->error);
+        }
+    }
+
+}; // class basic_query_router
+
+} // namespace amy
+
+#endif // __AMY_BASIC_QUERY_ROUTER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -57,6 +57,10 @@ const client_flags client_odbc = detail::client_odbc;
 /// mysql_ssl_set()  before calling \c mysql_real_connect().
 const client_flags client_ssl = detail::client_ssl;
 
+/// Keeps the options set on the connection when a connect operation fails,
+/// so that it may be retried without setting them again.
+const client_flags client_remember_options = detail::client_remember_options;
+
 /// Default client flags.
 const client_flags default_flags = 0;
 
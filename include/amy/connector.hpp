@@ -2,6 +2,11 @@
 #define __AMY_CONNECTOR_HPP__
 
 #include <amy/basic_connector.hpp>
+#include <amy/basic_connector_group.hpp>
+#include <amy/basic_insert_batcher.hpp>
+#include <amy/basic_load_balancer.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/basic_query_router.hpp>
 #include <amy/basic_results_iterator.hpp>
 #include <amy/basic_scoped_transaction.hpp>
 #include <amy/mysql_service.hpp>
@@ -20,6 +25,25 @@ typedef
     basic_scoped_transaction<mysql_service>
     scoped_transaction;
 
+typedef
+    basic_query_queue<mysql_service>
+    query_queue;
+
+typedef
+    basic_query_router<mysql_service>
+    query_router;
+
+typedef
+    basic_connector_group<mysql_service>
+    connector_group;
+
+typedef
+    basic_load_balancer<mysql_service>
+    load_balancer;
+
+template<typename... Columns>
+using insert_batcher = basic_insert_batcher<mysql_service, Columns...>;
+
 } // namespace amy
 
 #endif // __AMY_CONNECTOR_HPP__
@@ -0,0 +1,47 @@
+#ifndef __AMY_DETAIL_ASYNC_INITIATE_HPP__
+#define __AMY_DETAIL_ASYNC_INITIATE_HPP__
+
+#include <amy/asio.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/async_result.hpp>
+#else
+#include <boost/asio/async_result.hpp>
+#endif
+
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// Launches an asynchronous operation for the completion token \p token.
+/**
+ * \p initiation is invoked with the completion handler derived from \p token
+ * followed by \p args.  With Asio versions providing \c async_initiate, the
+ * invocation may be deferred, e.g. until a coroutine awaits the operation
+ * when \p token is \c use_awaitable, hence \p initiation and \p args must not
+ * refer to temporaries.  Older versions fall back to \c async_completion.
+ */
+template<typename Signature,
+         typename CompletionToken,
+         typename Initiation,
+         typename... Args>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, Signature)
+async_initiate(Initiation initiation, CompletionToken& token, Args&&... args) {
+#if defined(AMY_ASIO_HAS_ASYNC_INITIATE)
+    return AMY_ASIO_NS::async_initiate<CompletionToken, Signature>(
+            std::move(initiation), token, std::forward<Args>(args)...);
+#else
+    AMY_ASIO_NS::async_completion<CompletionToken, Signature> init(token);
+    initiation(std::move(init.completion_handler),
+               std::forward<Args>(args)...);
+    return init.result.get();
+#endif
+}
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_ASYNC_INITIATE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,124 @@
+#ifndef __AMY_DETAIL_CONNECT_PARAMS_HPP__
+#define __AMY_DETAIL_CONNECT_PARAMS_HPP__
+
+#include <amy/detail/mysql_types.hpp>
+
+#include <amy/auth_info.hpp>
+#include <amy/endpoint_traits.hpp>
+
+#include <string>
+
+namespace amy {
+namespace detail {
+
+/// Remembers the parameters of a connect operation, so that the same server
+/// can be connected to again later, e.g. to open a side connection.
+class connect_params {
+public:
+    connect_params() :
+        connected_(false),
+        has_host_(false),
+        port_(0u),
+        has_unix_socket_(false),
+        has_password_(false),
+        flags_(0)
+    {}
+
+    template<typename Endpoint>
+    void assign(Endpoint const& endpoint,
+                auth_info const& auth,
+                std::string const& database,
+                client_flags flags)
+    {
+        amy::endpoint_traits<Endpoint> traits(endpoint);
+
+        connected_ = true;
+        has_host_ = !!traits.host();
+        host_ = has_host_ ? traits.host() : "";
+        port_ = traits.port();
+        has_unix_socket_ = !!traits.unix_socket();
+        unix_socket_ = has_unix_socket_ ? traits.unix_socket() : "";
+        user_ = auth.user();
+        has_password_ = !!auth.password();
+        password_ = has_password_ ? auth.password() : "";
+        database_ = database;
+        flags_ = flags;
+    }
+
+    /// Whether any connect operation has been recorded.
+    bool empty() const {
+        return !connected_;
+    }
+
+    char const* host() const {
+        return has_host_ ? host_.c_str() : nullptr;
+    }
+
+    unsigned int port() const {
+        return port_;
+    }
+
+    char const* unix_socket() const {
+        return has_unix_socket_ ? unix_socket_.c_str() : nullptr;
+    }
+
+    amy::auth_info auth() const {
+        return has_password_ ?
+            amy::auth_info(user_, password_) :
+            amy::auth_info(user_);
+    }
+
+    std::string const& database() const {
+        return database_;
+    }
+
+    client_flags flags() const {
+        return flags_;
+    }
+
+private:
+    bool connected_;
+    bool has_host_;
+    std::string host_;
+    unsigned int port_;
+    bool has_unix_socket_;
+    std::string unix_socket_;
+    std::string user_;
+    bool has_password_;
+    std::string password_;
+    std::string database_;
+    client_flags flags_;
+
+}; // class connect_params
+
+} // namespace detail
+
+template<>
+class endpoint_traits<detail::connect_params> {
+public:
+    endpoint_traits(detail::connect_params const& params) :
+        params_(params)
+    {}
+
+    char const* host() const {
+        return params_.host();
+    }
+
+    unsigned int port() const {
+        return params_.port();
+    }
+
+    char const* unix_socket() const {
+        return params_.unix_socket();
+    }
+
+private:
+    detail::connect_params const& params_;
+
+}; // class endpoint_traits<detail::connect_params>
+
+} // namespace amy
+
+#endif // __AMY_DETAIL_CONNECT_PARAMS_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,142 @@
+#ifndef __AMY_DETAIL_HANDLER_PTR_HPP__
+#define __AMY_DETAIL_HANDLER_PTR_HPP__
+
+#include <amy/asio.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/associated_allocator.hpp>
+#else
+#include <boost/asio/associated_allocator.hpp>
+#endif
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// Owns the state of a composed asynchronous operation together with its
+/// final completion handler.
+/**
+ * The state is allocated with the allocator associated with the handler, so
+ * that handlers carrying a custom allocator (e.g. one drawing from a
+ * coroutine frame or a per-connection pool) fully control the memory used by
+ * the operation.  The pointer is move-only, which allows move-only handlers
+ * such as the ones created by \c use_awaitable.
+ *
+ * \c T is constructed with a const reference to the handler followed by the
+ * remaining constructor arguments.
+ */
+template<typename T, typename Handler>
+class handler_ptr {
+public:
+    typedef typename AMY_ASIO_NS::associated_allocator<Handler>::type
+        handler_allocator_type;
+
+    typedef typename std::allocator_traits<handler_allocator_type>::
+        template rebind_alloc<T> allocator_type;
+
+    typedef std::allocator_traits<allocator_type> allocator_traits;
+
+    template<typename DeducedHandler, typename... Args>
+    explicit handler_ptr(DeducedHandler&& handler, Args&&... args) :
+        t_(nullptr),
+        handler_(std::forward<DeducedHandler>(handler))
+    {
+        allocator_type alloc(get_allocator());
+        T* t = allocator_traits::allocate(alloc, 1);
+
+        try {
+            allocator_traits::construct(alloc, t, handler_,
+                                        std::forward<Args>(args)...);
+        } catch (...) {
+            allocator_traits::deallocate(alloc, t, 1);
+            throw;
+        }
+
+        t_ = t;
+    }
+
+    handler_ptr(handler_ptr&& other) :
+        t_(other.t_),
+        handler_(std::move(other.handler_))
+    {
+        other.t_ = nullptr;
+    }
+
+    handler_ptr(handler_ptr const&) = delete;
+    handler_ptr& operator=(handler_ptr const&) = delete;
+    handler_ptr& operator=(handler_ptr&&) = delete;
+
+    ~handler_ptr() {
+        if (t_) {
+            reset(allocator_type(get_allocator()));
+        }
+    }
+
+    /// Whether the state is still owned, i.e. \c invoke has not been called.
+    bool has_value() const noexcept {
+        return !!t_;
+    }
+
+    Handler const& handler() const noexcept {
+        return handler_;
+    }
+
+    handler_allocator_type get_allocator() const noexcept {
+        return AMY_ASIO_NS::get_associated_allocator(handler_);
+    }
+
+    T* get() const noexcept {
+        return t_;
+    }
+
+    T& operator*() const noexcept {
+        return *t_;
+    }
+
+    T* operator->() const noexcept {
+        return t_;
+    }
+
+    /// Destroys the state, then invokes the handler with \p args.
+    /**
+     * Destroying the state first gives the handler the chance to reuse its
+     * memory.  Arguments referring to the state must therefore be moved to
+     * the stack before calling \c invoke.
+     */
+    template<typename... Args>
+    void invoke(Args&&... args) {
+        allocator_type alloc(get_allocator());
+        Handler handler(std::move(handler_));
+        reset(alloc);
+        handler(std::forward<Args>(args)...);
+    }
+
+    /// Destroys the state and returns the handler, e.g. to invoke it through
+    /// an executor.
+    Handler release() {
+        allocator_type alloc(get_allocator());
+        Handler handler(std::move(handler_));
+        reset(alloc);
+        return handler;
+    }
+
+private:
+    T* t_;
+    Handler handler_;
+
+    void reset(allocator_type alloc) {
+        allocator_traits::destroy(alloc, t_);
+        allocator_traits::deallocate(alloc, t_, 1);
+        t_ = nullptr;
+    }
+
+}; // class handler_ptr
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_HANDLER_PTR_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -25,6 +25,9 @@ using ::mysql_num_rows;
 using ::mysql_real_escape_string;
 using ::mysql_row_seek;
 using ::mysql_row_tell;
+using ::mysql_set_local_infile_default;
+using ::mysql_set_local_infile_handler;
+using ::mysql_thread_id;
 
 inline void clear_error(AMY_SYSTEM_NS::error_code& ec) {
     errno = 0; // this won't clear the ::mysql_errno()
@@ -106,6 +109,27 @@ inline int32_t mysql_real_query(mysql_handle m,
     return error_wrapper(::mysql_real_query(m, stmt_str, length), m, ec);
 }
 
+/// The first half of \c mysql_real_query, sending the statement.
+inline int32_t mysql_send_query(mysql_handle m,
+                                char const* stmt_str,
+                                unsigned long length,
+                                AMY_SYSTEM_NS::error_code& ec)
+{
+    clear_error(ec);
+    return error_wrapper(::mysql_send_query(m, stmt_str, length), m, ec);
+}
+
+/// The second half of \c mysql_real_query, waiting for the server.
+inline void mysql_read_query_result(mysql_handle m,
+                                    AMY_SYSTEM_NS::error_code& ec)
+{
+    clear_error(ec);
+    if (::mysql_read_query_result(m)) {
+        ec = AMY_SYSTEM_NS::error_code(::mysql_errno(m),
+                                       amy::error::get_client_category());
+    }
+}
+
 inline uint32_t mysql_field_count(const mysql_handle m) {
     // ::mysql_field_count() never fails.
     return ::mysql_field_count(m);
@@ -42,6 +42,9 @@ const int client_no_schema        = CLIENT_NO_SCHEMA;
 const int client_odbc             = CLIENT_ODBC;
 const int client_ssl              = CLIENT_SSL;
 
+// Does not fit in an int.
+const client_flags client_remember_options = CLIENT_REMEMBER_OPTIONS;
+
 // MySQL options
 const int init_command            = MYSQL_INIT_COMMAND;
 const int compress                = MYSQL_OPT_COMPRESS;
@@ -0,0 +1,157 @@
+#ifndef __AMY_DETAIL_OBSERVED_HANDLER_HPP__
+#define __AMY_DETAIL_OBSERVED_HANDLER_HPP__
+
+#include <amy/detail/query_trace_hook.hpp>
+
+#include <amy/asio.hpp>
+#include <amy/query_trace.hpp>
+#include <amy/result_set.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/associated_allocator.hpp>
+#include <asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <asio/associated_cancellation_slot.hpp>
+#endif
+#else
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <boost/asio/associated_cancellation_slot.hpp>
+#endif
+#endif
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// Wraps the completion handler of a statement so that its \c query_trace is
+/// filled in by the service and handed to \p Observer.
+/**
+ * Copies of the wrapper share the trace, since services may copy the handler
+ * before invoking it.  They also share the observer with the connector, since
+ * a statement still pending when the connector is destroyed completes later
+ * with \c operation_aborted.
+ */
+template<typename Observer, typename Handler>
+class observed_handler {
+public:
+    template<typename DeducedHandler>
+    observed_handler(std::shared_ptr<Observer> observer,
+                     uint64_t statement_id,
+                     std::string const& stmt,
+                     DeducedHandler&& handler) :
+        observer_(std::move(observer)),
+        trace_(std::make_shared<query_trace>()),
+        handler_(std::forward<DeducedHandler>(handler))
+    {
+        trace_->statement_id = statement_id;
+        trace_->statement = stmt;
+        trace_->bytes_sent = stmt.size();
+        trace_->issued = query_trace::clock_type::now();
+    }
+
+    Handler const& handler() const noexcept {
+        return handler_;
+    }
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec) {
+        complete(ec);
+        handler_(ec);
+    }
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec, result_set rs) {
+        trace_->rows = rs.size();
+        trace_->fields = rs.field_count();
+        complete(ec);
+        handler_(ec, std::move(rs));
+    }
+
+    friend query_trace* get_query_trace(observed_handler const& h) noexcept {
+        return h.trace_.get();
+    }
+
+private:
+    std::shared_ptr<Observer> observer_;
+    std::shared_ptr<query_trace> trace_;
+    Handler handler_;
+
+    void complete(AMY_SYSTEM_NS::error_code const& ec) {
+        trace_->ec = ec;
+        trace_->mark(query_trace::dispatch);
+        (*observer_)(static_cast<query_trace const&>(*trace_));
+    }
+
+}; // class observed_handler
+
+} // namespace detail
+} // namespace amy
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+namespace asio {
+#else
+namespace boost {
+namespace asio {
+#endif
+
+template<typename Observer, typename Handler, typename Executor>
+struct associated_executor<amy::detail::observed_handler<Observer, Handler>,
+                           Executor>
+{
+    typedef typename associated_executor<Handler, Executor>::type type;
+
+    static type get(
+            amy::detail::observed_handler<Observer, Handler> const& h,
+            Executor const& ex = Executor()) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+
+}; // struct associated_executor<observed_handler>
+
+template<typename Observer, typename Handler, typename Allocator>
+struct associated_allocator<amy::detail::observed_handler<Observer, Handler>,
+                            Allocator>
+{
+    typedef typename associated_allocator<Handler, Allocator>::type type;
+
+    static type get(
+            amy::detail::observed_handler<Observer, Handler> const& h,
+            Allocator const& a = Allocator()) noexcept
+    {
+        return associated_allocator<Handler, Allocator>::get(h.handler(), a);
+    }
+
+}; // struct associated_allocator<observed_handler>
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+template<typename Observer, typename Handler, typename CancellationSlot>
+struct associated_cancellation_slot<
+    amy::detail::observed_handler<Observer, Handler>, CancellationSlot>
+{
+    typedef typename associated_cancellation_slot<Handler,
+                                                  CancellationSlot>::type type;
+
+    static type get(
+            amy::detail::observed_handler<Observer, Handler> const& h,
+            CancellationSlot const& s = CancellationSlot()) noexcept
+    {
+        return associated_cancellation_slot<Handler, CancellationSlot>::get(
+                h.handler(), s);
+    }
+
+}; // struct associated_cancellation_slot<observed_handler>
+#endif
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+} // namespace asio
+#else
+} // namespace asio
+} // namespace boost
+#endif
+
+#endif // __AMY_DETAIL_OBSERVED_HANDLER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,256 @@
+#ifndef __AMY_DETAIL_OP_QUEUE_HPP__
+#define __AMY_DETAIL_OP_QUEUE_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+#include <amy/detail/recycling_allocator.hpp>
+
+#include <amy/asio.hpp>
+
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// A FIFO queue running asynchronous operations of a connection one at a
+/// time.
+/**
+ * An operation is a function object invoked with an empty error code when it
+ * is its turn to start, or with \c operation_aborted when the queue is
+ * cleared before it got the chance to run.  A started operation must call \c
+ * complete exactly once when it finished using the connection, which starts
+ * the next queued operation, if any.
+ *
+ * Like an Asio strand, the queue guarantees that no two operations run
+ * concurrently, and that operations start in the order they were queued,
+ * while \c enqueue may be called from any thread.  Queue nodes are allocated
+ * from a per-queue \c recycling_pool, so that queueing operations does not
+ * hit the global allocator once the connection reached its steady state.
+ */
+class op_queue : private noncopyable {
+public:
+    op_queue() :
+        front_(nullptr),
+        back_(nullptr),
+        busy_(false),
+        completing_(false),
+        again_(false),
+        holds_(0u),
+        deferred_(false)
+    {}
+
+    ~op_queue() {
+        clear();
+    }
+
+    /// The pool queue nodes are allocated from.
+    recycling_pool& pool() {
+        return pool_;
+    }
+
+    /// Starts \p op right away if no other operation is running, otherwise
+    /// appends it to the queue.
+    template<typename Operation>
+    void enqueue(Operation&& op) {
+        typedef node_impl<typename std::decay<Operation>::type> node_type;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (!busy_) {
+                busy_ = true;
+            } else {
+                void* p = pool_.allocate(sizeof(node_type));
+                push(new (p) node_type(std::forward<Operation>(op), pool_));
+                return;
+            }
+        }
+
+        op(AMY_SYSTEM_NS::error_code());
+    }
+
+    /// Marks the running operation as finished and starts the next one.
+    void complete() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (holds_) {
+            deferred_ = true;
+            return;
+        }
+
+        // Operations completing synchronously from within the loop below
+        // only flag another iteration, which keeps the stack depth bounded.
+        if (completing_) {
+            again_ = true;
+            return;
+        }
+
+        completing_ = true;
+
+        for (;;) {
+            node* n = pop();
+
+            if (!n) {
+                busy_ = false;
+                break;
+            }
+
+            again_ = false;
+            lock.unlock();
+            n->invoke(AMY_SYSTEM_NS::error_code());
+            lock.lock();
+
+            if (!again_) {
+                break;
+            }
+        }
+
+        completing_ = false;
+    }
+
+    /// Keeps the next operation from starting until \c release is called.
+    /**
+     * Used when some work on behalf of the running operation (e.g. killing a
+     * query through a side connection) must finish before the connection can
+     * be used again.
+     */
+    void hold() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++holds_;
+    }
+
+    /// Undoes a previous \c hold, starting the next operation if the running
+    /// one completed in the meantime.
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (--holds_ || !deferred_) {
+                return;
+            }
+
+            deferred_ = false;
+        }
+
+        complete();
+    }
+
+    /// Aborts all queued operations that have not been started yet.
+    void clear() {
+        node* n = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            n = front_;
+            front_ = back_ = nullptr;
+        }
+
+        while (n) {
+            node* next = n->next_;
+            n->invoke(AMY_ASIO_NS::error::operation_aborted);
+            n = next;
+        }
+    }
+
+    /// Whether an operation is running.
+    bool busy() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return busy_;
+    }
+
+private:
+    class node {
+    public:
+        node* next_;
+
+        void invoke(AMY_SYSTEM_NS::error_code const& ec) {
+            func_(this, ec);
+        }
+
+    protected:
+        typedef void (*func_type)(node*, AMY_SYSTEM_NS::error_code const&);
+
+        explicit node(func_type func) :
+            next_(nullptr),
+            func_(func)
+        {}
+
+    private:
+        func_type func_;
+
+    }; // class node
+
+    template<typename Operation>
+    class node_impl : public node {
+    public:
+        template<typename DeducedOperation>
+        node_impl(DeducedOperation&& op, recycling_pool& pool) :
+            node(&node_impl::do_invoke),
+            op_(std::forward<DeducedOperation>(op)),
+            pool_(pool)
+        {}
+
+    private:
+        Operation op_;
+        recycling_pool& pool_;
+
+        static void do_invoke(node* base, AMY_SYSTEM_NS::error_code const& ec) {
+            node_impl* self = static_cast<node_impl*>(base);
+
+            // Frees the node before running the operation, so that the memory
+            // can be reused by the operation itself.
+            Operation op(std::move(self->op_));
+            recycling_pool& pool = self->pool_;
+            self->~node_impl();
+            pool.deallocate(self, sizeof(node_impl));
+
+            op(ec);
+        }
+
+    }; // class node_impl
+
+    mutable std::mutex mutex_;
+    recycling_pool pool_;
+    node* front_;
+    node* back_;
+    bool busy_;
+    bool completing_;
+    bool again_;
+    std::size_t holds_;
+    bool deferred_;
+
+    void push(node* n) {
+        if (back_) {
+            back_->next_ = n;
+        } else {
+            front_ = n;
+        }
+
+        back_ = n;
+    }
+
+    node* pop() {
+        node* n = front_;
+
+        if (n) {
+            front_ = n->next_;
+
+            if (!front_) {
+                back_ = nullptr;
+            }
+
+            n->next_ = nullptr;
+        }
+
+        return n;
+    }
+
+}; // class op_queue
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_OP_QUEUE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,82 @@
+#ifndef __AMY_DETAIL_QUERY_TRACE_HOOK_HPP__
+#define __AMY_DETAIL_QUERY_TRACE_HOOK_HPP__
+
+#include <amy/allocation_accounting.hpp>
+#include <amy/query_trace.hpp>
+
+namespace amy {
+namespace detail {
+
+/// Handlers are not traced by default.
+/**
+ * Handlers carrying a \c query_trace provide a \c get_query_trace overload
+ * found by argument dependent lookup, and so do the wrappers forwarding to
+ * the handler they wrap.
+ */
+template<typename Handler>
+inline query_trace* get_query_trace(Handler const&) noexcept {
+    return nullptr;
+}
+
+/// Returns the trace carried by \p handler, or \c nullptr.
+/**
+ * Services test the result before recording anything, which costs nothing
+ * once inlined for handlers without a trace.
+ */
+template<typename Handler>
+inline query_trace* query_trace_of(Handler const& handler) noexcept {
+    return get_query_trace(handler);
+}
+
+/// Marks the end of \p p if there is a trace.
+inline void mark_phase(query_trace* trace, query_trace::phase p) {
+    if (trace) {
+        trace->mark(p);
+    }
+}
+
+/// Marks the end of a phase when invoked, if there is a trace.
+class query_phase_marker {
+public:
+    query_phase_marker(query_trace* trace, query_trace::phase p) :
+        trace_(trace),
+        phase_(p)
+    {}
+
+    void operator()() const {
+        mark_phase(trace_, phase_);
+    }
+
+private:
+    query_trace* trace_;
+    query_trace::phase phase_;
+
+}; // class query_phase_marker
+
+/// Accounts the allocations made while it lives to \p trace, if any.
+#if defined(AMY_ALLOCATION_ACCOUNTING) && AMY_ALLOCATION_ACCOUNTING
+class query_allocation_scope : private noncopyable {
+public:
+    explicit query_allocation_scope(query_trace* trace) :
+        scope_(trace ? trace->allocations : unused_)
+    {}
+
+private:
+    allocation_counters unused_;
+    allocation_scope scope_;
+
+}; // class query_allocation_scope
+#else
+class query_allocation_scope : private noncopyable {
+public:
+    explicit query_allocation_scope(query_trace*) {}
+
+}; // class query_allocation_scope
+#endif
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_QUERY_TRACE_HOOK_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,246 @@
+#ifndef __AMY_DETAIL_RECONNECT_HANDLER_HPP__
+#define __AMY_DETAIL_RECONNECT_HANDLER_HPP__
+
+#include <amy/asio.hpp>
+#include <amy/reconnect_policy.hpp>
+#include <amy/result_set.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/associated_allocator.hpp>
+#include <asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <asio/associated_cancellation_slot.hpp>
+#endif
+#else
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <boost/asio/associated_cancellation_slot.hpp>
+#endif
+#endif
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// Wraps the completion handler of a query so that a lost connection is
+/// reestablished before the handler runs.
+/**
+ * When the query fails because the connection was lost and \p Connector has
+ * an enabled \c reconnect_policy, the connector reconnects first.  An
+ * idempotent statement is then run once more with the same handler, any
+ * other statement completes with the original error.  A statement is never
+ * run more than twice.
+ */
+template<typename Connector, typename Handler>
+class reconnect_handler_base {
+public:
+    template<typename DeducedHandler>
+    reconnect_handler_base(Connector& connector,
+                           std::string const& stmt,
+                           bool idempotent,
+                           DeducedHandler&& handler) :
+        connector_(&connector),
+        stmt_(stmt),
+        idempotent_(idempotent),
+        retried_(false),
+        handler_(std::forward<DeducedHandler>(handler))
+    {}
+
+    Handler const& handler() const noexcept {
+        return handler_;
+    }
+
+protected:
+    Connector* connector_;
+    std::string stmt_;
+    bool idempotent_;
+    bool retried_;
+    Handler handler_;
+
+    bool should_reconnect(AMY_SYSTEM_NS::error_code const& ec) const {
+        return !retried_ &&
+               reconnect_policy::is_connection_lost(ec) &&
+               connector_->get_reconnect_policy().enabled();
+    }
+
+    /// Whether the statement is to be run again after reconnecting.
+    bool should_retry(AMY_SYSTEM_NS::error_code const& reconnect_ec) {
+        retried_ = idempotent_ && !reconnect_ec;
+        return retried_;
+    }
+
+}; // class reconnect_handler_base
+
+template<typename Connector, typename Handler>
+class reconnect_query_handler :
+    public reconnect_handler_base<Connector, Handler>
+{
+    typedef reconnect_handler_base<Connector, Handler> base_type;
+
+public:
+    template<typename DeducedHandler>
+    reconnect_query_handler(Connector& connector,
+                            std::string const& stmt,
+                            bool idempotent,
+                            DeducedHandler&& handler) :
+        base_type(connector, stmt, idempotent,
+                  std::forward<DeducedHandler>(handler))
+    {}
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec) {
+        using namespace std::placeholders;
+
+        if (this->should_reconnect(ec)) {
+            std::shared_ptr<reconnect_query_handler> self =
+                std::make_shared<reconnect_query_handler>(std::move(*this));
+            self->connector_->async_reconnect(
+                    std::bind(&reconnect_query_handler::resume, self, ec, _1));
+        } else {
+            this->handler_(ec);
+        }
+    }
+
+private:
+    void resume(AMY_SYSTEM_NS::error_code const& ec,
+                AMY_SYSTEM_NS::error_code const& reconnect_ec)
+    {
+        if (this->should_retry(reconnect_ec)) {
+            Connector& connector = *this->connector_;
+            std::string stmt = this->stmt_;
+            connector.reissue_query(stmt, std::move(*this));
+        } else {
+            this->handler_(ec);
+        }
+    }
+
+}; // class reconnect_query_handler
+
+template<typename Connector, typename Handler>
+class reconnect_query_result_handler :
+    public reconnect_handler_base<Connector, Handler>
+{
+    typedef reconnect_handler_base<Connector, Handler> base_type;
+
+public:
+    template<typename DeducedHandler>
+    reconnect_query_result_handler(Connector& connector,
+                                   std::string const& stmt,
+                                   bool idempotent,
+                                   DeducedHandler&& handler) :
+        base_type(connector, stmt, idempotent,
+                  std::forward<DeducedHandler>(handler))
+    {}
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec, result_set rs) {
+        using namespace std::placeholders;
+
+        if (this->should_reconnect(ec)) {
+            std::shared_ptr<reconnect_query_result_handler> self =
+                std::make_shared<reconnect_query_result_handler>(
+                        std::move(*this));
+            self->connector_->async_reconnect(
+                    std::bind(&reconnect_query_result_handler::resume,
+                              self, ec, _1));
+        } else {
+            this->handler_(ec, std::move(rs));
+        }
+    }
+
+private:
+    void resume(AMY_SYSTEM_NS::error_code const& ec,
+                AMY_SYSTEM_NS::error_code const& reconnect_ec)
+    {
+        if (this->should_retry(reconnect_ec)) {
+            Connector& connector = *this->connector_;
+            std::string stmt = this->stmt_;
+            connector.reissue_query_result(stmt, std::move(*this));
+        } else {
+            this->handler_(ec, result_set::empty_set());
+        }
+    }
+
+}; // class reconnect_query_result_handler
+
+} // namespace detail
+} // namespace amy
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+namespace asio {
+#else
+namespace boost {
+namespace asio {
+#endif
+
+// Both wrappers forward the associated executor, allocator and cancellation
+// slot of the wrapped handler.
+
+#define AMY_FORWARD_ASSOCIATORS(wrapper)                                     \
+template<typename Connector, typename Handler, typename Executor>            \
+struct associated_executor<amy::detail::wrapper<Connector, Handler>,         \
+                           Executor>                                         \
+{                                                                            \
+    typedef typename associated_executor<Handler, Executor>::type type;      \
+                                                                             \
+    static type get(amy::detail::wrapper<Connector, Handler> const& h,       \
+                    Executor const& ex = Executor()) noexcept                \
+    {                                                                        \
+        return associated_executor<Handler, Executor>::get(h.handler(), ex); \
+    }                                                                        \
+};                                                                           \
+                                                                             \
+template<typename Connector, typename Handler, typename Allocator>           \
+struct associated_allocator<amy::detail::wrapper<Connector, Handler>,        \
+                            Allocator>                                       \
+{                                                                            \
+    typedef typename associated_allocator<Handler, Allocator>::type type;    \
+                                                                             \
+    static type get(amy::detail::wrapper<Connector, Handler> const& h,       \
+                    Allocator const& a = Allocator()) noexcept               \
+    {                                                                        \
+        return associated_allocator<Handler, Allocator>::get(h.handler(), a);\
+    }                                                                        \
+};
+
+AMY_FORWARD_ASSOCIATORS(reconnect_query_handler)
+AMY_FORWARD_ASSOCIATORS(reconnect_query_result_handler)
+
+#undef AMY_FORWARD_ASSOCIATORS
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#define AMY_FORWARD_CANCELLATION_SLOT(wrapper)                               \
+template<typename Connector, typename Handler, typename CancellationSlot>    \
+struct associated_cancellation_slot<                                         \
+    amy::detail::wrapper<Connector, Handler>, CancellationSlot>              \
+{                                                                            \
+    typedef typename associated_cancellation_slot<Handler,                   \
+                                                  CancellationSlot>::type    \
+        type;                                                                \
+                                                                             \
+    static type get(amy::detail::wrapper<Connector, Handler> const& h,       \
+                    CancellationSlot const& s = CancellationSlot()) noexcept \
+    {                                                                        \
+        return associated_cancellation_slot<Handler, CancellationSlot>::get( \
+                h.handler(), s);                                             \
+    }                                                                        \
+};
+
+AMY_FORWARD_CANCELLATION_SLOT(reconnect_query_handler)
+AMY_FORWARD_CANCELLATION_SLOT(reconnect_query_result_handler)
+
+#undef AMY_FORWARD_CANCELLATION_SLOT
+#endif
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+} // namespace asio
+#else
+} // namespace asio
+} // namespace boost
+#endif
+
+#endif // __AMY_DETAIL_RECONNECT_HANDLER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
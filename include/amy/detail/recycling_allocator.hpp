@@ -0,0 +1,168 @@
+#ifndef __AMY_DETAIL_RECYCLING_ALLOCATOR_HPP__
+#define __AMY_DETAIL_RECYCLING_ALLOCATOR_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+namespace amy {
+namespace detail {
+
+/// A small-object memory pool that keeps freed blocks for reuse.
+/**
+ * Blocks are grouped in size classes of \c granularity bytes, up to \c
+ * max_block_size bytes.  Each size class caches at most \c max_cached freed
+ * blocks, larger requests always go to the global allocator.  Once a
+ * connection reached its steady state, allocating and freeing the same kinds
+ * of objects over and over again never hits the global allocator.
+ *
+ * The pool is thread safe, and must outlive all blocks allocated from it.
+ */
+class recycling_pool : private noncopyable {
+public:
+    static const std::size_t granularity = 64;
+    static const std::size_t size_classes = 16;
+    static const std::size_t max_block_size = granularity * size_classes;
+    static const std::size_t max_cached = 8;
+
+    recycling_pool() :
+        cached_()
+    {
+        for (std::size_t i = 0; i < size_classes; ++i) {
+            free_[i] = nullptr;
+        }
+    }
+
+    ~recycling_pool() {
+        for (std::size_t i = 0; i < size_classes; ++i) {
+            while (free_[i]) {
+                block* b = free_[i];
+                free_[i] = b->next;
+                ::operator delete(b);
+            }
+        }
+    }
+
+    void* allocate(std::size_t size) {
+        if (size > max_block_size) {
+            return ::operator new(size);
+        }
+
+        std::size_t c = size_class(size);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (block* b = free_[c]) {
+                free_[c] = b->next;
+                --cached_[c];
+                return b;
+            }
+        }
+
+        return ::operator new((c + 1) * granularity);
+    }
+
+    void deallocate(void* p, std::size_t size) {
+        if (size <= max_block_size) {
+            std::size_t c = size_class(size);
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (cached_[c] < max_cached) {
+                block* b = static_cast<block*>(p);
+                b->next = free_[c];
+                free_[c] = b;
+                ++cached_[c];
+                return;
+            }
+        }
+
+        ::operator delete(p);
+    }
+
+private:
+    struct block {
+        block* next;
+    };
+
+    std::mutex mutex_;
+    block* free_[size_classes];
+    std::size_t cached_[size_classes];
+
+    static std::size_t size_class(std::size_t size) {
+        return size ? (size - 1) / granularity : 0;
+    }
+
+}; // class recycling_pool
+
+/// A standard allocator drawing memory from a \c recycling_pool.
+/**
+ * A default constructed allocator has no pool and falls back to the global
+ * allocator.
+ */
+template<typename T>
+class recycling_allocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef recycling_allocator<U> other;
+    };
+
+    recycling_allocator() noexcept :
+        pool_(nullptr)
+    {}
+
+    explicit recycling_allocator(recycling_pool* pool) noexcept :
+        pool_(pool)
+    {}
+
+    template<typename U>
+    recycling_allocator(recycling_allocator<U> const& other) noexcept :
+        pool_(other.pool())
+    {}
+
+    T* allocate(std::size_t n) {
+        std::size_t size = n * sizeof(T);
+
+        return static_cast<T*>(pool_ ?
+                pool_->allocate(size) :
+                ::operator new(size));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (pool_) {
+            pool_->deallocate(p, n * sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    recycling_pool* pool() const noexcept {
+        return pool_;
+    }
+
+    template<typename U>
+    bool operator==(recycling_allocator<U> const& other) const noexcept {
+        return pool_ == other.pool();
+    }
+
+    template<typename U>
+    bool operator!=(recycling_allocator<U> const& other) const noexcept {
+        return pool_ != other.pool();
+    }
+
+private:
+    recycling_pool* pool_;
+
+}; // class recycling_allocator
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_RECYCLING_ALLOCATOR_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,165 @@
+#ifndef __AMY_DETAIL_RECYCLING_HANDLER_HPP__
+#define __AMY_DETAIL_RECYCLING_HANDLER_HPP__
+
+#include <amy/detail/query_trace_hook.hpp>
+#include <amy/detail/recycling_allocator.hpp>
+
+#include <amy/asio.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/associated_allocator.hpp>
+#include <asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <asio/associated_cancellation_slot.hpp>
+#endif
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+#include <asio/associated_immediate_executor.hpp>
+#endif
+#else
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <boost/asio/associated_cancellation_slot.hpp>
+#endif
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+#include <boost/asio/associated_immediate_executor.hpp>
+#endif
+#endif
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// Wraps a completion handler so that the memory of the asynchronous
+/// operations completing it is drawn from a \c recycling_pool.
+/**
+ * Handlers with a custom associated allocator keep using it, only handlers
+ * with the default \c std::allocator are redirected to the pool.  The wrapper
+ * shares the ownership of the pool, so that memory can be given back to the
+ * pool until the handler itself is destroyed.  The associated executor,
+ * immediate executor and cancellation slot of the wrapped handler are
+ * preserved.
+ */
+template<typename Handler>
+class recycling_handler {
+public:
+    typedef typename AMY_ASIO_NS::associated_allocator<Handler>::type
+        handler_allocator_type;
+
+    /// Whether the wrapped handler has no custom allocator.
+    static const bool uses_pool =
+        std::is_same<handler_allocator_type, std::allocator<void> >::value;
+
+    typedef typename std::conditional<uses_pool,
+                                      recycling_allocator<void>,
+                                      handler_allocator_type>::type
+        allocator_type;
+
+    template<typename DeducedHandler>
+    recycling_handler(DeducedHandler&& handler,
+                      std::shared_ptr<recycling_pool> pool) :
+        handler_(std::forward<DeducedHandler>(handler)),
+        pool_(std::move(pool))
+    {}
+
+    allocator_type get_allocator() const noexcept {
+        return get_allocator(std::integral_constant<bool, uses_pool>());
+    }
+
+    Handler const& handler() const noexcept {
+        return handler_;
+    }
+
+    template<typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+    friend query_trace* get_query_trace(recycling_handler const& h) noexcept {
+        return query_trace_of(h.handler_);
+    }
+
+private:
+    Handler handler_;
+    std::shared_ptr<recycling_pool> pool_;
+
+    allocator_type get_allocator(std::true_type) const noexcept {
+        return allocator_type(pool_.get());
+    }
+
+    allocator_type get_allocator(std::false_type) const noexcept {
+        return AMY_ASIO_NS::get_associated_allocator(handler_);
+    }
+
+}; // class recycling_handler
+
+} // namespace detail
+} // namespace amy
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+namespace asio {
+#else
+namespace boost {
+namespace asio {
+#endif
+
+template<typename Handler, typename Executor>
+struct associated_executor<amy::detail::recycling_handler<Handler>, Executor> {
+    typedef typename associated_executor<Handler, Executor>::type type;
+
+    static type get(amy::detail::recycling_handler<Handler> const& h,
+                    Executor const& ex = Executor()) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+
+}; // struct associated_executor<recycling_handler>
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+template<typename Handler, typename CancellationSlot>
+struct associated_cancellation_slot<amy::detail::recycling_handler<Handler>,
+                                    CancellationSlot>
+{
+    typedef typename associated_cancellation_slot<Handler,
+                                                  CancellationSlot>::type type;
+
+    static type get(amy::detail::recycling_handler<Handler> const& h,
+                    CancellationSlot const& s = CancellationSlot()) noexcept
+    {
+        return associated_cancellation_slot<Handler, CancellationSlot>::get(
+                h.handler(), s);
+    }
+
+}; // struct associated_cancellation_slot<recycling_handler>
+#endif
+
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+template<typename Handler, typename Executor>
+struct associated_immediate_executor<amy::detail::recycling_handler<Handler>,
+                                     Executor>
+{
+    typedef typename associated_immediate_executor<Handler, Executor>::type
+        type;
+
+    static type get(amy::detail::recycling_handler<Handler> const& h,
+                    Executor const& ex) noexcept
+    {
+        return associated_immediate_executor<Handler, Executor>::get(
+                h.handler(), ex);
+    }
+
+}; // struct associated_immediate_executor<recycling_handler>
+#endif
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+} // namespace asio
+#else
+} // namespace asio
+} // namespace boost
+#endif
+
+#endif // __AMY_DETAIL_RECYCLING_HANDLER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
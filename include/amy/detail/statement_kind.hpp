@@ -0,0 +1,225 @@
+#ifndef __AMY_DETAIL_STATEMENT_KIND_HPP__
+#define __AMY_DETAIL_STATEMENT_KIND_HPP__
+
+#include <cctype>
+#include <string>
+
+namespace amy {
+namespace detail {
+
+/// Coarse classification of a SQL statement for routing purposes.
+enum statement_kind {
+    /// A statement which only reads and may run on a replica.
+    statement_read,
+
+    /// Any statement which must run on the primary.
+    statement_write,
+
+    /// A statement opening a transaction.
+    statement_begin,
+
+    /// A statement closing a transaction.
+    statement_end,
+
+    /// A statement disabling autocommit, after which the session stays in a
+    /// transaction.
+    statement_autocommit_off,
+
+    /// A statement enabling autocommit, which also commits.
+    statement_autocommit_on
+
+}; // enum statement_kind
+
+/// Splits a statement into upper-cased keywords and \c ; separators, skipping
+/// comments, literals and quoted identifiers.
+class statement_lexer {
+public:
+    explicit statement_lexer(std::string const& stmt) :
+        stmt_(stmt),
+        pos_(0u)
+    {}
+
+    /// Stores the next keyword, identifier or \c ; into \p token, returns \c
+    /// false at the end of the statement.
+    bool next(std::string& token) {
+        token.clear();
+
+        while (pos_ < stmt_.size()) {
+            char c = stmt_[pos_];
+
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++pos_;
+            } else if (c == '#' || starts_line_comment()) {
+                skip_past("\n");
+            } else if (starts_with("/*")) {
+                pos_ += 2u;
+                skip_past("*/");
+            } else if (c == '\'' || c == '"' || c == '`') {
+                skip_quoted(c);
+            } else if (c == ';') {
+                ++pos_;
+                token = ";";
+                return true;
+            } else if (is_word(c)) {
+                while (pos_ < stmt_.size() && is_word(stmt_[pos_])) {
+                    token += static_cast<char>(std::toupper(
+                                static_cast<unsigned char>(stmt_[pos_++])));
+                }
+
+                return true;
+            } else {
+                ++pos_;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    std::string const& stmt_;
+    std::string::size_type pos_;
+
+    static bool is_word(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) ||
+               c == '_' || c == '$';
+    }
+
+    bool starts_with(char const* s) const {
+        return stmt_.compare(pos_, std::char_traits<char>::length(s), s) == 0;
+    }
+
+    /// "--" only starts a comment when followed by a space.
+    bool starts_line_comment() const {
+        return starts_with("--") &&
+               (pos_ + 2u == stmt_.size() ||
+                std::isspace(static_cast<unsigned char>(stmt_[pos_ + 2u])));
+    }
+
+    void skip_past(char const* s) {
+        std::string::size_type n = stmt_.find(s, pos_);
+        pos_ = n == std::string::npos
+            ? stmt_.size()
+            : n + std::char_traits<char>::length(s);
+    }
+
+    void skip_quoted(char quote) {
+        for (++pos_; pos_ < stmt_.size(); ++pos_) {
+            if (stmt_[pos_] == '\\' && quote != '`') {
+                ++pos_;
+            } else if (stmt_[pos_] == quote) {
+                // A doubled quote stands for itself.
+                if (pos_ + 1u < stmt_.size() && stmt_[pos_ + 1u] == quote) {
+                    ++pos_;
+                } else {
+                    ++pos_;
+                    return;
+                }
+            }
+        }
+    }
+
+}; // class statement_lexer
+
+/// Whether \p stmt holds more than one statement, a trailing \c ; aside.
+inline bool is_multi_statement(std::string const& stmt) {
+    statement_lexer lexer(stmt);
+    std::string token;
+    bool separated = false;
+
+    while (lexer.next(token)) {
+        if (token == ";") {
+            separated = true;
+        } else if (separated) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// Classifies \p stmt, erring on the side of \c statement_write.
+/**
+ * \c SELECT, \c SHOW, \c DESCRIBE and \c EXPLAIN statements are reads, unless
+ * they lock rows, write into variables or files, or depend on the session
+ * state of a previous statement (\c LAST_INSERT_ID(), \c FOUND_ROWS(), named
+ * locks).  \c SET statements assigning \c autocommit are told apart,
+ * values other than 1, \c ON and \c TRUE disabling it.  Everything else,
+ * including other \c SET statements and \c WITH, is a write, and so are
+ * several statements separated by \c ;, whatever they are.
+ */
+inline statement_kind classify_statement(std::string const& stmt) {
+    if (is_multi_statement(stmt)) {
+        return statement_write;
+    }
+
+    statement_lexer lexer(stmt);
+    std::string token;
+
+    if (!lexer.next(token) || token == ";") {
+        return statement_write;
+    }
+
+    if (token == "BEGIN") {
+        return statement_begin;
+    }
+
+    if (token == "START") {
+        return lexer.next(token) && token == "TRANSACTION"
+            ? statement_begin
+            : statement_write;
+    }
+
+    if (token == "COMMIT") {
+        return statement_end;
+    }
+
+    if (token == "ROLLBACK") {
+        // ROLLBACK TO SAVEPOINT keeps the transaction open.
+        return lexer.next(token) && token == "TO"
+            ? statement_write
+            : statement_end;
+    }
+
+    if (token == "SET") {
+        while (lexer.next(token)) {
+            if (token == "AUTOCOMMIT") {
+                return lexer.next(token) &&
+                       (token == "1" || token == "ON" || token == "TRUE")
+                    ? statement_autocommit_on
+                    : statement_autocommit_off;
+            }
+        }
+
+        return statement_write;
+    }
+
+    if (token != "SELECT" && token != "SHOW" && token != "DESCRIBE" &&
+        token != "DESC" && token != "EXPLAIN")
+    {
+        return statement_write;
+    }
+
+    std::string previous;
+
+    while (lexer.next(token)) {
+        if (token == "INTO" || token == "LAST_INSERT_ID" ||
+            token == "FOUND_ROWS" || token == "GET_LOCK" ||
+            token == "RELEASE_LOCK" || token == "RELEASE_ALL_LOCKS" ||
+            (previous == "FOR" && (token == "UPDATE" || token == "SHARE")) ||
+            (previous == "LOCK" && token == "IN"))
+        {
+            return statement_write;
+        }
+
+        previous.swap(token);
+    }
+
+    return statement_read;
+}
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_STATEMENT_KIND_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,123 @@
+#ifndef __AMY_DETAIL_UNIQUE_HANDLER_HPP__
+#define __AMY_DETAIL_UNIQUE_HANDLER_HPP__
+
+#include <amy/asio.hpp>
+
+#if defined(AMY_ASIO_HAS_ASYNC_INITIATE)
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/post.hpp>
+#else
+#include <boost/asio/post.hpp>
+#endif
+#endif
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace amy {
+namespace detail {
+
+/// A type-erased completion handler invoked with an error code, for handlers
+/// waiting on something other than an operation of the service.
+/**
+ * Unlike \c std::function, the wrapped handler need only be movable, as are
+ * the handlers of coroutine completion tokens.  The handler is invoked at
+ * most once, and is destroyed before it runs.
+ */
+class unique_handler {
+public:
+    unique_handler() noexcept {}
+
+    template<typename Handler,
+             typename = typename std::enable_if<
+                 !std::is_same<typename std::decay<Handler>::type,
+                               unique_handler>::value>::type>
+    unique_handler(Handler&& handler) :
+        impl_(new impl<typename std::decay<Handler>::type>(
+                    std::forward<Handler>(handler)))
+    {}
+
+    unique_handler(unique_handler&&) = default;
+    unique_handler& operator=(unique_handler&&) = default;
+
+    explicit operator bool() const noexcept {
+        return !!impl_;
+    }
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec) {
+        impl_.release()->invoke(ec);
+    }
+
+    /// Invokes the handler with \p ec from \p io_service, rather than from
+    /// within the calling function.
+    void post(AMY_ASIO_NS::io_service& io_service,
+              AMY_SYSTEM_NS::error_code const& ec);
+
+private:
+    class impl_base {
+    public:
+        virtual ~impl_base() {}
+
+        /// Moves the handler out and destroys \c *this before invoking it.
+        virtual void invoke(AMY_SYSTEM_NS::error_code const& ec) = 0;
+
+    }; // class impl_base
+
+    template<typename Handler>
+    class impl : public impl_base {
+    public:
+        template<typename DeducedHandler>
+        explicit impl(DeducedHandler&& handler) :
+            handler_(std::forward<DeducedHandler>(handler))
+        {}
+
+        void invoke(AMY_SYSTEM_NS::error_code const& ec) override {
+            Handler handler(std::move(handler_));
+            delete this;
+            handler(ec);
+        }
+
+    private:
+        Handler handler_;
+
+    }; // class impl
+
+    struct bound_handler;
+
+    std::unique_ptr<impl_base> impl_;
+
+}; // class unique_handler
+
+struct unique_handler::bound_handler {
+    bound_handler(unique_handler&& handler,
+                  AMY_SYSTEM_NS::error_code const& ec) :
+        handler(std::move(handler)),
+        ec(ec)
+    {}
+
+    void operator()() {
+        handler(ec);
+    }
+
+    unique_handler handler;
+    AMY_SYSTEM_NS::error_code ec;
+
+}; // struct unique_handler::bound_handler
+
+inline void unique_handler::post(AMY_ASIO_NS::io_service& io_service,
+                                 AMY_SYSTEM_NS::error_code const& ec)
+{
+#if defined(AMY_ASIO_HAS_ASYNC_INITIATE)
+    // Unlike io_service::post, requires no copyable handler.
+    AMY_ASIO_NS::post(io_service, bound_handler(std::move(*this), ec));
+#else
+    io_service.post(bound_handler(std::move(*this), ec));
+#endif
+}
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_UNIQUE_HANDLER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
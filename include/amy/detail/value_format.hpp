@@ -0,0 +1,73 @@
+#ifndef __AMY_DETAIL_VALUE_FORMAT_HPP__
+#define __AMY_DETAIL_VALUE_FORMAT_HPP__
+
+#include <amy/sql_types.hpp>
+
+#include <date/date.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+namespace amy {
+namespace detail {
+
+// Formatting of values as text, appended to the statements or rows being
+// built without going through streams nor temporary strings.
+
+template<typename Integer>
+bool is_negative(Integer value, std::true_type) {
+    return value < 0;
+}
+
+template<typename Integer>
+bool is_negative(Integer, std::false_type) {
+    return false;
+}
+
+template<typename Integer>
+void append_integer(std::string& out, Integer value) {
+    typedef typename std::make_unsigned<Integer>::type unsigned_type;
+
+    // Digits are written backwards, from the least significant one.
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    bool negative = is_negative(value, std::is_signed<Integer>());
+    unsigned_type n = negative ? unsigned_type(0) - unsigned_type(value)
+                               : unsigned_type(value);
+
+    do {
+        *--p = static_cast<char>('0' + n % 10u);
+        n /= 10u;
+    } while (n);
+
+    if (negative) {
+        *--p = '-';
+    }
+
+    out.append(p, digits + sizeof(digits));
+}
+
+/// Appends \p value with enough digits to read it back exactly.  Infinite
+/// and NaN values have no SQL literal, and are left to the callers.
+inline void append_floating(std::string& out, double value, bool single) {
+    char digits[32];
+    int n = std::snprintf(digits, sizeof(digits),
+                          single ? "%.9g" : "%.17g", value);
+    out.append(digits, static_cast<std::size_t>(n));
+}
+
+inline void append_datetime(std::string& out, sql_datetime const& value) {
+    out += date::format(
+            "%F %T",
+            std::chrono::time_point_cast<std::chrono::microseconds>(value));
+}
+
+} // namespace detail
+} // namespace amy
+
+#endif // __AMY_DETAIL_VALUE_FORMAT_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,198 @@
+#ifndef __AMY_DIGEST_TABLE_HPP__
+#define __AMY_DIGEST_TABLE_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/query_trace.hpp>
+#include <amy/statement_digest.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace amy {
+
+/// Aggregated figures of the statements sharing a digest.
+struct digest_stats {
+    typedef std::chrono::nanoseconds duration;
+
+    digest_stats() :
+        hash(0u),
+        count(0u),
+        errors(0u),
+        rows(0u),
+        total_latency(duration::zero()),
+        max_latency(duration::zero())
+    {}
+
+    uint64_t hash;
+
+    /// The normalized statement, empty for statements which did not fit in
+    /// the table.
+    std::string text;
+
+    uint64_t count;
+    uint64_t errors;
+    uint64_t rows;
+    duration total_latency;
+    duration max_latency;
+
+    void add(query_trace const& trace) {
+        duration latency =
+            std::chrono::duration_cast<duration>(trace.total());
+
+        ++count;
+        errors += trace.ec ? 1u : 0u;
+        rows += trace.rows;
+        total_latency += latency;
+        max_latency = std::max(max_latency, latency);
+    }
+
+}; // struct digest_stats
+
+/// Aggregates statements per digest, in a table of bounded size.
+/**
+ * Once \c capacity digests are known, statements with new digests are
+ * accounted for in a single overflow entry, so that the memory of the table
+ * stays bounded whatever the variety of statements.  The table is thread
+ * safe, and only allocates for digests it has not seen yet.
+ */
+class digest_table : private detail::noncopyable {
+public:
+    explicit digest_table(std::size_t capacity = 1000u) :
+        capacity_(capacity)
+    {
+        entries_.reserve(capacity);
+    }
+
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+    void record(statement_digest const& digest, query_trace const& trace) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = entries_.find(digest.hash());
+
+        if (it == entries_.end()) {
+            if (entries_.size() >= capacity_) {
+                overflow_.add(trace);
+                return;
+            }
+
+            digest_stats& stats = entries_[digest.hash()];
+            stats.hash = digest.hash();
+            stats.text.assign(digest.text(), digest.size());
+            stats.add(trace);
+        } else {
+            it->second.add(trace);
+        }
+    }
+
+    /// The aggregated digests, by decreasing total latency.
+    std::vector<digest_stats> snapshot() const {
+        std::vector<digest_stats> result;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            result.reserve(entries_.size());
+
+            for (auto const& entry : entries_) {
+                result.push_back(entry.second);
+            }
+        }
+
+        std::sort(result.begin(), result.end(),
+                  [](digest_stats const& lhs, digest_stats const& rhs) {
+                      return lhs.total_latency > rhs.total_latency;
+                  });
+
+        return result;
+    }
+
+    /// Statements not aggregated since the table was full.
+    digest_stats overflow() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return overflow_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        overflow_ = digest_stats();
+    }
+
+private:
+    std::size_t capacity_;
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, digest_stats> entries_;
+    digest_stats overflow_;
+
+}; // class digest_table
+
+/// An observer of \c basic_connector aggregating statements per digest, and
+/// optionally reporting slow statements.
+/**
+ * \code
+ * amy::digest_table digests;
+ *
+ * amy::basic_connector<amy::mysql_service, amy::digest_observer> connector(
+ *         io_service,
+ *         amy::digest_observer(
+ *             digests, std::chrono::milliseconds(100),
+ *             [](amy::query_trace const& trace,
+ *                amy::statement_digest const& digest) {
+ *                 std::clog << "slow query: " << digest.text() << std::endl;
+ *             }));
+ * \endcode
+ */
+class digest_observer {
+public:
+    typedef std::function<void (query_trace const&, statement_digest const&)>
+        slow_query_handler;
+
+    /// \p table must outlive the observer.
+    explicit digest_observer(digest_table& table) :
+        table_(&table),
+        threshold_(query_trace::clock_type::duration::max())
+    {}
+
+    /// Also invokes \p on_slow_query with the statements taking at least
+    /// \p threshold, from issuing them to running their handler.
+    template<typename Rep, typename Period>
+    digest_observer(digest_table& table,
+                    std::chrono::duration<Rep, Period> const& threshold,
+                    slow_query_handler on_slow_query) :
+        table_(&table),
+        threshold_(std::chrono::duration_cast<
+                       query_trace::clock_type::duration>(threshold)),
+        on_slow_query_(std::move(on_slow_query))
+    {}
+
+    void operator()(query_trace const& trace) const {
+        statement_digest digest(trace.statement);
+
+        table_->record(digest, trace);
+
+        if (on_slow_query_ && trace.total() >= threshold_) {
+            on_slow_query_(trace, digest);
+        }
+    }
+
+private:
+    digest_table* table_;
+    query_trace::clock_type::duration threshold_;
+    slow_query_handler on_slow_query_;
+
+}; // class digest_observer
+
+} // namespace amy
+
+#endif // __AMY_DIGEST_TABLE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
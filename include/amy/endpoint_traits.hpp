@@ -15,7 +15,7 @@ struct null_endpoint {};
 template<>
 class endpoint_traits<null_endpoint> {
 public:
-    endpoint_traits<null_endpoint>(null_endpoint const&) {
+    endpoint_traits(null_endpoint const&) {
     }
 
     char const* host() const {
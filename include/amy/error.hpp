@@ -138,6 +138,9 @@ enum misc_errors {
     // Failed to rollback
     rollback_error = 7,
 
+    // Query rejected by admission control
+    busy = 8,
+
     // Unknown error
     unknown,
 
@@ -289,10 +292,11 @@ public:
             "Failed to set autocommit mode",
             "Failed to commit",
             "Failed to rollback",
+            "Too many outstanding queries",
             "Unknown error",
         };
 
-        if (value < 0 || value >= unknown_error) {
+        if (value < 0 || value > error::unknown) {
             return std::string(messages[error::unknown]);
         }
 
@@ -350,6 +354,34 @@ inline AMY_SYSTEM_NS::error_code make_error_code(misc_errors e) {
                                       get_misc_category());
 }
 
+namespace detail {
+
+/// Whether \c ec is reported by the server for a statement, rather than
+/// raised by the client library, e.g. on a lost connection.
+/**
+ * Both share the client category.  Client library errors are numbered from \c
+ * CR_MIN_ERROR to \c CR_MAX_ERROR, plus the \c CER_ range of MariaDB
+ * Connector/C; server errors are numbered below and above, from 3000 on in
+ * recent servers.
+ */
+inline bool is_server_error(AMY_SYSTEM_NS::error_code const& ec) {
+    if (ec.category() != get_client_category()) {
+        return false;
+    }
+
+    int value = ec.value();
+
+#if defined(CER_MIN_ERROR) && defined(CER_MAX_ERROR)
+    if (CER_MIN_ERROR <= value && value <= CER_MAX_ERROR) {
+        return false;
+    }
+#endif
+
+    return value < CR_MIN_ERROR || CR_MAX_ERROR < value;
+}
+
+} // namespace detail
+
 } // namespace error
 } // namespace amy
 
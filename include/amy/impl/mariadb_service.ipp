@@ -1,19 +1,116 @@
 #ifndef __AMY_IMPL_MARIADB_SERVICE_IPP__
 #define __AMY_IMPL_MARIADB_SERVICE_IPP__
 
+#include <amy/detail/handler_ptr.hpp>
 #include <amy/detail/mariadb_ops.hpp>
+#include <amy/detail/query_trace_hook.hpp>
 
 #include <amy/mariadb_options.hpp>
 #include <amy/client_flags.hpp>
 #include <amy/endpoint_traits.hpp>
 #include <amy/noop_deleter.hpp>
-#include <boost/beast/core/handler_ptr.hpp>
 #include <boost/beast/core/bind_handler.hpp>
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <boost/asio/associated_cancellation_slot.hpp>
+#endif
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+#include <boost/asio/associated_immediate_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#endif
 
 #include <functional>
+#include <string>
+#include <type_traits>
 
 namespace amy {
 
+namespace {
+// Maximum number of nested inline completions on a thread, beyond which
+// completions are posted to keep the stack depth bounded.
+const int max_immediate_depth = 8;
+
+inline int& immediate_depth() {
+  static thread_local int depth = 0;
+  return depth;
+}
+
+template <typename Handler>
+bool can_complete_inline(Handler const& handler, io_context& ioc,
+    std::true_type /* uses the io_context executor */) {
+  auto ex = ioc.get_executor();
+
+  return immediate_depth() < max_immediate_depth &&
+         ex.running_in_this_thread() &&
+         (boost::asio::get_associated_executor)(handler, ex) == ex;
+}
+
+template <typename Handler>
+bool can_complete_inline(Handler const&, io_context&, std::false_type) {
+  return false;
+}
+
+// Invokes the handler of an operation that completed without waiting for the
+// server, e.g. a small query over a fast local socket.  The handler runs
+// through its associated immediate executor when Asio provides one,
+// otherwise inline when already running on its executor, up to a bounded
+// recursion depth, and is posted in any other case.
+template <typename Handler, typename... Args>
+void complete_immediately(io_context& ioc, Handler&& handler, Args&&... args) {
+  using handler_type = typename std::decay<Handler>::type;
+
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+  auto ex = (boost::asio::get_associated_immediate_executor)(
+      handler, ioc.get_executor());
+  boost::asio::dispatch(ex, boost::beast::bind_handler(
+                                std::forward<Handler>(handler),
+                                std::forward<Args>(args)...));
+#else
+  using executor_type = boost::asio::associated_executor_t<handler_type,
+      decltype(std::declval<io_context&>().get_executor())>;
+
+  if (can_complete_inline(handler, ioc,
+          std::is_same<executor_type,
+              decltype(std::declval<io_context&>().get_executor())>())) {
+    handler_type h(std::forward<Handler>(handler));
+
+    ++immediate_depth();
+    try {
+      h(std::forward<Args>(args)...);
+    } catch (...) {
+      --immediate_depth();
+      throw;
+    }
+    --immediate_depth();
+    return;
+  }
+
+  AMY_ASIO_NS::post(ioc.get_executor(),
+      boost::beast::bind_handler(
+          std::forward<Handler>(handler), std::forward<Args>(args)...));
+#endif
+}
+
+// Completes a queued operation that failed before using the connection.
+// Operations aborted before they started are always posted, as the queue may
+// be cleared from within close(), and impl may already be gone.
+template <typename Handler, typename... Args>
+void fail_queued_operation(io_context& ioc,
+    mariadb_service::implementation& impl, bool started, Handler&& handler,
+    Args&&... args) {
+  if (!started) {
+    AMY_ASIO_NS::post(ioc.get_executor(),
+        boost::beast::bind_handler(
+            std::forward<Handler>(handler), std::forward<Args>(args)...));
+    return;
+  }
+
+  auto queue = impl.ops;
+  complete_immediately(
+      ioc, std::forward<Handler>(handler), std::forward<Args>(args)...);
+  queue->complete();
+}
+} // namespace
+
 inline mariadb_service::mariadb_service(AMY_ASIO_NS::io_service& io_service)
     : detail::service_base<mariadb_service>(io_service) {}
 
@@ -25,6 +122,8 @@ inline void mariadb_service::construct(implementation_type& impl) {
   impl.ev_ =
       std::make_unique<AMY_ASIO_NS::posix::stream_descriptor>(get_io_service());
   impl.timer_ = std::make_unique<AMY_ASIO_NS::steady_timer>(get_io_service());
+  impl.deadline_ =
+      std::make_unique<AMY_ASIO_NS::steady_timer>(get_io_service());
 }
 
 inline void mariadb_service::destroy(implementation_type& impl) { close(impl); }
@@ -89,6 +188,10 @@ AMY_SYSTEM_NS::error_code mariadb_service::connect(implementation_type& impl,
 
   impl.flags = client_flag;
 
+  if (!ec) {
+    impl.params_.assign(endpoint, auth, database, client_flag);
+  }
+
   return ec;
 }
 
@@ -97,25 +200,30 @@ BOOST_ASIO_INITFN_RESULT_TYPE(ConnectHandler, void(AMY_SYSTEM_NS::error_code))
 mariadb_service::async_connect(implementation_type& impl,
     Endpoint const& endpoint, auth_info const& auth,
     std::string const& database, client_flags flags, ConnectHandler handler) {
-  if (!is_open(impl)) {
-    AMY_SYSTEM_NS::error_code ec;
-    if (!!open(impl, ec)) {
-      AMY_ASIO_NS::post(this->get_io_service().get_executor(),
-          boost::beast::bind_handler(handler, ec));
-      return;
+  auto& ioc = this->get_io_service();
+
+  impl.ops->enqueue([this, &ioc, &impl, endpoint, auth, database, flags,
+                        handler = std::move(handler)](
+                        AMY_SYSTEM_NS::error_code ec) mutable {
+    bool started = !ec;
+
+    if (started && !is_open(impl)) {
+      open(impl, ec);
     }
-  }
 
-  AMY_SYSTEM_NS::error_code ec;
-  set_option(impl, options::nonblock_default(), ec);
-  if (ec) {
-    AMY_ASIO_NS::post(this->get_io_service().get_executor(),
-        boost::beast::bind_handler(handler, ec));
-    return;
-  }
+    if (!ec) {
+      set_option(impl, options::nonblock_default(), ec);
+    }
 
-  connect_handler<ConnectHandler, Endpoint>(this->get_io_service(), handler,
-      impl, endpoint, auth, database, flags)(ec, 0);
+    if (ec) {
+      fail_queued_operation(ioc, impl, started, std::move(handler), ec);
+      return;
+    }
+
+    connect_handler<detail::recycling_handler<ConnectHandler>, Endpoint>(ioc,
+        impl.recycle(std::move(handler)), impl, endpoint, auth, database,
+        flags)(ec, 0);
+  });
 }
 
 inline AMY_SYSTEM_NS::error_code mariadb_service::query(
@@ -138,14 +246,55 @@ template <typename QueryHandler>
 BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler, void(AMY_SYSTEM_NS::error_code))
 mariadb_service::async_query(
     implementation_type& impl, std::string const& stmt, QueryHandler handler) {
-  if (!is_open(impl)) {
-    AMY_ASIO_NS::post(this->get_io_service().get_executor(),
-        boost::beast::bind_handler(handler, amy::error::not_initialized));
-    return;
-  }
+  auto& ioc = this->get_io_service();
 
-  query_handler<QueryHandler>(this->get_io_service(), handler, impl, stmt)(
-      {}, 0);
+  impl.ops->enqueue([this, &ioc, &impl, stmt, handler = std::move(handler)](
+                        AMY_SYSTEM_NS::error_code ec) mutable {
+    bool started = !ec;
+
+    if (started && !is_open(impl)) {
+      ec = amy::error::not_initialized;
+    }
+
+    if (ec) {
+      fail_queued_operation(ioc, impl, started, std::move(handler), ec);
+      return;
+    }
+
+    query_handler<detail::recycling_handler<QueryHandler>>(
+        ioc, impl.recycle(std::move(handler)), impl, stmt)({}, 0);
+  });
+}
+
+template <typename QueryHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler, void(AMY_SYSTEM_NS::error_code))
+mariadb_service::async_query(implementation_type& impl,
+    std::string const& stmt, time_point deadline, QueryHandler handler) {
+  auto& ioc = this->get_io_service();
+
+  impl.ops->enqueue([this, &ioc, &impl, stmt, deadline,
+                        handler = std::move(handler)](
+                        AMY_SYSTEM_NS::error_code ec) mutable {
+    bool started = !ec;
+
+    if (started && !is_open(impl)) {
+      ec = amy::error::not_initialized;
+    }
+
+    // The deadline may have expired while waiting in the queue.
+    if (!ec && deadline <= AMY_ASIO_NS::steady_timer::clock_type::now()) {
+      ec = AMY_ASIO_NS::error::operation_aborted;
+    }
+
+    if (ec) {
+      fail_queued_operation(ioc, impl, started, std::move(handler), ec);
+      return;
+    }
+
+    query_handler<detail::recycling_handler<deadline_handler<QueryHandler>>>(
+        ioc, impl.recycle(arm_deadline(impl, deadline, std::move(handler))),
+        impl, stmt)({}, 0);
+  });
 }
 
 inline bool mariadb_service::has_more_results(
@@ -195,15 +344,26 @@ BOOST_ASIO_INITFN_RESULT_TYPE(
     StoreResultHandler, void(AMY_SYSTEM_NS::error_code, amy::result_set))
 mariadb_service::async_store_result(
     implementation_type& impl, StoreResultHandler handler) {
-  if (!is_open(impl)) {
-    AMY_ASIO_NS::post(this->get_io_service().get_executor(),
-        boost::beast::bind_handler(handler, amy::error::not_initialized,
-            result_set::empty_set()));
-    return;
-  }
+  auto& ioc = this->get_io_service();
+
+  impl.ops->enqueue(
+      [this, &ioc, &impl, handler = std::move(handler)](
+          AMY_SYSTEM_NS::error_code ec) mutable {
+        bool started = !ec;
 
-  store_result_handler<StoreResultHandler>(
-      this->get_io_service(), handler, impl)({}, 0);
+        if (started && !is_open(impl)) {
+          ec = amy::error::not_initialized;
+        }
+
+        if (ec) {
+          fail_queued_operation(ioc, impl, started, std::move(handler), ec,
+              result_set::empty_set());
+          return;
+        }
+
+        store_result_handler<detail::recycling_handler<StoreResultHandler>>(
+            ioc, impl.recycle(std::move(handler)), impl)({}, 0);
+      });
 }
 
 template <typename Handler>
@@ -211,15 +371,147 @@ BOOST_ASIO_INITFN_RESULT_TYPE(
     Handler, void(AMY_SYSTEM_NS::error_code, amy::result_set))
 mariadb_service::async_query_result(
     implementation_type& impl, std::string const& stmt, Handler handler) {
-  if (!is_open(impl)) {
-    AMY_ASIO_NS::post(this->get_io_service().get_executor(),
-        boost::beast::bind_handler(handler, amy::error::not_initialized,
-            result_set::empty_set()));
+  auto& ioc = this->get_io_service();
+
+  impl.ops->enqueue([this, &ioc, &impl, stmt, handler = std::move(handler)](
+                        AMY_SYSTEM_NS::error_code ec) mutable {
+    bool started = !ec;
+
+    if (started && !is_open(impl)) {
+      ec = amy::error::not_initialized;
+    }
+
+    if (ec) {
+      fail_queued_operation(ioc, impl, started, std::move(handler), ec,
+          result_set::empty_set());
+      return;
+    }
+
+    query_result_handler<detail::recycling_handler<Handler>>(
+        ioc, impl.recycle(std::move(handler)), impl, stmt)({}, 0);
+  });
+}
+
+template <typename Handler>
+BOOST_ASIO_INITFN_RESULT_TYPE(
+    Handler, void(AMY_SYSTEM_NS::error_code, amy::result_set))
+mariadb_service::async_query_result(implementation_type& impl,
+    std::string const& stmt, time_point deadline, Handler handler) {
+  auto& ioc = this->get_io_service();
+
+  impl.ops->enqueue([this, &ioc, &impl, stmt, deadline,
+                        handler = std::move(handler)](
+                        AMY_SYSTEM_NS::error_code ec) mutable {
+    bool started = !ec;
+
+    if (started && !is_open(impl)) {
+      ec = amy::error::not_initialized;
+    }
+
+    if (!ec && deadline <= AMY_ASIO_NS::steady_timer::clock_type::now()) {
+      ec = AMY_ASIO_NS::error::operation_aborted;
+    }
+
+    if (ec) {
+      fail_queued_operation(ioc, impl, started, std::move(handler), ec,
+          result_set::empty_set());
+      return;
+    }
+
+    query_result_handler<detail::recycling_handler<deadline_handler<Handler>>>(
+        ioc, impl.recycle(arm_deadline(impl, deadline, std::move(handler))),
+        impl, stmt)({}, 0);
+  });
+}
+
+template <typename KillHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(KillHandler, void(AMY_SYSTEM_NS::error_code))
+mariadb_service::async_kill_query(
+    implementation_type& impl, KillHandler handler) {
+  namespace ops = amy::detail::mysql_ops;
+
+  auto& ioc = this->get_io_service();
+
+  if (!is_open(impl) || impl.params_.empty()) {
+    complete_immediately(
+        ioc, std::move(handler), AMY_SYSTEM_NS::error_code(
+                                     amy::error::not_initialized));
     return;
   }
 
-  query_result_handler<Handler>(this->get_io_service(), handler, impl, stmt)(
-      {}, 0);
+  // The side connection must not go through the queue of \c impl, whose
+  // running operation is the one to be killed.
+  std::string stmt =
+      "KILL QUERY " + std::to_string(ops::mysql_thread_id(&impl.mysql));
+
+  auto side = std::make_shared<implementation_type>();
+  construct(*side);
+
+  detail::connect_params const& params = impl.params_;
+
+  async_connect(*side, params, params.auth(), params.database(),
+      amy::default_flags,
+      [this, side, stmt, handler = std::move(handler)](
+          AMY_SYSTEM_NS::error_code ec) mutable {
+        if (ec) {
+          handler(ec);
+          return;
+        }
+
+        async_query(*side, stmt,
+            [side, handler = std::move(handler)](
+                AMY_SYSTEM_NS::error_code ec) mutable {
+              handler(ec);
+            });
+      });
+}
+
+template <typename Handler>
+mariadb_service::deadline_handler<Handler> mariadb_service::arm_deadline(
+    implementation_type& impl, time_point deadline, Handler handler) {
+  // Only called by the running operation, so that handing out IDs needs no
+  // synchronization.
+  uint64_t id = ++impl.last_deadline_id_;
+  impl.deadline_id_ = id;
+
+  std::weak_ptr<void> token(impl.cancelation_token);
+
+  impl.deadline_->expires_at(deadline);
+  impl.deadline_->async_wait(
+      [this, &impl, token, id](AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec || token.expired() || impl.deadline_id_ != id) {
+          return;
+        }
+
+        // Recorded before claiming the deadline, so that the handler sees it
+        // whenever its own claim fails.  IDs only grow, which keeps a late
+        // timer from hiding the expiry of a later operation.
+        uint64_t expired = impl.deadline_expired_id_;
+        while (expired < id &&
+               !impl.deadline_expired_id_.compare_exchange_weak(
+                   expired, id)) {
+        }
+
+        // The handler claims the deadline too once the operation completes,
+        // and only the winner gets to act on it.
+        uint64_t armed = id;
+        if (!impl.deadline_id_.compare_exchange_strong(armed, 0)) {
+          return;
+        }
+
+        // Keeps the next operation from starting before the kill went
+        // through, otherwise it might be killed instead.
+        auto queue = impl.ops;
+        queue->hold();
+
+        async_kill_query(
+            impl, [queue](AMY_SYSTEM_NS::error_code const&) {
+              queue->release();
+            });
+      });
+
+  return deadline_handler<Handler>(
+      this->get_io_service(), impl, id, std::move(handler));
 }
 
 inline AMY_SYSTEM_NS::error_code mariadb_service::autocommit(
@@ -261,7 +553,10 @@ inline uint64_t mariadb_service::affected_rows(implementation_type& impl) {
 
 inline mariadb_service::implementation::implementation()
     : flags(amy::default_flags), initialized(false), first_result_stored(false),
-      cancelation_token(static_cast<void*>(nullptr), noop_deleter()) {}
+      cancelation_token(static_cast<void*>(nullptr), noop_deleter()),
+      wait_generation_(0), wait_events_(0), wait_secondary_(0),
+      deadline_id_(0), deadline_expired_id_(0), last_deadline_id_(0),
+      ops(std::make_shared<detail::op_queue>()) {}
 
 inline mariadb_service::implementation::~implementation() { close(); }
 
@@ -273,10 +568,13 @@ inline void mariadb_service::implementation::close() {
 
   ev_->release();
   if (timer_) timer_->cancel();
+  if (deadline_) deadline_->cancel();
 
   this->first_result_stored = false;
 
   cancel();
+
+  ops->clear();
 }
 
 template <typename Option>
@@ -297,53 +595,261 @@ inline void mariadb_service::cancel(implementation_type& impl) {
   impl.cancel();
 }
 
+template <typename Handler>
+detail::recycling_handler<typename std::decay<Handler>::type>
+mariadb_service::implementation::recycle(Handler&& handler) const {
+  // Shares the ownership of the queue owning the pool.
+  std::shared_ptr<detail::recycling_pool> pool(ops, &ops->pool());
+
+  return detail::recycling_handler<typename std::decay<Handler>::type>(
+      std::forward<Handler>(handler), std::move(pool));
+}
+
 inline void mariadb_service::implementation::cancel() {
   this->cancelation_token.reset(static_cast<void*>(nullptr), noop_deleter());
+
+  // Wakes up the running operation right away instead of on the next socket
+  // event, the operation then completes with operation_aborted.
+  if (ev_ && ev_->native_handle() != -1) ev_->cancel();
+  if (timer_) timer_->cancel();
 }
 
 namespace {
+// Resumes the operation waiting for the events requested by the client
+// library.  The first requested wait carries the operation, the others are
+// secondary waits which only record their event and wake it up.  On
+// completion, the remaining secondary waits are canceled and the operation
+// is resumed with all the events that occurred.
+template <typename Handler>
+class primary_wait_handler {
+public:
+  primary_wait_handler(Handler&& handler, mariadb_service::implementation& impl,
+      int event)
+      : handler_(std::move(handler)), impl_(&impl),
+        cancelation_token_(impl.cancelation_token), event_(event) {}
+
+  using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+  allocator_type get_allocator() const noexcept {
+    return (boost::asio::get_associated_allocator)(handler_);
+  }
+
+  using executor_type = boost::asio::associated_executor_t<Handler>;
+
+  executor_type get_executor() const noexcept {
+    return (boost::asio::get_associated_executor)(handler_);
+  }
+
+  // Waits are always intermediate steps of the composed operation.
+  friend bool asio_handler_is_continuation(primary_wait_handler*) {
+    return true;
+  }
+
+  void operator()(AMY_SYSTEM_NS::error_code ec) {
+    int events = ec ? 0 : event_;
+
+    if (!cancelation_token_.expired()) {
+      auto& impl = *impl_;
+
+      // Makes pending secondary waits stale before canceling them.
+      ++impl.wait_generation_;
+      events |= impl.wait_events_;
+
+      namespace ops = amy::detail::mysql_ops;
+      if (impl.wait_secondary_ & ops::wait_type::read_or_write)
+        impl.ev_->cancel();
+      if (impl.wait_secondary_ & ops::wait_type::timeout) impl.timer_->cancel();
+
+      impl.wait_events_    = 0;
+      impl.wait_secondary_ = 0;
+    }
+
+    if (events) {
+      handler_(AMY_SYSTEM_NS::error_code(), events);
+    } else {
+      handler_(ec, 0);
+    }
+  }
+
+private:
+  Handler handler_;
+  mariadb_service::implementation* impl_;
+  std::weak_ptr<void> cancelation_token_;
+  int event_;
+};
+
+class secondary_wait_handler {
+public:
+  secondary_wait_handler(mariadb_service::implementation& impl, int event)
+      : impl_(&impl), cancelation_token_(impl.cancelation_token),
+        generation_(impl.wait_generation_), event_(event) {}
+
+  void operator()(AMY_SYSTEM_NS::error_code const& ec) {
+    if (ec || cancelation_token_.expired() ||
+        impl_->wait_generation_ != generation_)
+      return;
+
+    impl_->wait_events_ |= event_;
+
+    // Wakes up the primary wait, which always waits on the descriptor when
+    // there are secondary waits.
+    impl_->ev_->cancel();
+  }
+
+private:
+  mariadb_service::implementation* impl_;
+  std::weak_ptr<void> cancelation_token_;
+  uint64_t generation_;
+  int event_;
+};
+
 template <typename T1, typename T2>
 void async_wait_mysql(int& status, T1& p, T2& self) {
   namespace ops = amy::detail::mysql_ops;
 
-  auto& ev = *p.impl_.ev_;
+  auto& impl = p.impl_;
+  auto& ev   = *impl.ev_;
+
+  p.continuation_ = true;
+
   if (status & ops::wait_type::read_or_write) {
-    int fd = ops::mysql_get_socket(&p.impl_.mysql);
+    // The socket only changes when connecting, which releases the previous
+    // one, otherwise the descriptor stays registered with the reactor until
+    // the connection is closed.
+    int fd = ops::mysql_get_socket(&impl.mysql);
     if (ev.native_handle() != fd) {
       ev.release();
       ev.assign(fd);
     }
   }
 
-  if (p.impl_.timer_) p.impl_.timer_->cancel();
-  if (ev.native_handle() != -1) ev.cancel();
+  // Exceptional conditions are reported as the socket being readable.
+  int requested = status & (ops::wait_type::read_or_write |
+                               ops::wait_type::timeout);
+  if (status & ops::wait_type::except) requested |= ops::wait_type::read;
+
+  int primary = (requested & ops::wait_type::read)
+                    ? ops::wait_type::read
+                    : (requested & ops::wait_type::write)
+                          ? ops::wait_type::write
+                          : ops::wait_type::timeout;
+
+  ++impl.wait_generation_;
+  impl.wait_events_    = 0;
+  impl.wait_secondary_ = requested & ~primary;
 
   using AMY_ASIO_NS::posix::descriptor_base;
-  using namespace std::placeholders;
-  if (status & ops::wait_type::read) {
-    ev.async_wait(descriptor_base::wait_read,
-        boost::beast::bind_handler(std::move(self), _1, ops::wait_type::read));
-    return;
-  }
-  if (status & ops::wait_type::write) {
+
+  if (impl.wait_secondary_ & ops::wait_type::write) {
     ev.async_wait(descriptor_base::wait_write,
-        boost::beast::bind_handler(std::move(self), _1, ops::wait_type::write));
-    return;
+        impl.recycle(secondary_wait_handler(impl, ops::wait_type::write)));
   }
-  if (status & ops::wait_type::timeout) {
-    auto& impl = p.impl_;
+
+  // The timer is only touched when the client library asks for a timeout.
+  if (requested & ops::wait_type::timeout) {
     if (!impl.timer_)
       impl.timer_ = std::make_unique<AMY_ASIO_NS::steady_timer>(p.ioc_);
 
-    auto timeout = ops::mysql_get_timeout_value(&impl.mysql);
+    impl.timer_->expires_after(ops::mysql_get_timeout_value(&impl.mysql));
+  }
 
-    auto& timer = *impl.timer_;
-    timer.expires_after(timeout);
-    timer.async_wait(boost::beast::bind_handler(
-        std::move(self), _1, ops::wait_type::timeout));
-    return;
+  if (impl.wait_secondary_ & ops::wait_type::timeout) {
+    impl.timer_->async_wait(
+        impl.recycle(secondary_wait_handler(impl, ops::wait_type::timeout)));
   }
-};
+
+  primary_wait_handler<T2> handler(std::move(self), impl, primary);
+
+  switch (primary) {
+  case ops::wait_type::read:
+    ev.async_wait(descriptor_base::wait_read, std::move(handler));
+    break;
+  case ops::wait_type::write:
+    ev.async_wait(descriptor_base::wait_write, std::move(handler));
+    break;
+  default: impl.timer_->async_wait(std::move(handler)); break;
+  }
+}
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+// Cancels the running operation of impl on terminal cancellation requests
+// emitted through the slot associated with handler.  Only terminal
+// cancellation is supported, as the connection is left in an unspecified
+// state and must be closed.
+template <typename Handler>
+void connect_cancellation_slot(
+    Handler const& handler, mariadb_service::implementation& impl) {
+  auto slot = boost::asio::get_associated_cancellation_slot(handler);
+
+  if (!slot.is_connected()) return;
+
+  auto* pimpl = &impl;
+  std::weak_ptr<void> token(impl.cancelation_token);
+
+  slot.assign([pimpl, token](boost::asio::cancellation_type type) {
+    if ((type & boost::asio::cancellation_type::terminal) !=
+            boost::asio::cancellation_type::none &&
+        !token.expired())
+      pimpl->cancel();
+  });
+}
+
+// Kills the statement of the running query operation of impl on terminal
+// cancellation requests, like an expired deadline does, so that the
+// connection stays usable.  killed records the request, the operation then
+// completes with operation_aborted.
+template <typename Handler>
+void connect_kill_slot(Handler const& handler, mariadb_service& service,
+    mariadb_service::implementation& impl, bool& killed) {
+  auto slot = boost::asio::get_associated_cancellation_slot(handler);
+
+  if (!slot.is_connected()) return;
+
+  auto* pservice = &service;
+  auto* pimpl    = &impl;
+  auto* pkilled  = &killed;
+  std::weak_ptr<void> token(impl.cancelation_token);
+
+  slot.assign([pservice, pimpl, pkilled, token](
+                  boost::asio::cancellation_type type) {
+    if ((type & boost::asio::cancellation_type::terminal) ==
+            boost::asio::cancellation_type::none ||
+        token.expired() || *pkilled)
+      return;
+
+    *pkilled = true;
+
+    // Keeps the next operation from starting before the kill went through,
+    // otherwise it might be killed instead.
+    auto queue = pimpl->ops;
+    queue->hold();
+
+    pservice->async_kill_query(
+        *pimpl, [queue](AMY_SYSTEM_NS::error_code const&) {
+          queue->release();
+        });
+  });
+}
+
+// Must be called before invoking the final handler.
+template <typename Handler>
+void disconnect_cancellation_slot(Handler const& handler) {
+  auto slot = boost::asio::get_associated_cancellation_slot(handler);
+
+  if (slot.is_connected()) slot.clear();
+}
+#else
+template <typename Handler>
+void connect_cancellation_slot(
+    Handler const&, mariadb_service::implementation&) {}
+
+template <typename Handler>
+void connect_kill_slot(Handler const&, mariadb_service&,
+    mariadb_service::implementation&, bool&) {}
+
+template <typename Handler>
+void disconnect_cancellation_slot(Handler const&) {}
+#endif
 } // namespace
 
 // This composed operation mysql_real_connect_[start|cont]
@@ -366,9 +872,16 @@ class mariadb_service::connect_handler {
     // to perform next, starting from zero.
     int step = 0;
 
+    // Whether the operation waited for the server at least once.
+    bool continuation_ = false;
+
     implementation_type& impl_;
     std::weak_ptr<void> cancelation_token_{impl_.cancelation_token};
 
+    // Kept apart from impl_, which may be gone once the operation is
+    // canceled.
+    std::shared_ptr<detail::op_queue> queue_{impl_.ops};
+
     Endpoint endpoint_;
     amy::auth_info auth_;
     std::string database_;
@@ -387,23 +900,21 @@ class mariadb_service::connect_handler {
     }
   };
 
-  // The operation's data is kept in a cheap-to-copy smart
-  // pointer container called `handler_ptr`. This efficiently
-  // satisfies the CopyConstructible requirements of completion
-  // handlers with expensive-to-copy state.
+  // The operation's data is kept in a move-only smart pointer
+  // container called `handler_ptr`, together with the final
+  // completion handler.
   //
   // `handler_ptr` uses the allocator associated with the final
   // completion handler, in order to allocate the storage for `state`.
   //
-  boost::beast::handler_ptr<state, Handler> p_;
+  detail::handler_ptr<state, Handler> p_;
 
 public:
-  // Boost.Asio requires that handlers are CopyConstructible.
-  // In some cases, it takes advantage of handlers that are
-  // MoveConstructible. This operation supports both.
+  // Boost.Asio requires that handlers are MoveConstructible, which
+  // also allows move-only final handlers, e.g. the ones created by
+  // `use_awaitable`.
   //
-  connect_handler(connect_handler&&)      = default;
-  connect_handler(connect_handler const&) = default;
+  connect_handler(connect_handler&&) = default;
 
   // The constructor simply creates our state variables in
   // the smart pointer container.
@@ -459,6 +970,11 @@ public:
     switch (ec ? 2 : p.step) {
     // initial entry
     case 0: {
+      connect_cancellation_slot(p_.handler(), p.impl_);
+
+      // When reconnecting, the old socket is closed, which silently dropped
+      // it from the reactor, and the new one likely reuses its descriptor.
+      p.impl_.ev_->release();
 
       amy::endpoint_traits<Endpoint> traits(p.endpoint_);
 
@@ -483,6 +999,11 @@ public:
 
     case 2: break;
     }
+
+    if (!ec) {
+      p.impl_.params_.assign(p.endpoint_, p.auth_, p.database_, p.flags_);
+    }
+
     // Invoke the final handler. The implementation of `handler_ptr`
     // will deallocate the storage for the state before the handler
     // is invoked. This is necessary to provide the
@@ -497,7 +1018,15 @@ public:
     // be destroyed before the handler is invoked.
     //
     auto work = std::move(p.work);
-    p_.invoke(ec);
+    auto queue = std::move(p.queue_);
+    disconnect_cancellation_slot(p_.handler());
+    if (p.continuation_) {
+      p_.invoke(ec);
+    } else {
+      auto& ioc = p.ioc_;
+      complete_immediately(ioc, p_.release(), ec);
+    }
+    queue->complete();
     return;
   }
 };
@@ -514,22 +1043,32 @@ class mariadb_service::query_handler {
 
     int step = 0;
 
+    // Whether the operation waited for the server at least once.
+    bool continuation_ = false;
+
     implementation_type& impl_;
     std::weak_ptr<void> cancelation_token_{impl_.cancelation_token};
 
-    std::string stmt_;
+    // Kept apart from impl_, which may be gone once the operation is
+    // canceled.
+    std::shared_ptr<detail::op_queue> queue_{impl_.ops};
+
+    detail::string stmt_;
     int result_ = -1;
 
+    // Whether a cancellation request killed the statement.
+    bool killed_ = false;
+
     explicit state(Handler const&, io_context& ioc, implementation_type& impl,
         std::string const& stmt)
-        : ioc_(ioc), work(ioc_.get_executor()), impl_(impl), stmt_(stmt) {}
+        : ioc_(ioc), work(ioc_.get_executor()), impl_(impl),
+          stmt_(stmt.data(), stmt.size()) {}
   };
 
-  boost::beast::handler_ptr<state, Handler> p_;
+  detail::handler_ptr<state, Handler> p_;
 
 public:
-  query_handler(query_handler&&)      = default;
-  query_handler(query_handler const&) = default;
+  query_handler(query_handler&&) = default;
 
   template <class DeducedHandler>
   query_handler(io_context& ioc, DeducedHandler&& handler,
@@ -557,12 +1096,21 @@ public:
     if (p.cancelation_token_.expired())
       ec = AMY_ASIO_NS::error::operation_aborted;
 
+    query_trace* trace = amy::detail::query_trace_of(p_.handler());
+    amy::detail::query_allocation_scope allocations(trace);
+
     switch (ec ? 2 : p.step) {
     case 0: {
+      connect_kill_slot(p_.handler(),
+          AMY_ASIO_NS::use_service<mariadb_service>(p.ioc_), p.impl_,
+          p.killed_);
+      amy::detail::mark_phase(trace, query_trace::queue);
+
       p.impl_.first_result_stored = false;
 
       status = ops::mysql_real_query_start(
           &p.result_, &p.impl_.mysql, p.stmt_.c_str(), p.stmt_.size(), ec);
+      amy::detail::mark_phase(trace, query_trace::send);
 
     } /* FALLTHRU */
     case 1: {
@@ -572,7 +1120,10 @@ public:
 
       p.step = 1;
 
-      if (status == ops::wait_type::finish || ec) break;
+      if (status == ops::wait_type::finish || ec) {
+        amy::detail::mark_phase(trace, query_trace::first_byte);
+        break;
+      }
 
       async_wait_mysql(status, p, *this);
       return;
@@ -580,8 +1131,21 @@ public:
 
     case 2: break;
     }
+
+    // A killed statement does not necessarily fail, e.g. SLEEP() just
+    // returns early.
+    if (p.killed_) ec = AMY_ASIO_NS::error::operation_aborted;
+
     auto work = std::move(p.work);
-    p_.invoke(ec);
+    auto queue = std::move(p.queue_);
+    disconnect_cancellation_slot(p_.handler());
+    if (p.continuation_) {
+      p_.invoke(ec);
+    } else {
+      auto& ioc = p.ioc_;
+      complete_immediately(ioc, p_.release(), ec);
+    }
+    queue->complete();
     return;
   }
 };
@@ -598,9 +1162,16 @@ class mariadb_service::store_result_handler {
 
     int step = 0;
 
+    // Whether the operation waited for the server at least once.
+    bool continuation_ = false;
+
     implementation_type& impl_;
     std::weak_ptr<void> cancelation_token_{impl_.cancelation_token};
 
+    // Kept apart from impl_, which may be gone once the operation is
+    // canceled.
+    std::shared_ptr<detail::op_queue> queue_{impl_.ops};
+
     int next_result_                 = -1;
     detail::result_set_type* result_ = nullptr;
 
@@ -608,11 +1179,10 @@ class mariadb_service::store_result_handler {
         : ioc_(ioc), work(ioc_.get_executor()), impl_(impl) {}
   };
 
-  boost::beast::handler_ptr<state, Handler> p_;
+  detail::handler_ptr<state, Handler> p_;
 
 public:
-  store_result_handler(store_result_handler&&)      = default;
-  store_result_handler(store_result_handler const&) = default;
+  store_result_handler(store_result_handler&&) = default;
 
   template <class DeducedHandler>
   store_result_handler(
@@ -653,6 +1223,7 @@ public:
       };
       switch (ec ? S_ERROR : p.step) {
       case S_ENTRY: {
+        connect_cancellation_slot(p_.handler(), p.impl_);
 
         if (p.impl_.first_result_stored) {
           mariadb_service& service =
@@ -724,7 +1295,15 @@ public:
         // error code and an empty result set.
         rs = result_set::empty_set();
       }
-      p_.invoke(ec, rs);
+      auto queue = std::move(p.queue_);
+      disconnect_cancellation_slot(p_.handler());
+      if (p.continuation_) {
+        p_.invoke(ec, rs);
+      } else {
+        auto& ioc = p.ioc_;
+        complete_immediately(ioc, p_.release(), ec, std::move(rs));
+      }
+      queue->complete();
       return;
     } // for(;;)
   }
@@ -742,23 +1321,33 @@ class mariadb_service::query_result_handler {
 
     int step = 0;
 
+    // Whether the operation waited for the server at least once.
+    bool continuation_ = false;
+
     implementation_type& impl_;
     std::weak_ptr<void> cancelation_token_{impl_.cancelation_token};
 
-    std::string stmt_;
+    // Kept apart from impl_, which may be gone once the operation is
+    // canceled.
+    std::shared_ptr<detail::op_queue> queue_{impl_.ops};
+
+    detail::string stmt_;
     int query_result_                = -1;
     detail::result_set_type* result_ = nullptr;
 
+    // Whether a cancellation request killed the statement.
+    bool killed_ = false;
+
     explicit state(Handler const&, io_context& ioc, implementation_type& impl,
         std::string const& stmt)
-        : ioc_(ioc), work(ioc_.get_executor()), impl_(impl), stmt_(stmt) {}
+        : ioc_(ioc), work(ioc_.get_executor()), impl_(impl),
+          stmt_(stmt.data(), stmt.size()) {}
   };
 
-  boost::beast::handler_ptr<state, Handler> p_;
+  detail::handler_ptr<state, Handler> p_;
 
 public:
-  query_result_handler(query_result_handler&&)      = default;
-  query_result_handler(query_result_handler const&) = default;
+  query_result_handler(query_result_handler&&) = default;
 
   template <class DeducedHandler>
   query_result_handler(io_context& ioc, DeducedHandler&& handler,
@@ -780,11 +1369,13 @@ public:
 
   void operator()(boost::beast::error_code ec, int status) {
     auto& p = *p_;
-    auto rs = result_set::empty_set();
 
     using namespace amy::error;
     namespace ops = amy::detail::mysql_ops;
 
+    query_trace* trace = amy::detail::query_trace_of(p_.handler());
+    amy::detail::query_allocation_scope allocations(trace);
+
     for (;;) {
       if (p.cancelation_token_.expired())
         ec = AMY_ASIO_NS::error::operation_aborted;
@@ -798,15 +1389,22 @@ public:
       };
       switch (ec ? S_ERROR : p.step) {
       case S_ENTRY: {
+        connect_kill_slot(p_.handler(),
+            AMY_ASIO_NS::use_service<mariadb_service>(p.ioc_), p.impl_,
+            p.killed_);
+        amy::detail::mark_phase(trace, query_trace::queue);
+
         p.impl_.first_result_stored = false;
 
         status = ops::mysql_real_query_start(&p.query_result_, &p.impl_.mysql,
             p.stmt_.c_str(), p.stmt_.size(), ec);
+        amy::detail::mark_phase(trace, query_trace::send);
         if (ec) break;
         if (status != ops::wait_type::finish) {
           p.step = S_WAIT_QUERY;
           continue;
         }
+        amy::detail::mark_phase(trace, query_trace::first_byte);
         p.step = S_STORE_START;
       } /* FALLTHRU */
       case S_STORE_START: {
@@ -834,6 +1432,7 @@ public:
 
         if (status == ops::wait_type::finish) {
           if (p.step == S_CONT_QUERY) {
+            amy::detail::mark_phase(trace, query_trace::first_byte);
             p.step = S_STORE_START;
             continue; // goto mysql_store_result_start
           }
@@ -852,19 +1451,108 @@ public:
 
       result_set rs;
       if (!ec) {
+        amy::detail::mark_phase(trace, query_trace::transfer);
+
         // Retrieves the next result set.
         rs.assign(&p.impl_.mysql, ec);
-      } else {
+        amy::detail::mark_phase(trace, query_trace::decode);
+      }
+
+      // The result of a killed statement, if any, is stored and dropped.
+      if (p.killed_) ec = AMY_ASIO_NS::error::operation_aborted;
+
+      if (ec) {
         // If anything went wrong, invokes the user-defined handler with the
         // error code and an empty result set.
         rs = result_set::empty_set();
       }
-      p_.invoke(ec, rs);
+      auto queue = std::move(p.queue_);
+      disconnect_cancellation_slot(p_.handler());
+      if (p.continuation_) {
+        p_.invoke(ec, rs);
+      } else {
+        auto& ioc = p.ioc_;
+        complete_immediately(ioc, p_.release(), ec, std::move(rs));
+      }
+      queue->complete();
       return;
     } // for(;;)
   }
 };
 
+// Completion handler wrapper of operations with a deadline
+template <class Handler>
+class mariadb_service::deadline_handler {
+  io_context* ioc_;
+  implementation_type* impl_;
+  std::weak_ptr<void> cancelation_token_;
+  uint64_t id_;
+  Handler handler_;
+
+public:
+  deadline_handler(io_context& ioc, implementation_type& impl, uint64_t id,
+      Handler handler)
+      : ioc_(&ioc), impl_(&impl), cancelation_token_(impl.cancelation_token),
+        id_(id), handler_(std::move(handler)) {}
+
+  using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+  allocator_type get_allocator() const noexcept {
+    return (boost::asio::get_associated_allocator)(handler_);
+  }
+
+  using executor_type = boost::asio::associated_executor_t<Handler,
+      decltype(std::declval<io_context&>().get_executor())>;
+
+  executor_type get_executor() const noexcept {
+    return (boost::asio::get_associated_executor)(
+        handler_, ioc_->get_executor());
+  }
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+  using cancellation_slot_type =
+      boost::asio::associated_cancellation_slot_t<Handler>;
+
+  cancellation_slot_type get_cancellation_slot() const noexcept {
+    return (boost::asio::get_associated_cancellation_slot)(handler_);
+  }
+#endif
+
+#if defined(AMY_ASIO_HAS_IMMEDIATE_EXECUTOR)
+  using immediate_executor_type =
+      boost::asio::associated_immediate_executor_t<Handler,
+          decltype(std::declval<io_context&>().get_executor())>;
+
+  immediate_executor_type get_immediate_executor() const noexcept {
+    return (boost::asio::get_associated_immediate_executor)(
+        handler_, ioc_->get_executor());
+  }
+#endif
+
+  friend query_trace* get_query_trace(deadline_handler const& h) noexcept {
+    return amy::detail::query_trace_of(h.handler_);
+  }
+
+  template <typename... Args>
+  void operator()(AMY_SYSTEM_NS::error_code ec, Args&&... args) {
+    // A canceled operation may have outlived the implementation.
+    if (!cancelation_token_.expired()) {
+      uint64_t id = id_;
+
+      if (impl_->deadline_id_.compare_exchange_strong(id, 0)) {
+        impl_->deadline_->cancel();
+      } else if (impl_->deadline_expired_id_ == id_) {
+        // The timer claimed the deadline first and kills the statement.  A
+        // killed statement does not necessarily fail, e.g. SLEEP() just
+        // returns early.
+        ec = AMY_ASIO_NS::error::operation_aborted;
+      }
+    }
+
+    handler_(ec, std::forward<Args>(args)...);
+  }
+};
+
 } // namespace amy
 
 #endif // __AMY_IMPL_MARIADB_SERVICE_IPP__
@@ -2,6 +2,7 @@
 #define __AMY_IMPL_MYSQL_SERVICE_IPP__
 
 #include <amy/detail/mysql_ops.hpp>
+#include <amy/detail/query_trace_hook.hpp>
 
 #include <amy/client_flags.hpp>
 #include <amy/endpoint_traits.hpp>
@@ -390,6 +391,30 @@ mysql_service::handler_base<Handler>::handler_base(
     handler_(handler)
 {}
 
+template<typename Handler>
+void mysql_service::handler_base<Handler>::real_query(
+        detail::string const& stmt,
+        AMY_SYSTEM_NS::error_code& ec)
+{
+    namespace ops = amy::detail::mysql_ops;
+
+    query_trace* trace = amy::detail::query_trace_of(handler_);
+
+    if (!trace) {
+        ops::mysql_real_query(&impl_.mysql, stmt.c_str(), stmt.length(), ec);
+        return;
+    }
+
+    // Same as mysql_real_query(), split to tell sending from waiting.
+    ops::mysql_send_query(&impl_.mysql, stmt.c_str(), stmt.length(), ec);
+    trace->mark(query_trace::send);
+
+    if (!ec) {
+        ops::mysql_read_query_result(&impl_.mysql, ec);
+        trace->mark(query_trace::first_byte);
+    }
+}
+
 template<typename Endpoint, typename ConnectHandler>
 mysql_service::connect_handler<Endpoint, ConnectHandler>::connect_handler(
         implementation_type& impl,
@@ -442,7 +467,7 @@ mysql_service::query_handler<QueryHandler>::query_handler(
         AMY_ASIO_NS::io_service& io_service,
         QueryHandler handler)
   : handler_base<QueryHandler>(impl, io_service, handler),
-    stmt_(stmt)
+    stmt_(stmt.data(), stmt.size())
 {}
 
 template<typename QueryHandler>
@@ -457,13 +482,14 @@ void mysql_service::query_handler<QueryHandler>::operator()() {
         return;
     }
 
+    query_trace* trace = amy::detail::query_trace_of(this->handler_);
+    amy::detail::query_allocation_scope allocations(trace);
+    amy::detail::mark_phase(trace, query_trace::queue);
+
     this->impl_.first_result_stored = false;
 
     AMY_SYSTEM_NS::error_code ec;
-    ops::mysql_real_query(&this->impl_.mysql,
-                          stmt_.c_str(),
-                          stmt_.length(),
-                          ec);
+    this->real_query(stmt_, ec);
 
     this->io_service_.post(std::bind(this->handler_, ec));
 }
@@ -593,7 +619,7 @@ mysql_service::query_result_handler<QueryResultHandler>::query_result_handler(
         AMY_ASIO_NS::io_service& io_service,
         QueryResultHandler handler)
   : handler_base<QueryResultHandler>(impl, io_service, handler),
-    stmt_(stmt)
+    stmt_(stmt.data(), stmt.size())
 {}
 
 template<typename QueryResultHandler>
@@ -609,13 +635,14 @@ void mysql_service::query_result_handler<QueryResultHandler>::operator()() {
         return;
     }
 
+    query_trace* trace = amy::detail::query_trace_of(this->handler_);
+    amy::detail::query_allocation_scope allocations(trace);
+    amy::detail::mark_phase(trace, query_trace::queue);
+
     this->impl_.first_result_stored = false;
 
     AMY_SYSTEM_NS::error_code ec;
-    ops::mysql_real_query(&this->impl_.mysql,
-                          stmt_.c_str(),
-                          stmt_.length(),
-                          ec);
+    this->real_query(stmt_, ec);
 
     if (ec) {
         // If anything went wrong, invokes the user-defined handler with the
@@ -628,7 +655,9 @@ void mysql_service::query_result_handler<QueryResultHandler>::operator()() {
     }
 
 	result_set rs;
-	rs.assign(&this->impl_.mysql, ec);
+	rs.assign(&this->impl_.mysql, ec,
+	          amy::detail::query_phase_marker(trace, query_trace::transfer));
+	amy::detail::mark_phase(trace, query_trace::decode);
 
 	this->io_service_.post(std::bind(this->handler_, ec, rs));
 }
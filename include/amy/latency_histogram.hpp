@@ -0,0 +1,204 @@
+#ifndef __AMY_LATENCY_HISTOGRAM_HPP__
+#define __AMY_LATENCY_HISTOGRAM_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace amy {
+
+/// Log-linear bucketing of nanosecond values, shared by \c latency_histogram
+/// and its snapshots.
+/**
+ * Values below <tt>2 * sub_buckets</tt> have a bucket each.  Above, every
+ * power of two is split into \c sub_buckets buckets of equal width, so that
+ * a bucket is never wider than 1/16 of its values, up to \c max_value.
+ * Larger values are counted in the last bucket.
+ */
+struct histogram_buckets {
+    static const int sub_bucket_bits = 4;
+
+    static const uint64_t sub_buckets = 1u << sub_bucket_bits;
+
+    static const uint64_t max_value = (uint64_t(1) << 40) - 1u;
+
+    static const std::size_t count =
+        2u * sub_buckets + (40 - sub_bucket_bits - 1) * sub_buckets;
+
+    static std::size_t index(uint64_t value) {
+        if (value > max_value) {
+            value = max_value;
+        }
+
+        if (value < 2u * sub_buckets) {
+            return static_cast<std::size_t>(value);
+        }
+
+        int shift = floor_log2(value) - sub_bucket_bits;
+
+        return static_cast<std::size_t>(
+                2u * sub_buckets + (shift - 1) * sub_buckets +
+                ((value >> shift) - sub_buckets));
+    }
+
+    /// The smallest value counted in bucket \p i.
+    static uint64_t lower_bound(std::size_t i) {
+        if (i < 2u * sub_buckets) {
+            return i;
+        }
+
+        std::size_t k = i - 2u * sub_buckets;
+        int shift = static_cast<int>(k / sub_buckets) + 1;
+        return (sub_buckets + k % sub_buckets) << shift;
+    }
+
+    /// The largest value counted in bucket \p i.
+    static uint64_t upper_bound(std::size_t i) {
+        return i + 1u < count ? lower_bound(i + 1u) - 1u : max_value;
+    }
+
+private:
+    static int floor_log2(uint64_t value) {
+        int n = 0;
+
+        while (value >>= 1) {
+            ++n;
+        }
+
+        return n;
+    }
+
+}; // struct histogram_buckets
+
+/// A point-in-time copy of a \c latency_histogram.
+class histogram_snapshot {
+public:
+    typedef std::chrono::nanoseconds duration;
+
+    histogram_snapshot() :
+        counts_(histogram_buckets::count, 0u),
+        count_(0u),
+        sum_(0u),
+        max_(0u)
+    {}
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    duration max() const {
+        return duration(max_);
+    }
+
+    duration mean() const {
+        return duration(count_ ? sum_ / count_ : 0u);
+    }
+
+    /// The upper bound of the bucket holding the \p p th percentile, with
+    /// \p p within [0, 100].
+    duration percentile(double p) const {
+        if (count_ == 0u) {
+            return duration::zero();
+        }
+
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+        rank = rank == 0u ? 1u : (rank > count_ ? count_ : rank);
+
+        uint64_t seen = 0u;
+
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+
+            if (seen >= rank) {
+                uint64_t bound = histogram_buckets::upper_bound(i);
+                return duration(bound < max_ ? bound : max_);
+            }
+        }
+
+        return duration(max_);
+    }
+
+    /// Number of values per bucket, see \c histogram_buckets.
+    std::vector<uint64_t> const& counts() const {
+        return counts_;
+    }
+
+private:
+    friend class latency_histogram;
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+
+}; // class histogram_snapshot
+
+/// A lock-free histogram of latencies with a bounded relative error.
+/**
+ * \c record is wait-free and only touches relaxed atomics, so that any number
+ * of I/O threads can record while another thread takes snapshots.  A
+ * snapshot taken concurrently with \c record may miss the latest values, or
+ * count a value in the total before its bucket, but never blocks recording.
+ */
+class latency_histogram : private detail::noncopyable {
+public:
+    typedef std::chrono::nanoseconds duration;
+
+    latency_histogram() :
+        count_(0u),
+        sum_(0u),
+        max_(0u)
+    {
+        for (std::size_t i = 0; i < histogram_buckets::count; ++i) {
+            counts_[i].store(0u, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> const& elapsed) {
+        long long ns =
+            std::chrono::duration_cast<duration>(elapsed).count();
+        uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0u;
+
+        counts_[histogram_buckets::index(value)].fetch_add(
+                1u, std::memory_order_relaxed);
+        count_.fetch_add(1u, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = max_.load(std::memory_order_relaxed);
+
+        while (value > max &&
+               !max_.compare_exchange_weak(max, value,
+                                           std::memory_order_relaxed))
+        {}
+    }
+
+    histogram_snapshot snapshot() const {
+        histogram_snapshot s;
+
+        for (std::size_t i = 0; i < histogram_buckets::count; ++i) {
+            s.counts_[i] = counts_[i].load(std::memory_order_relaxed);
+        }
+
+        s.count_ = count_.load(std::memory_order_relaxed);
+        s.sum_ = sum_.load(std::memory_order_relaxed);
+        s.max_ = max_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::atomic<uint64_t> counts_[histogram_buckets::count];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+
+}; // class latency_histogram
+
+} // namespace amy
+
+#endif // __AMY_LATENCY_HISTOGRAM_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
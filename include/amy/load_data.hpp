@@ -0,0 +1,316 @@
+#ifndef __AMY_LOAD_DATA_HPP__
+#define __AMY_LOAD_DATA_HPP__
+
+#include <amy/detail/mysql_ops.hpp>
+#include <amy/detail/noncopyable.hpp>
+#include <amy/detail/value_format.hpp>
+
+#include <amy/sql_types.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace amy {
+
+/// Formats a row streamed by \c basic_connector::load_data, as a line of
+/// tab-separated values in the default format of \c LOAD \c DATA.
+/**
+ * Fields are added in the order of the columns of the table, or of the
+ * column list given to \c load_data.  Strings and characters are escaped,
+ * and \c nullptr stands for \c NULL, as do infinite and NaN floating point
+ * values, which SQL has no literal for.
+ */
+class load_data_row : private detail::noncopyable {
+public:
+    /// Appends the row to \p buffer.
+    explicit load_data_row(std::string& buffer) :
+        buffer_(buffer),
+        fields_(0u)
+    {}
+
+    std::size_t fields() const {
+        return fields_;
+    }
+
+    load_data_row& add(char const* value, std::size_t length) {
+        separate();
+
+        for (char const* end = value + length; value != end; ++value) {
+            switch (*value) {
+            case '\\':
+                buffer_ += "\\\\";
+                break;
+            case '\t':
+                buffer_ += "\\t";
+                break;
+            case '\n':
+                buffer_ += "\\n";
+                break;
+            case '\r':
+                buffer_ += "\\r";
+                break;
+            case '\0':
+                buffer_ += "\\0";
+                break;
+            default:
+                buffer_ += *value;
+            }
+        }
+
+        return *this;
+    }
+
+    load_data_row& add(std::string const& value) {
+        return add(value.data(), value.size());
+    }
+
+    load_data_row& add(char const* value) {
+        return add(value, std::strlen(value));
+    }
+
+    /// Adds \p value as a string of one character, rather than as its code.
+    load_data_row& add(char value) {
+        return add(&value, 1u);
+    }
+
+    load_data_row& add(std::nullptr_t) {
+        separate();
+        buffer_ += "\\N";
+        return *this;
+    }
+
+    load_data_row& add(bool value) {
+        separate();
+        buffer_ += value ? '1' : '0';
+        return *this;
+    }
+
+    template<typename Integer>
+    typename std::enable_if<std::is_integral<Integer>::value,
+                            load_data_row&>::type
+    add(Integer value) {
+        separate();
+        detail::append_integer(buffer_, value);
+        return *this;
+    }
+
+    load_data_row& add(double value) {
+        return add_floating(value, false);
+    }
+
+    load_data_row& add(float value) {
+        return add_floating(value, true);
+    }
+
+    load_data_row& add(sql_datetime const& value) {
+        separate();
+        detail::append_datetime(buffer_, value);
+        return *this;
+    }
+
+    /// Ends the row, and starts the next one.
+    void finish() {
+        buffer_ += '\n';
+        fields_ = 0u;
+    }
+
+private:
+    std::string& buffer_;
+    std::size_t fields_;
+
+    void separate() {
+        if (fields_++) {
+            buffer_ += '\t';
+        }
+    }
+
+    load_data_row& add_floating(double value, bool single) {
+        if (!std::isfinite(value)) {
+            return add(nullptr);
+        }
+
+        separate();
+        detail::append_floating(buffer_, value, single);
+        return *this;
+    }
+
+}; // class load_data_row
+
+namespace detail {
+
+template<std::size_t I, std::size_t N>
+struct tuple_fields {
+    template<typename Tuple>
+    static void add(load_data_row& row, Tuple const& t) {
+        row.add(std::get<I>(t));
+        tuple_fields<I + 1, N>::add(row, t);
+    }
+
+}; // struct tuple_fields
+
+template<std::size_t N>
+struct tuple_fields<N, N> {
+    template<typename Tuple>
+    static void add(load_data_row&, Tuple const&) {}
+
+}; // struct tuple_fields
+
+/// Produces a row per element of a range of tuples.
+template<typename InputIterator>
+class range_producer {
+public:
+    range_producer(InputIterator first, InputIterator last) :
+        first_(first),
+        last_(last)
+    {}
+
+    bool operator()(load_data_row& row) {
+        typedef typename std::decay<
+            typename std::iterator_traits<InputIterator>::value_type>::type
+            tuple_type;
+
+        if (first_ == last_) {
+            return false;
+        }
+
+        tuple_fields<0, std::tuple_size<tuple_type>::value>::add(row,
+                                                                 *first_);
+        ++first_;
+        return true;
+    }
+
+private:
+    InputIterator first_;
+    InputIterator last_;
+
+}; // class range_producer
+
+/// Feeds the rows of a producer to \c LOAD \c DATA \c LOCAL \c INFILE,
+/// through the callbacks of \c mysql_set_local_infile_handler, for as long
+/// as it lives.
+/**
+ * Rows are formatted into a buffer reused for the whole load, and handed to
+ * the client library in the chunks it asks for.  Exceptions thrown by the
+ * producer abort the load, and are rethrown by \c rethrow.
+ */
+template<typename Producer>
+class local_infile_source : private noncopyable {
+public:
+    local_infile_source(mysql_handle m, Producer& producer) :
+        mysql_(m),
+        producer_(producer),
+        offset_(0u),
+        done_(false)
+    {
+        mysql_ops::mysql_set_local_infile_handler(
+                mysql_, &local_infile_source::init,
+                &local_infile_source::read, &local_infile_source::end,
+                &local_infile_source::error, this);
+    }
+
+    ~local_infile_source() {
+        mysql_ops::mysql_set_local_infile_default(mysql_);
+    }
+
+    void rethrow() {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+    static int init(void** state, char const*, void* self) {
+        *state = self;
+        return 0;
+    }
+
+    static int read(void* self, char* buffer, unsigned int length) {
+        return static_cast<local_infile_source*>(self)->read_some(buffer,
+                                                                  length);
+    }
+
+    static void end(void*) {}
+
+    static int error(void*, char* message, unsigned int length) {
+        std::snprintf(message, length, "load_data producer failed");
+        return CR_UNKNOWN_ERROR;
+    }
+
+private:
+    mysql_handle mysql_;
+    Producer& producer_;
+    std::string buffer_;
+    std::size_t offset_;
+    bool done_;
+    std::exception_ptr exception_;
+
+    /// Fills \p buffer with up to \p length bytes of rows.
+    /**
+     * \return the number of bytes written, 0 once all the rows are, or -1 if
+     * the producer threw.
+     */
+    int read_some(char* buffer, unsigned int length) {
+        try {
+            if (offset_ == buffer_.size()) {
+                fill(length);
+            }
+
+            std::size_t n = std::min<std::size_t>(length,
+                                                  buffer_.size() - offset_);
+            std::memcpy(buffer, buffer_.data() + offset_, n);
+            offset_ += n;
+            return static_cast<int>(n);
+        } catch (...) {
+            exception_ = std::current_exception();
+            return -1;
+        }
+    }
+
+    void fill(std::size_t length) {
+        buffer_.clear();
+        offset_ = 0u;
+
+        load_data_row row(buffer_);
+
+        while (!done_ && buffer_.size() < length) {
+            if (producer_(row)) {
+                row.finish();
+            } else {
+                done_ = true;
+            }
+        }
+    }
+
+}; // class local_infile_source
+
+} // namespace detail
+
+/// A producer for \c basic_connector::load_data, streaming a row per
+/// element of [\p first, \p last), whose elements are \c std::tuple or \c
+/// std::pair instances of values accepted by \c load_data_row::add.
+template<typename InputIterator>
+detail::range_producer<InputIterator> produce_rows(InputIterator first,
+                                                   InputIterator last)
+{
+    return detail::range_producer<InputIterator>(first, last);
+}
+
+template<typename Range>
+auto produce_rows(Range const& range)
+    -> detail::range_producer<decltype(std::begin(range))>
+{
+    return produce_rows(std::begin(range), std::end(range));
+}
+
+} // namespace amy
+
+#endif // __AMY_LOAD_DATA_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
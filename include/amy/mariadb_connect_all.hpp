@@ -0,0 +1,194 @@
+#ifndef __AMY_MARIADB_CONNECT_ALL_HPP__
+#define __AMY_MARIADB_CONNECT_ALL_HPP__
+
+#include <amy/detail/async_initiate.hpp>
+
+#include <amy/auth_info.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/mariadb_connector.hpp>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace amy {
+
+/// The connectors handed over by \c async_connect_all.
+using mariadb_connectors = std::vector<std::unique_ptr<mariadb_connector>>;
+
+namespace detail {
+
+template <typename Endpoint, typename Handler>
+class connect_all_op
+    : public std::enable_shared_from_this<connect_all_op<Endpoint, Handler>> {
+public:
+  template <typename DeducedHandler>
+  connect_all_op(io_context& ioc, std::size_t count, Endpoint const& endpoint,
+      auth_info const& auth, std::string const& database, client_flags flags,
+      std::size_t parallelism, DeducedHandler&& handler)
+      : ioc_(ioc), endpoint_(endpoint), auth_(auth), database_(database),
+        flags_(flags), parallelism_(parallelism ? parallelism : 1),
+        slots_(count), timer_(ioc),
+        handler_(std::forward<DeducedHandler>(handler)) {
+    connected_.reserve(count);
+  }
+
+  void start(mariadb_service::time_point deadline) {
+    auto self = this->shared_from_this();
+
+    timer_.expires_at(deadline);
+    timer_.async_wait([self](AMY_SYSTEM_NS::error_code const& ec) {
+      if (!ec) {
+        self->expire();
+      }
+    });
+
+    launch();
+    maybe_finish();
+  }
+
+private:
+  io_context& ioc_;
+  Endpoint endpoint_;
+  auth_info auth_;
+  std::string database_;
+  client_flags flags_;
+  std::size_t parallelism_;
+
+  /// Connectors indexed by launch order, set while their handshake runs.
+  mariadb_connectors slots_;
+  mariadb_connectors connected_;
+  std::size_t launched_ = 0;
+  std::size_t running_ = 0;
+
+  boost::asio::steady_timer timer_;
+  Handler handler_;
+  AMY_SYSTEM_NS::error_code ec_;
+  bool done_ = false;
+
+  /// Starts handshakes up to the parallelism cap, until the first error.
+  void launch() {
+    while (!ec_ && running_ < parallelism_ && launched_ < slots_.size()) {
+      std::size_t index = launched_++;
+      ++running_;
+
+      slots_[index].reset(new mariadb_connector(ioc_));
+
+      auto self = this->shared_from_this();
+      slots_[index]->async_connect(endpoint_, auth_, database_, flags_,
+          [self, index](AMY_SYSTEM_NS::error_code const& ec) {
+            self->handle_connect(index, ec);
+          });
+    }
+  }
+
+  void handle_connect(std::size_t index, AMY_SYSTEM_NS::error_code const& ec) {
+    --running_;
+
+    if (!ec) {
+      connected_.push_back(std::move(slots_[index]));
+    } else if (!ec_) {
+      ec_ = ec;
+    }
+
+    launch();
+    maybe_finish();
+  }
+
+  /// Aborts the handshakes still running.
+  void expire() {
+    if (done_) {
+      return;
+    }
+
+    if (!ec_) {
+      ec_ = boost::asio::error::timed_out;
+    }
+
+    for (auto& c : slots_) {
+      if (c) {
+        c->cancel();
+      }
+    }
+  }
+
+  void maybe_finish() {
+    if (done_ || running_ || (!ec_ && launched_ < slots_.size())) {
+      return;
+    }
+
+    done_ = true;
+    timer_.cancel();
+
+    // Connectors which failed are destroyed outside of their own handlers.
+    auto failed = std::make_shared<mariadb_connectors>(std::move(slots_));
+    boost::asio::post(ioc_, [failed] {});
+
+    // Posted, since zero connections complete within the initiating function.
+    auto ex = (boost::asio::get_associated_executor)(
+        handler_, ioc_.get_executor());
+    boost::asio::post(ex, boost::beast::bind_handler(std::move(handler_), ec_,
+                              std::move(connected_)));
+  }
+}; // class connect_all_op
+
+class initiate_connect_all {
+public:
+  explicit initiate_connect_all(io_context& ioc) : ioc_(&ioc) {}
+
+  template <typename Handler, typename Endpoint>
+  void operator()(Handler&& handler, std::size_t count,
+      Endpoint const& endpoint, auth_info const& auth,
+      std::string const& database, client_flags flags,
+      std::size_t parallelism, mariadb_service::time_point deadline) const {
+    using op_type =
+        connect_all_op<Endpoint, typename std::decay<Handler>::type>;
+
+    std::make_shared<op_type>(*ioc_, count, endpoint, auth, database, flags,
+        parallelism, std::forward<Handler>(handler))
+        ->start(deadline);
+  }
+
+private:
+  io_context* ioc_;
+}; // class initiate_connect_all
+
+} // namespace detail
+
+/// Opens \p count connections with at most \p parallelism handshakes in
+/// flight at any time.
+/**
+ * Each handshake runs on the non-blocking MariaDB API, so that warming up a
+ * pool takes roughly <tt>count / parallelism</tt> handshake round trips
+ * instead of \p count.  No new handshake starts after the first failure.
+ * When \p deadline expires, the running handshakes are canceled and the
+ * operation completes with \c timed_out.
+ *
+ * The handler receives the first error, if any, and the connectors which
+ * did connect, bound to \p ioc.
+ */
+template <typename Endpoint, typename ConnectAllHandler>
+BOOST_ASIO_INITFN_RESULT_TYPE(ConnectAllHandler,
+    void(AMY_SYSTEM_NS::error_code, mariadb_connectors))
+async_connect_all(io_context& ioc, std::size_t count, Endpoint const& endpoint,
+    auth_info const& auth, std::string const& database, client_flags flags,
+    std::size_t parallelism, mariadb_service::time_point deadline,
+    ConnectAllHandler&& handler) {
+  return detail::async_initiate<void(
+      AMY_SYSTEM_NS::error_code, mariadb_connectors)>(
+      detail::initiate_connect_all(ioc), handler, count, endpoint, auth,
+      database, flags, parallelism, deadline);
+}
+
+} // namespace amy
+
+#endif // __AMY_MARIADB_CONNECT_ALL_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
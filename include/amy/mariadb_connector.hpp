@@ -2,6 +2,11 @@
 #define __AMY_MARIADB_CONNECTOR_HPP__
 
 #include <amy/basic_connector.hpp>
+#include <amy/basic_connector_group.hpp>
+#include <amy/basic_insert_batcher.hpp>
+#include <amy/basic_load_balancer.hpp>
+#include <amy/basic_query_queue.hpp>
+#include <amy/basic_query_router.hpp>
 #include <amy/basic_results_iterator.hpp>
 #include <amy/basic_scoped_transaction.hpp>
 #include <amy/mariadb_service.hpp>
@@ -14,6 +19,18 @@ using mariadb_results_iterator = basic_results_iterator<mariadb_service>;
 
 using mariadb_scoped_transaction = basic_scoped_transaction<mariadb_service>;
 
+using mariadb_query_queue = basic_query_queue<mariadb_service>;
+
+using mariadb_query_router = basic_query_router<mariadb_service>;
+
+using mariadb_connector_group = basic_connector_group<mariadb_service>;
+
+using mariadb_load_balancer = basic_load_balancer<mariadb_service>;
+
+template<typename... Columns>
+using mariadb_insert_batcher =
+    basic_insert_batcher<mariadb_service, Columns...>;
+
 } // namespace amy
 
 #endif // __AMY_MARIADB_CONNECTOR_HPP__
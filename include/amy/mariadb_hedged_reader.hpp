@@ -0,0 +1,324 @@
+#ifndef __AMY_MARIADB_HEDGED_READER_HPP__
+#define __AMY_MARIADB_HEDGED_READER_HPP__
+
+#include <amy/detail/async_initiate.hpp>
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/auth_info.hpp>
+#include <amy/client_flags.hpp>
+#include <amy/mariadb_connector.hpp>
+#include <amy/result_set.hpp>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace amy {
+
+/// Runs read-only statements over replicas, hedging the slow ones.
+/**
+ * \c async_query_result_hedged sends a statement to an idle connection of the
+ * next replica.  If no result came back after the hedge delay, the statement
+ * is sent again to an idle connection of another replica.  The first result
+ * to come back completes the operation, and the statement still running on
+ * the other connection is interrupted with \c async_kill_query, which leaves
+ * that connection usable.
+ *
+ * The hedge delay is the \c percentile of the latencies of the last \c
+ * sample_window statements, so that roughly <tt>1 - percentile</tt> of the
+ * statements are hedged.  Until enough samples are gathered, \c
+ * initial_delay is used.
+ *
+ * Each connection runs one statement at a time; statements issued while all
+ * connections are busy wait in FIFO order.  Only statements without side
+ * effects may be hedged.  The reader is not thread safe, must only be used
+ * from the thread running its \c io_context, and must outlive its pending
+ * operations.
+ */
+class mariadb_hedged_reader : private detail::noncopyable {
+public:
+  using clock_type = std::chrono::steady_clock;
+
+  /// Number of latency samples the hedge delay is computed from.
+  static const std::size_t sample_window = 256;
+
+  /// Minimum number of samples the hedge delay is computed from.
+  static const std::size_t min_samples = 16;
+
+  /// Number of new samples after which the hedge delay is recomputed.
+  static const std::size_t update_interval = 16;
+
+  explicit mariadb_hedged_reader(io_context& ioc)
+      : ioc_(ioc), percentile_(0.95),
+        initial_delay_(std::chrono::milliseconds(10)),
+        min_delay_(std::chrono::milliseconds(1)),
+        hedge_delay_(initial_delay_), next_(0), next_sample_(0),
+        samples_since_update_(0), hedged_(0) {}
+
+  io_context& get_io_service() { return ioc_; }
+
+  /// Connects \p connections connections to a new replica and returns its
+  /// index.
+  template <typename Endpoint>
+  std::size_t add_replica(Endpoint const& endpoint, auth_info const& auth,
+      std::string const& database, client_flags flags,
+      std::size_t connections = 1) {
+    std::size_t replica = replicas_++;
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(connections, 1); ++i) {
+      std::unique_ptr<member> m(new member(ioc_, replica));
+      m->connector.connect(endpoint, auth, database, flags);
+      members_.push_back(std::move(m));
+    }
+
+    return replica;
+  }
+
+  /// Number of connections over all replicas.
+  std::size_t size() const { return members_.size(); }
+
+  mariadb_connector& connector(std::size_t index) {
+    return members_[index]->connector;
+  }
+
+  /// Fraction of the statements expected to complete before the hedge delay.
+  void percentile(double p) { percentile_ = std::min(std::max(p, 0.0), 1.0); }
+
+  /// Hedge delay used until enough latency samples are gathered.
+  void initial_delay(clock_type::duration delay) {
+    initial_delay_ = delay;
+
+    if (samples_.size() < min_samples) {
+      hedge_delay_ = delay;
+    }
+  }
+
+  /// Lower bound of the hedge delay.
+  void min_delay(clock_type::duration delay) { min_delay_ = delay; }
+
+  /// The current hedge delay.
+  clock_type::duration hedge_delay() const { return hedge_delay_; }
+
+  /// Number of statements which were sent to a second replica.
+  std::size_t hedged() const { return hedged_; }
+
+  /// Accounts for the latency of a read, as done for each successful one.
+  /**
+   * The hedge delay is recomputed every \c update_interval samples, once at
+   * least \c min_samples were gathered.  Reads run apart from the reader may
+   * be accounted for this way.
+   */
+  void record(clock_type::duration latency) {
+    if (samples_.size() < sample_window) {
+      samples_.push_back(latency);
+    } else {
+      samples_[next_sample_++ % sample_window] = latency;
+    }
+
+    if (samples_.size() < min_samples ||
+        ++samples_since_update_ < update_interval) {
+      return;
+    }
+
+    samples_since_update_ = 0;
+
+    std::vector<clock_type::duration> sorted(samples_);
+    auto nth = sorted.begin() +
+               static_cast<std::ptrdiff_t>(percentile_ * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), nth, sorted.end());
+
+    hedge_delay_ = std::max(*nth, min_delay_);
+  }
+
+  template <typename QueryResultHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(QueryResultHandler,
+      void(AMY_SYSTEM_NS::error_code, amy::result_set))
+  async_query_result_hedged(
+      std::string const& stmt, QueryResultHandler&& handler) {
+    return detail::async_initiate<void(
+        AMY_SYSTEM_NS::error_code, amy::result_set)>(
+        initiate_hedged_query(this), handler, stmt);
+  }
+
+private:
+  struct member {
+    member(io_context& ioc, std::size_t replica)
+        : connector(ioc), replica(replica), running(false), killing(false) {}
+
+    bool busy() const { return running || killing; }
+
+    mariadb_connector connector;
+    std::size_t replica;
+
+    /// Whether a statement of the reader runs on the connection.
+    bool running;
+
+    /// Whether a KILL QUERY targeting the connection is in flight.
+    bool killing;
+  }; // struct member
+
+  template <typename Handler>
+  struct hedged_op {
+    hedged_op(io_context& ioc, std::string const& stmt, Handler&& handler)
+        : stmt(stmt), handler(std::move(handler)), timer(ioc) {}
+
+    std::string stmt;
+    Handler handler;
+    boost::asio::steady_timer timer;
+    clock_type::time_point started;
+    member* attempts[2] = {nullptr, nullptr};
+    std::size_t launched = 0;
+    std::size_t running = 0;
+    bool done = false;
+  }; // struct hedged_op
+
+  class initiate_hedged_query {
+  public:
+    explicit initiate_hedged_query(mariadb_hedged_reader* self) : self_(self) {}
+
+    template <typename Handler>
+    void operator()(Handler&& handler, std::string const& stmt) const {
+      using handler_type = typename std::decay<Handler>::type;
+
+      auto op = std::make_shared<hedged_op<handler_type>>(
+          self_->ioc_, stmt, std::forward<Handler>(handler));
+      self_->start(std::move(op));
+    }
+
+  private:
+    mariadb_hedged_reader* self_;
+  }; // class initiate_hedged_query
+
+  io_context& ioc_;
+  std::vector<std::unique_ptr<member>> members_;
+  std::size_t replicas_ = 0;
+  double percentile_;
+  clock_type::duration initial_delay_;
+  clock_type::duration min_delay_;
+  clock_type::duration hedge_delay_;
+  std::size_t next_;
+
+  /// Operations waiting for an idle connection.
+  std::deque<std::function<void()>> pending_;
+
+  /// Ring buffer of the latest latencies.
+  std::vector<clock_type::duration> samples_;
+  std::size_t next_sample_;
+  std::size_t samples_since_update_;
+  std::size_t hedged_;
+
+  /// An idle connection, preferably of the next replica in round-robin
+  /// order, on any replica but \p excluded.
+  member* acquire(std::size_t excluded) {
+    for (std::size_t i = 0; i < members_.size(); ++i) {
+      member* m = members_[next_++ % members_.size()].get();
+
+      if (!m->busy() && m->replica != excluded) {
+        return m;
+      }
+    }
+
+    return nullptr;
+  }
+
+  template <typename Handler>
+  void start(std::shared_ptr<hedged_op<Handler>> op) {
+    member* m = acquire(replicas_);
+
+    if (!m) {
+      pending_.push_back([this, op] { start(op); });
+      return;
+    }
+
+    op->started = clock_type::now();
+    launch(op, m);
+
+    op->timer.expires_after(hedge_delay_);
+    op->timer.async_wait([this, op](AMY_SYSTEM_NS::error_code const& ec) {
+      if (ec || op->done || op->launched != 1) {
+        return;
+      }
+
+      if (member* second = acquire(op->attempts[0]->replica)) {
+        ++hedged_;
+        launch(op, second);
+      }
+    });
+  }
+
+  template <typename Handler>
+  void launch(std::shared_ptr<hedged_op<Handler>> const& op, member* m) {
+    m->running = true;
+    op->attempts[op->launched++] = m;
+    ++op->running;
+
+    m->connector.async_query_result(op->stmt,
+        [this, op, m](AMY_SYSTEM_NS::error_code const& ec, result_set rs) {
+          handle_result(op, m, ec, std::move(rs));
+        });
+  }
+
+  template <typename Handler>
+  void handle_result(std::shared_ptr<hedged_op<Handler>> const& op, member* m,
+      AMY_SYSTEM_NS::error_code const& ec, result_set rs) {
+    m->running = false;
+    --op->running;
+
+    // A failed attempt leaves the decision to the one still running.
+    if (!op->done && (!ec || !op->running)) {
+      op->done = true;
+      op->timer.cancel();
+
+      if (!ec) {
+        record(clock_type::now() - op->started);
+      }
+
+      for (std::size_t i = 0; i < op->launched; ++i) {
+        member* other = op->attempts[i];
+
+        if (other != m && other->running) {
+          kill(other);
+        }
+      }
+
+      auto ex = (boost::asio::get_associated_executor)(
+          op->handler, ioc_.get_executor());
+      boost::asio::dispatch(ex,
+          boost::beast::bind_handler(std::move(op->handler), ec, rs));
+    }
+
+    release(m);
+  }
+
+  void kill(member* m) {
+    m->killing = true;
+    m->connector.async_kill_query([this, m](AMY_SYSTEM_NS::error_code const&) {
+      m->killing = false;
+      release(m);
+    });
+  }
+
+  /// Hands an idle connection over to the oldest waiting operation.
+  void release(member* m) {
+    if (!m->busy() && !pending_.empty()) {
+      std::function<void()> next = std::move(pending_.front());
+      pending_.pop_front();
+      next();
+    }
+  }
+}; // class mariadb_hedged_reader
+
+} // namespace amy
+
+#endif // __AMY_MARIADB_HEDGED_READER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
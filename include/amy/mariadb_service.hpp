@@ -1,7 +1,10 @@
 #ifndef __AMY_MARIADB_SERVICE_HPP__
 #define __AMY_MARIADB_SERVICE_HPP__
 
+#include <amy/detail/connect_params.hpp>
 #include <amy/detail/mysql_lib_init.hpp>
+#include <amy/detail/op_queue.hpp>
+#include <amy/detail/recycling_handler.hpp>
 #include <amy/detail/mysql_types.hpp>
 #include <amy/detail/service_base.hpp>
 
@@ -14,6 +17,7 @@
 #else
 #include <boost/asio/posix/stream_descriptor.hpp>
 #endif
+#include <atomic>
 #include <memory>
 
 namespace amy {
@@ -30,6 +34,11 @@ public:
   class store_result_handler;
   template<class Handler>
   class query_result_handler;
+  template<class Handler>
+  class deadline_handler;
+
+  /// The type used to express per-operation deadlines.
+  typedef AMY_ASIO_NS::steady_timer::time_point time_point;
 
   typedef implementation implementation_type;
 
@@ -83,6 +92,19 @@ public:
   async_query(
       implementation_type& impl, std::string const& stmt, QueryHandler handler);
 
+  /// Starts an asynchronous query that must complete before \p deadline.
+  /**
+   * If the deadline expires while the query is still running, the query is
+   * killed on the server with a <tt>KILL QUERY</tt> statement sent over a
+   * side connection, and the handler is invoked with \c operation_aborted.
+   * The connection itself stays usable, and the next queued operation only
+   * starts after the kill went through.
+   */
+  template <typename QueryHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(QueryHandler, void(AMY_SYSTEM_NS::error_code))
+  async_query(implementation_type& impl, std::string const& stmt,
+      time_point deadline, QueryHandler handler);
+
   bool has_more_results(implementation_type const& impl) const;
 
   result_set store_result(
@@ -99,6 +121,22 @@ public:
   async_query_result(implementation_type& impl,
                      std::string const& stmt, Handler handler);
 
+  template <typename Handler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(
+      Handler, void(AMY_SYSTEM_NS::error_code, amy::result_set))
+  async_query_result(implementation_type& impl, std::string const& stmt,
+      time_point deadline, Handler handler);
+
+  /// Kills the statement currently executed by \p impl on the server.
+  /**
+   * Opens a side connection to the server \p impl was last connected to and
+   * runs <tt>KILL QUERY</tt> with the connection ID of \p impl.  The
+   * interrupted operation of \p impl completes with an error.
+   */
+  template <typename KillHandler>
+  BOOST_ASIO_INITFN_RESULT_TYPE(KillHandler, void(AMY_SYSTEM_NS::error_code))
+  async_kill_query(implementation_type& impl, KillHandler handler);
+
   AMY_SYSTEM_NS::error_code autocommit(
       implementation_type& impl, bool mode, AMY_SYSTEM_NS::error_code& ec);
 
@@ -112,6 +150,10 @@ public:
 
 private:
   detail::mysql_lib_init mysql_lib_init_;
+
+  template <typename Handler>
+  deadline_handler<Handler> arm_deadline(
+      implementation_type& impl, time_point deadline, Handler handler);
 }; // class mariadb_service
 
 /// The underlying MySQL client connector implementation.
@@ -135,6 +177,45 @@ struct mariadb_service::implementation {
   std::unique_ptr<AMY_ASIO_NS::posix::stream_descriptor> ev_;
   std::unique_ptr<AMY_ASIO_NS::steady_timer> timer_;
 
+  /// Incremented by each wait for socket events or timeouts, so that
+  /// completions of canceled secondary waits can be told apart.
+  uint64_t wait_generation_;
+
+  /// Events reported by the secondary waits of the current wait.
+  int wait_events_;
+
+  /// Events waited for by the secondary waits of the current wait.
+  int wait_secondary_;
+
+  /// Parameters of the last connect operation, used to open side
+  /// connections.
+  detail::connect_params params_;
+
+  /// Timer enforcing the deadline of the running operation, if any.
+  /**
+   * Kept apart from \c timer_, which serves the timeouts requested by the
+   * client library itself.
+   */
+  std::unique_ptr<AMY_ASIO_NS::steady_timer> deadline_;
+
+  /// ID of the running operation the deadline is armed for, 0 if none.
+  std::atomic<uint64_t> deadline_id_;
+
+  /// ID of the last operation whose deadline expired, set by the timer.
+  std::atomic<uint64_t> deadline_expired_id_;
+
+  /// Last ID handed out to an operation with a deadline.
+  uint64_t last_deadline_id_;
+
+  /// Asynchronous operations waiting for the connection.
+  /**
+   * Asynchronous operations are started one at a time in FIFO order, so that
+   * they may be issued concurrently, even from different threads, without
+   * stepping on each other's \c ev_, \c timer_ and \c first_result_stored.
+   * Shared with the running operation, which may outlive the implementation.
+   */
+  std::shared_ptr<detail::op_queue> ops;
+
   /// Constructor.
   /**
    * The native connection handle is neither opened nor initialized within
@@ -154,6 +235,13 @@ struct mariadb_service::implementation {
   /// Cancels unfinished asynchronous operations.
   void cancel();
 
+  /// Wraps \p handler so that the asynchronous operation completing it
+  /// allocates its state and its intermediate handlers from the pool of the
+  /// connection.
+  template <typename Handler>
+  detail::recycling_handler<typename std::decay<Handler>::type> recycle(
+      Handler&& handler) const;
+
 }; // struct mariadb_service::implementation
 
 } // namespace amy
@@ -5,6 +5,7 @@
 #include <amy/detail/mysql_types.hpp>
 #include <amy/detail/service_base.hpp>
 
+#include <amy/allocation_accounting.hpp>
 #include <amy/endpoint_traits.hpp>
 #include <amy/result_set.hpp>
 
@@ -184,6 +185,9 @@ public:
                           Handler handler);
 
 protected:
+    /// Runs \p stmt, timestamping the phases of a traced statement.
+    void real_query(detail::string const& stmt, AMY_SYSTEM_NS::error_code& ec);
+
     implementation_type& impl_;
     std::weak_ptr<void> cancelation_token_;
     AMY_ASIO_NS::io_service& io_service_;
@@ -224,7 +228,7 @@ public:
     void operator()();
 
 private:
-    std::string stmt_;
+    detail::string stmt_;
 
 }; // class mysql_service::query_handler
 
@@ -267,7 +271,7 @@ public:
     void operator()();
 
 private:
-    std::string stmt_;
+    detail::string stmt_;
 
 }; // class mysql_service::query_result_handler
 
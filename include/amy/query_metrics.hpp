@@ -0,0 +1,192 @@
+#ifndef __AMY_QUERY_METRICS_HPP__
+#define __AMY_QUERY_METRICS_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/error.hpp>
+#include <amy/latency_histogram.hpp>
+#include <amy/query_trace.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace amy {
+
+/// A point-in-time copy of a \c query_metrics.
+struct query_metrics_snapshot {
+    /// Kinds of errors statements fail with.
+    enum error_class {
+        /// Errors reported by the server for the statement itself, e.g.
+        /// syntax errors or deadlocks.
+        server_error = 0,
+
+        /// Client library errors, e.g. lost connections.
+        client_error,
+
+        /// amy's own errors, like \c amy::error::busy.
+        misc_error,
+
+        /// Any other error, e.g. \c operation_aborted.
+        other_error
+    };
+
+    static const int error_class_count = other_error + 1;
+
+    query_metrics_snapshot() :
+        queries(0u),
+        rows(0u),
+        bytes_sent(0u)
+    {
+        for (int i = 0; i < error_class_count; ++i) {
+            errors[i] = 0u;
+        }
+    }
+
+    uint64_t queries;
+    uint64_t errors[error_class_count];
+    uint64_t rows;
+    uint64_t bytes_sent;
+
+    /// From issuing statements to running their handlers.
+    histogram_snapshot latency;
+
+    /// Per phase, indexed by \c query_trace::phase.
+    histogram_snapshot phases[query_trace::phase_count];
+
+}; // struct query_metrics_snapshot
+
+/// Lock-free counters and latency histograms of the statements traced by
+/// observed connectors.
+/**
+ * A \c query_metrics can be fed by a single connector, or shared by all the
+ * connectors of a service, e.g. a connector group or a pool, through \c
+ * metrics_observer.  \c record may run on any number of threads at once, and
+ * \c snapshot can be called from yet another thread, typically a metrics
+ * scraper, without ever blocking the threads recording.  Each instance takes
+ * about 40KB for its histograms.
+ */
+class query_metrics : private detail::noncopyable {
+public:
+    typedef query_metrics_snapshot::error_class error_class;
+
+    query_metrics() :
+        queries_(0u),
+        rows_(0u),
+        bytes_sent_(0u)
+    {
+        for (int i = 0; i < query_metrics_snapshot::error_class_count; ++i) {
+            errors_[i].store(0u, std::memory_order_relaxed);
+        }
+    }
+
+    static error_class classify(AMY_SYSTEM_NS::error_code const& ec) {
+        if (ec.category() == amy::error::get_client_category()) {
+            return amy::error::detail::is_server_error(ec)
+                ? query_metrics_snapshot::server_error
+                : query_metrics_snapshot::client_error;
+        } else if (ec.category() == amy::error::get_misc_category()) {
+            return query_metrics_snapshot::misc_error;
+        } else {
+            return query_metrics_snapshot::other_error;
+        }
+    }
+
+    void record(query_trace const& trace) {
+        queries_.fetch_add(1u, std::memory_order_relaxed);
+        rows_.fetch_add(trace.rows, std::memory_order_relaxed);
+        bytes_sent_.fetch_add(trace.bytes_sent, std::memory_order_relaxed);
+
+        if (trace.ec) {
+            errors_[classify(trace.ec)].fetch_add(
+                    1u, std::memory_order_relaxed);
+        }
+
+        latency_.record(trace.total());
+
+        for (int i = 0; i < query_trace::phase_count; ++i) {
+            query_trace::phase p = static_cast<query_trace::phase>(i);
+
+            if (trace.reached(p)) {
+                phases_[i].record(trace.duration(p));
+            }
+        }
+    }
+
+    query_metrics_snapshot snapshot() const {
+        query_metrics_snapshot s;
+
+        s.queries = queries_.load(std::memory_order_relaxed);
+        s.rows = rows_.load(std::memory_order_relaxed);
+        s.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+
+        for (int i = 0; i < query_metrics_snapshot::error_class_count; ++i) {
+            s.errors[i] = errors_[i].load(std::memory_order_relaxed);
+        }
+
+        s.latency = latency_.snapshot();
+
+        for (int i = 0; i < query_trace::phase_count; ++i) {
+            s.phases[i] = phases_[i].snapshot();
+        }
+
+        return s;
+    }
+
+private:
+    std::atomic<uint64_t> queries_;
+    std::atomic<uint64_t> errors_[query_metrics_snapshot::error_class_count];
+    std::atomic<uint64_t> rows_;
+    std::atomic<uint64_t> bytes_sent_;
+    latency_histogram latency_;
+    latency_histogram phases_[query_trace::phase_count];
+
+}; // class query_metrics
+
+/// An observer of \c basic_connector recording statements into the metrics
+/// of the connector, and optionally into metrics shared with other
+/// connectors.
+/**
+ * \code
+ * amy::query_metrics service_metrics;
+ *
+ * amy::basic_connector<amy::mysql_service, amy::metrics_observer> connector(
+ *         io_service, amy::metrics_observer(&service_metrics));
+ *
+ * // From any thread.
+ * connector.observer().metrics().snapshot();
+ * service_metrics.snapshot();
+ * \endcode
+ */
+class metrics_observer {
+public:
+    /// \p shared, if any, must outlive the observer.
+    explicit metrics_observer(query_metrics* shared = nullptr) :
+        own_(std::make_shared<query_metrics>()),
+        shared_(shared)
+    {}
+
+    /// The metrics of this connector alone.
+    query_metrics& metrics() const {
+        return *own_;
+    }
+
+    void operator()(query_trace const& trace) const {
+        own_->record(trace);
+
+        if (shared_) {
+            shared_->record(trace);
+        }
+    }
+
+private:
+    std::shared_ptr<query_metrics> own_;
+    query_metrics* shared_;
+
+}; // class metrics_observer
+
+} // namespace amy
+
+#endif // __AMY_QUERY_METRICS_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
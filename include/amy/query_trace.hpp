@@ -0,0 +1,125 @@
+#ifndef __AMY_QUERY_TRACE_HPP__
+#define __AMY_QUERY_TRACE_HPP__
+
+#include <amy/allocation_accounting.hpp>
+#include <amy/asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace amy {
+
+/// Timestamps and sizes of an asynchronous statement run by an observed
+/// \c basic_connector.
+/**
+ * A statement goes through the phases below in order, and each phase is
+ * timestamped when it ends:
+ *
+ * - \c queue, waiting for the connection once the statement is issued,
+ * - \c send, sending the statement to the server,
+ * - \c first_byte, waiting for the first response, i.e. server execution,
+ * - \c transfer, transferring the result set, i.e. \c mysql_store_result,
+ * - \c decode, building the \c row and \c field wrappers of the result set,
+ * - \c dispatch, waiting for the completion handler to run.
+ *
+ * Phases a statement does not go through, like \c transfer and \c decode for
+ * \c async_query or the phases skipped by an error, are not reached.  With
+ * the non-blocking MariaDB API, \c send ends once the statement is handed to
+ * the socket.
+ */
+struct query_trace {
+    typedef std::chrono::steady_clock clock_type;
+
+    enum phase {
+        queue = 0,
+        send,
+        first_byte,
+        transfer,
+        decode,
+        dispatch
+    };
+
+    static const int phase_count = dispatch + 1;
+
+    query_trace() :
+        statement_id(0u),
+        bytes_sent(0u),
+        rows(0u),
+        fields(0u)
+    {}
+
+    /// Identifies the statement among the ones of its connector, from 1.
+    uint64_t statement_id;
+
+    std::string statement;
+
+    std::size_t bytes_sent;
+
+    /// Rows of the result set, if any.
+    uint64_t rows;
+
+    /// Columns of the result set, if any.
+    uint32_t fields;
+
+    AMY_SYSTEM_NS::error_code ec;
+
+    clock_type::time_point issued;
+
+    clock_type::time_point ended[phase_count];
+
+    /// Allocations and copies made by the service on behalf of the
+    /// statement, all zero unless \c AMY_ALLOCATION_ACCOUNTING is defined.
+    allocation_counters allocations;
+
+    void mark(phase p) {
+        ended[p] = clock_type::now();
+    }
+
+    bool reached(phase p) const {
+        return ended[p] != clock_type::time_point();
+    }
+
+    /// Time spent in \p p, zero if not reached.
+    clock_type::duration duration(phase p) const {
+        if (!reached(p)) {
+            return clock_type::duration::zero();
+        }
+
+        clock_type::time_point started = issued;
+
+        for (int i = p - 1; i >= 0; --i) {
+            if (reached(static_cast<phase>(i))) {
+                started = ended[i];
+                break;
+            }
+        }
+
+        return ended[p] - started;
+    }
+
+    /// Time from issuing the statement to running its handler.
+    clock_type::duration total() const {
+        return reached(dispatch) ? ended[dispatch] - issued
+                                 : clock_type::duration::zero();
+    }
+
+}; // struct query_trace
+
+/// The default observer of \c basic_connector, which disables tracing.
+/**
+ * An observer is a function object invoked with the \c query_trace of every
+ * asynchronous statement, right before its completion handler, from the
+ * thread running the handler.  Only connectors with an observer other than
+ * \c null_observer trace statements at all.
+ */
+struct null_observer {
+    void operator()(query_trace const&) const {}
+
+}; // struct null_observer
+
+} // namespace amy
+
+#endif // __AMY_QUERY_TRACE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
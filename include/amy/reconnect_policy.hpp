@@ -0,0 +1,120 @@
+#ifndef __AMY_RECONNECT_POLICY_HPP__
+#define __AMY_RECONNECT_POLICY_HPP__
+
+#include <amy/detail/mysql.hpp>
+
+#include <amy/error.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+
+namespace amy {
+
+/// Describes how asynchronous operations reestablish a lost connection.
+/**
+ * When an asynchronous query fails with \c CR_SERVER_GONE_ERROR or \c
+ * CR_SERVER_LOST, the connector reconnects to the endpoint of its last
+ * connect operation, making up to \c max_attempts attempts.  Before each
+ * attempt it waits for a random delay between zero and <tt>initial_backoff *
+ * 2^attempt</tt>, capped at \c max_backoff ("full jitter"), so that clients
+ * of a failed server do not reconnect in lockstep.
+ *
+ * A default constructed policy never reconnects.
+ */
+class reconnect_policy {
+public:
+    typedef std::chrono::steady_clock::duration duration;
+
+    /// Creates a policy which never reconnects.
+    reconnect_policy() :
+        max_attempts_(0u),
+        initial_backoff_(duration::zero()),
+        max_backoff_(duration::zero())
+    {}
+
+    reconnect_policy(std::size_t max_attempts,
+                     duration initial_backoff = std::chrono::milliseconds(10),
+                     duration max_backoff = std::chrono::seconds(2)) :
+        max_attempts_(max_attempts),
+        initial_backoff_(initial_backoff),
+        max_backoff_(std::max(max_backoff, initial_backoff))
+    {}
+
+    bool enabled() const {
+        return max_attempts_ != 0u;
+    }
+
+    std::size_t max_attempts() const {
+        return max_attempts_;
+    }
+
+    duration initial_backoff() const {
+        return initial_backoff_;
+    }
+
+    duration max_backoff() const {
+        return max_backoff_;
+    }
+
+    /// The delay to wait before the attempt number \p attempt, from 0.
+    template<typename RandomEngine>
+    duration backoff(std::size_t attempt, RandomEngine& random) const {
+        duration ceiling = initial_backoff_;
+
+        for (std::size_t i = 0; i < attempt && ceiling < max_backoff_; ++i) {
+            ceiling *= 2;
+        }
+
+        ceiling = std::min(ceiling, max_backoff_);
+
+        std::uniform_int_distribution<duration::rep> jitter(0, ceiling.count());
+        return duration(jitter(random));
+    }
+
+    /// Whether \p ec means that the connection to the server was lost.
+    static bool is_connection_lost(AMY_SYSTEM_NS::error_code const& ec) {
+        return ec.category() == amy::error::get_client_category() &&
+               (ec.value() == CR_SERVER_GONE_ERROR ||
+                ec.value() == CR_SERVER_LOST);
+    }
+
+private:
+    std::size_t max_attempts_;
+    duration initial_backoff_;
+    duration max_backoff_;
+
+}; // class reconnect_policy
+
+/// A statement which may safely run again after a lost connection.
+/**
+ * Passing an \c idempotent_statement to \c async_query or \c
+ * async_query_result lets the connector run it again once reconnected, while
+ * other statements fail with the error which triggered the reconnection.
+ */
+class idempotent_statement {
+public:
+    explicit idempotent_statement(std::string const& stmt) :
+        stmt_(stmt)
+    {}
+
+    std::string const& str() const {
+        return stmt_;
+    }
+
+private:
+    std::string stmt_;
+
+}; // class idempotent_statement
+
+/// Marks \p stmt as safe to run again after a lost connection.
+inline idempotent_statement idempotent(std::string const& stmt) {
+    return idempotent_statement(stmt);
+}
+
+} // namespace amy
+
+#endif // __AMY_RECONNECT_POLICY_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
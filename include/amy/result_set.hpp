@@ -4,6 +4,7 @@
 #include <amy/detail/mysql_types.hpp>
 #include <amy/detail/throw_error.hpp>
 
+#include <amy/allocation_accounting.hpp>
 #include <amy/field_info.hpp>
 #include <amy/row.hpp>
 
@@ -19,7 +20,7 @@ namespace amy {
  */
 class result_set {
 private:
-    typedef std::vector<row> values_type;
+    typedef std::vector<row, detail::allocator<row>> values_type;
 
     typedef
         values_type::const_iterator
@@ -39,6 +40,10 @@ private:
 		}
 	};
 
+    struct ignore_stored {
+        void operator()() const {}
+    };
+
 public:
     /// The random access iterator over rows.
     typedef values_const_iterator const_iterator;
@@ -51,7 +56,9 @@ public:
 
     typedef detail::mysql_handle native_mysql_type;
 
-    typedef std::vector<field_info> fields_info_type;
+    typedef
+        std::vector<field_info, detail::allocator<field_info>>
+        fields_info_type;
 
     explicit result_set() :
 		row_count_(0),
@@ -59,8 +66,10 @@ public:
 		field_count_(0),
 		result_set_(static_cast<detail::result_set_handle>(nullptr),
 			result_set_deleter()),
-        values_(new values_type),
-        fields_info_(new fields_info_type)
+        values_(std::allocate_shared<values_type>(
+                    detail::allocator<values_type>())),
+        fields_info_(std::allocate_shared<fields_info_type>(
+                    detail::allocator<fields_info_type>()))
     {}
 
     result_set(result_set const& other) :
@@ -70,7 +79,9 @@ public:
         result_set_(other.result_set_),
         values_(other.values_),
         fields_info_(other.fields_info_)
-    {}
+    {
+        detail::account_copy();
+    }
 
     result_set const& operator=(result_set const& other) {
 		row_count_ = other.row_count_,
@@ -79,6 +90,7 @@ public:
         result_set_ = other.result_set_;
         values_ = other.values_;
         fields_info_ = other.fields_info_;
+        detail::account_copy();
         return *this;
     }
 
@@ -92,6 +104,17 @@ public:
     void assign(
             native_mysql_type mysql,
             AMY_SYSTEM_NS::error_code& ec)
+    {
+        assign(mysql, ec, ignore_stored());
+    }
+
+    /// Same as above, invoking \p stored once the result set is transferred
+    /// from the server and before its rows are wrapped.
+    template<typename StoredHandler>
+    void assign(
+            native_mysql_type mysql,
+            AMY_SYSTEM_NS::error_code& ec,
+            StoredHandler stored)
     {
         namespace ops = amy::detail::mysql_ops;
 
@@ -99,6 +122,8 @@ public:
 			ops::mysql_store_result(mysql, ec),
 			result_set_deleter());
 
+        stored();
+
         if (!result_set_) {
             return;
         }
@@ -111,7 +136,8 @@ public:
 
         // Fetch fields information.
         field_count_ = ops::mysql_num_fields(result_set_.get());
-        fields_info_.reset(new fields_info_type);
+        fields_info_ = std::allocate_shared<fields_info_type>(
+                detail::allocator<fields_info_type>());
         fields_info_->reserve(field_count_);
         detail::field_handle f = nullptr;
 
@@ -125,7 +151,8 @@ public:
 
         while ((r = ops::mysql_fetch_row(mysql, result_set_.get(), ec))) {
             unsigned long* lengths = ops::mysql_fetch_lengths(result_set_.get());
-            values_->push_back(row(result_set_.get(), r, lengths, fields_info_));
+            values_->emplace_back(
+                    result_set_.get(), r, lengths, fields_info_);
         }
 
         if (ec) {
@@ -3,6 +3,7 @@
 
 #include <amy/detail/mysql_ops.hpp>
 
+#include <amy/allocation_accounting.hpp>
 #include <amy/field.hpp>
 #include <amy/field_info.hpp>
 
@@ -10,11 +11,13 @@
 
 namespace amy {
 
-class row {
+class row : private detail::copy_accounted {
 private:
-    typedef std::vector<field> fields_type;
+    typedef std::vector<field, detail::allocator<field>> fields_type;
 
-    typedef std::vector<field_info> fields_info_type;
+    typedef
+        std::vector<field_info, detail::allocator<field_info>>
+        fields_info_type;
 
 public:
     typedef fields_type::const_iterator const_iterator;
@@ -26,7 +29,7 @@ public:
     explicit row(detail::result_set_handle rs,
                  detail::row_type row,
                  unsigned long* lengths,
-                 std::shared_ptr<fields_info_type> fields_info)
+                 std::shared_ptr<fields_info_type> const& fields_info)
       : result_set_(rs),
         row_(row),
         lengths_(lengths),
@@ -0,0 +1,389 @@
+#ifndef __AMY_STATEMENT_DIGEST_HPP__
+#define __AMY_STATEMENT_DIGEST_HPP__
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace amy {
+
+/// The normalized text of a statement and its hash, identifying statements
+/// which only differ by their literals.
+/**
+ * Normalization runs in a single pass without allocating:
+ *
+ * - string, numeric, hexadecimal and bit literals become \c ?,
+ * - parenthesized lists of literals become <tt>(...)</tt>, whatever their
+ *   length, e.g. <tt>IN (1, 2, 3)</tt> and <tt>VALUES ('a')</tt>,
+ * - comments and a trailing \c ; are dropped,
+ * - unquoted words are lower-cased and tokens are separated by a single
+ *   space, except around <tt>( ) , . ;</tt>.
+ *
+ * So <tt>SELECT * FROM t WHERE id IN (1,2) AND name = 'x'</tt> becomes
+ * <tt>select * from t where id in (...) and name = ?</tt>.  The text is
+ * truncated to \c max_size bytes, the hash always covers the whole
+ * normalized statement.
+ */
+class statement_digest {
+public:
+    static const std::size_t max_size = 1024u;
+
+    statement_digest() {
+        clear();
+    }
+
+    explicit statement_digest(std::string const& stmt) {
+        assign(stmt.data(), stmt.size());
+    }
+
+    statement_digest(char const* stmt, std::size_t length) {
+        assign(stmt, length);
+    }
+
+    void assign(char const* stmt, std::size_t length) {
+        clear();
+        pos_ = stmt;
+        end_ = stmt + length;
+
+        while ((pos_ = skip_blank(pos_)) != end_) {
+            char c = *pos_;
+            char const* p = nullptr;
+
+            if (c == '`') {
+                p = skip_quoted(pos_);
+                emit(pos_, p - pos_, true);
+            } else if ((p = literal_end(pos_))) {
+                emit("?", 1u, true);
+            } else if (c == '(' && (p = literal_list_end(pos_))) {
+                emit("(...)", 5u, true);
+            } else if (is_word(c)) {
+                for (p = pos_; p != end_ && is_word(*p); ++p) {}
+                emit_lower(pos_, p - pos_);
+            } else if (c == ';' && skip_blank(pos_ + 1) == end_) {
+                break;
+            } else if (is_one_of(c, "(),.;?")) {
+                p = pos_ + 1;
+                emit(pos_, 1u, c == ')' || c == '?');
+            } else {
+                p = operator_end(pos_);
+                emit(pos_, p - pos_, false);
+            }
+
+            pos_ = p;
+        }
+
+        text_[size_] = '\0';
+        pos_ = end_ = nullptr;
+    }
+
+    /// FNV-1a hash of the whole normalized statement.
+    uint64_t hash() const {
+        return hash_;
+    }
+
+    char const* text() const {
+        return text_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    /// Whether the normalized statement is longer than \c max_size.
+    bool truncated() const {
+        return length_ > size_;
+    }
+
+    friend bool operator==(statement_digest const& lhs,
+                           statement_digest const& rhs)
+    {
+        return lhs.hash_ == rhs.hash_ && lhs.length_ == rhs.length_;
+    }
+
+    friend bool operator!=(statement_digest const& lhs,
+                           statement_digest const& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+private:
+    char text_[max_size + 1u];
+    std::size_t size_;
+    std::size_t length_;
+    uint64_t hash_;
+
+    char const* pos_;
+    char const* end_;
+
+    /// Whether the last token was a value, after which \c - and \c + are
+    /// operators rather than signs.
+    bool after_value_;
+
+    void clear() {
+        text_[0] = '\0';
+        size_ = 0u;
+        length_ = 0u;
+        hash_ = 14695981039346656037ull;
+        pos_ = end_ = nullptr;
+        after_value_ = false;
+    }
+
+    static bool is_space(char c) {
+        return std::isspace(static_cast<unsigned char>(c)) != 0;
+    }
+
+    static bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    /// Identifiers may hold any non-ASCII character.
+    static bool is_word(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) ||
+               c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    static bool is_one_of(char c, char const* chars) {
+        return c != '\0' && std::strchr(chars, c) != nullptr;
+    }
+
+    /// Whether the word of \p n bytes at \p p is a keyword after which a
+    /// \c - or \c + is a sign, e.g. <tt>WHERE a = 1 OR b = -1</tt>.
+    static bool precedes_value(char const* p, std::size_t n) {
+        static char const* const keywords[] = {
+            "and", "between", "by", "case", "div", "else", "in", "interval",
+            "is", "like", "limit", "mod", "not", "offset", "on", "or",
+            "return", "select", "set", "then", "values", "when", "where",
+            "xor"
+        };
+
+        for (char const* keyword : keywords) {
+            std::size_t i = 0;
+
+            while (i < n && keyword[i] != '\0' &&
+                   std::tolower(static_cast<unsigned char>(p[i])) ==
+                   keyword[i])
+            {
+                ++i;
+            }
+
+            if (i == n && keyword[i] == '\0') {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void put(char c) {
+        hash_ = (hash_ ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+
+        if (size_ < max_size) {
+            text_[size_++] = c;
+        }
+
+        ++length_;
+    }
+
+    void separate(char next) {
+        char last = size_ ? text_[size_ - 1u] : '\0';
+
+        if (length_ && last != '(' && last != '.' &&
+            !is_one_of(next, "),.;"))
+        {
+            put(' ');
+        }
+    }
+
+    void emit(char const* token, std::size_t n, bool value) {
+        separate(token[0]);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            put(token[i]);
+        }
+
+        after_value_ = value;
+    }
+
+    void emit_lower(char const* token, std::size_t n) {
+        separate(token[0]);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            put(static_cast<char>(
+                        std::tolower(static_cast<unsigned char>(token[i]))));
+        }
+
+        after_value_ = !precedes_value(token, n);
+    }
+
+    /// Skips whitespace and comments.
+    char const* skip_blank(char const* p) const {
+        while (p != end_) {
+            if (is_space(*p)) {
+                ++p;
+            } else if (*p == '#' ||
+                       (*p == '-' && end_ - p >= 2 && p[1] == '-' &&
+                        (end_ - p == 2 || is_space(p[2]))))
+            {
+                // "--" only starts a comment when followed by a space.
+                while (p != end_ && *p != '\n') {
+                    ++p;
+                }
+            } else if (*p == '/' && end_ - p >= 2 && p[1] == '*') {
+                for (p += 2; p != end_; ++p) {
+                    if (*p == '*' && end_ - p >= 2 && p[1] == '/') {
+                        p += 2;
+                        break;
+                    }
+                }
+            } else {
+                break;
+            }
+        }
+
+        return p;
+    }
+
+    /// Skips a quoted string or identifier starting at \p p.
+    char const* skip_quoted(char const* p) const {
+        char quote = *p;
+
+        for (++p; p != end_; ++p) {
+            if (*p == '\\' && quote != '`') {
+                if (++p == end_) {
+                    break;
+                }
+            } else if (*p == quote) {
+                // A doubled quote stands for itself.
+                if (end_ - p >= 2 && p[1] == quote) {
+                    ++p;
+                } else {
+                    return p + 1;
+                }
+            }
+        }
+
+        return end_;
+    }
+
+    /// Returns the end of the literal starting at \p p, or \c nullptr.
+    char const* literal_end(char const* p) const {
+        char const* q = p;
+
+        if ((*q == '-' || *q == '+') && !after_value_) {
+            ++q;
+        }
+
+        if (q == end_) {
+            return nullptr;
+        }
+
+        if (*q == '\'' || *q == '"') {
+            return skip_quoted(q);
+        }
+
+        // X'...', B'...' and N'...' literals.
+        if (q == p && end_ - q >= 2 && q[1] == '\'' &&
+            is_one_of(*q, "xXbBnN"))
+        {
+            return skip_quoted(q + 1);
+        }
+
+        if (!is_digit(*q) && !(*q == '.' && end_ - q >= 2 && is_digit(q[1]))) {
+            return nullptr;
+        }
+
+        if (*q == '0' && end_ - q >= 2 && is_one_of(q[1], "xXbB")) {
+            for (q += 2; q != end_ && std::isalnum(
+                        static_cast<unsigned char>(*q)); ++q) {}
+            return q;
+        }
+
+        while (q != end_ && is_digit(*q)) {
+            ++q;
+        }
+
+        if (q != end_ && *q == '.') {
+            for (++q; q != end_ && is_digit(*q); ++q) {}
+        }
+
+        if (q != end_ && (*q == 'e' || *q == 'E')) {
+            char const* e = q + 1;
+
+            if (e != end_ && (*e == '-' || *e == '+')) {
+                ++e;
+            }
+
+            if (e != end_ && is_digit(*e)) {
+                for (q = e; q != end_ && is_digit(*q); ++q) {}
+            }
+        }
+
+        // Identifiers may start with digits, e.g. 1st_column.
+        if (q != end_ && is_word(*q)) {
+            return nullptr;
+        }
+
+        return q;
+    }
+
+    /// Returns the end of the list of literals opened at \p p, or \c
+    /// nullptr.
+    char const* literal_list_end(char const* p) {
+        bool after_value = after_value_;
+        char const* q = skip_blank(p + 1);
+        char const* result = nullptr;
+
+        for (;;) {
+            after_value_ = false;
+
+            char const* e = q != end_ ? literal_end(q) : nullptr;
+
+            if (!e) {
+                break;
+            }
+
+            q = skip_blank(e);
+
+            if (q != end_ && *q == ',') {
+                q = skip_blank(q + 1);
+            } else {
+                if (q != end_ && *q == ')') {
+                    result = q + 1;
+                }
+
+                break;
+            }
+        }
+
+        after_value_ = after_value;
+        return result;
+    }
+
+    /// Returns the end of the operator starting at \p p, e.g. \c <= or \c
+    /// <>, stopping before the sign of a literal.
+    char const* operator_end(char const* p) const {
+        char const* q = p + 1;
+
+        while (q != end_ && !is_space(*q) && !is_word(*q) &&
+               !is_one_of(*q, "(),.;?`'\"#"))
+        {
+            if ((*q == '-' || *q == '+') && end_ - q >= 2 &&
+                (is_digit(q[1]) || q[1] == '.' || q[1] == '-'))
+            {
+                break;
+            }
+
+            ++q;
+        }
+
+        return q;
+    }
+
+}; // class statement_digest
+
+} // namespace amy
+
+#endif // __AMY_STATEMENT_DIGEST_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,460 @@
+#ifndef __AMY_WORKLOAD_CAPTURE_HPP__
+#define __AMY_WORKLOAD_CAPTURE_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/query_trace.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace amy {
+
+/// A statement of a captured workload.
+struct workload_record {
+    typedef std::chrono::nanoseconds duration;
+
+    workload_record() :
+        connection(0u),
+        issued(duration::zero()),
+        latency(duration::zero()),
+        rows(0u),
+        fields(0u),
+        error(0)
+    {}
+
+    /// Identifies the connection of the statement within the capture.
+    uint64_t connection;
+
+    std::string statement;
+
+    /// Time from starting the capture to issuing the statement.
+    duration issued;
+
+    /// Time from issuing the statement to running its handler.
+    duration latency;
+
+    uint64_t rows;
+    uint32_t fields;
+
+    /// The value of the error code of the statement, 0 on success.
+    int error;
+
+}; // struct workload_record
+
+namespace detail {
+
+/// The wire format of captures, in which integers are LEB128 encoded and
+/// signed ones zigzag encoded first:
+///
+/// - a header, \c magic followed by \c version,
+/// - then records, each starting with a \c record_tag:
+///   - \c define_statement, the length and bytes of a statement text, which
+///     takes the next identifier from 0 up,
+///   - \c execute_statement, the identifier of its text, then the connection,
+///     issue time and latency in nanoseconds, rows, fields and error,
+///   - \c reset_statements, forgetting all the statement texts defined.
+struct workload_format {
+    static char const* magic() {
+        return "AMYW";
+    }
+
+    enum {
+        magic_size = 4,
+        version = 1
+    };
+
+    enum record_tag {
+        define_statement = 1,
+        execute_statement = 2,
+        reset_statements = 3
+    };
+
+    static void put(std::string& out, uint64_t n) {
+        while (n >= 0x80u) {
+            out.push_back(static_cast<char>((n & 0x7fu) | 0x80u));
+            n >>= 7;
+        }
+
+        out.push_back(static_cast<char>(n));
+    }
+
+    static void put_signed(std::string& out, int64_t n) {
+        put(out, (static_cast<uint64_t>(n) << 1) ^
+                 static_cast<uint64_t>(n >> 63));
+    }
+
+    static bool get(std::istream& in, uint64_t& n) {
+        n = 0u;
+
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = in.get();
+
+            if (c == std::char_traits<char>::eof()) {
+                return false;
+            }
+
+            n |= static_cast<uint64_t>(c & 0x7f) << shift;
+
+            if (!(c & 0x80)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static bool get_signed(std::istream& in, int64_t& n) {
+        uint64_t u;
+
+        if (!get(in, u)) {
+            return false;
+        }
+
+        n = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1u);
+        return true;
+    }
+
+}; // struct workload_format
+
+} // namespace detail
+
+/// Writes the statements traced by \c recording_observer to a stream, so
+/// that \c workload_reader may read them back, e.g. to replay them.
+/**
+ * Captures are compact: each distinct statement text is written once and
+ * referred to by a small identifier afterwards.  Once \c capacity distinct
+ * texts are known, the recorder forgets them all and starts over, so that
+ * its memory stays bounded whatever the variety of statements.
+ *
+ * Records are appended to a buffer, which is written out in chunks once it
+ * holds \c chunk_size bytes, or once \c interval elapsed since the last
+ * write.  The thread recording at that point writes the chunk without
+ * holding the lock, so that the others keep recording meanwhile.  \c flush
+ * writes out the rest, as does the destructor.
+ *
+ * The recorder is thread safe.  Write errors do not throw, since they would
+ * escape from completion handlers, but leave the stream failed, see \c
+ * good().
+ */
+class workload_recorder : private detail::noncopyable {
+public:
+    typedef query_trace::clock_type clock_type;
+
+    /// \p out must outlive the recorder, and be opened in binary mode.
+    explicit workload_recorder(
+            std::ostream& out,
+            std::size_t capacity = 4096u,
+            std::size_t chunk_size = 64u * 1024u,
+            clock_type::duration interval = std::chrono::seconds(1)) :
+        out_(out),
+        capacity_(capacity),
+        chunk_size_(chunk_size),
+        interval_(interval),
+        started_(clock_type::now()),
+        connections_(0u),
+        written_(started_),
+        writing_(false),
+        good_(out.good())
+    {
+        buffer_.append(detail::workload_format::magic(),
+                       detail::workload_format::magic_size);
+        detail::workload_format::put(buffer_,
+                                     detail::workload_format::version);
+    }
+
+    ~workload_recorder() {
+        flush();
+    }
+
+    /// The time issue times are relative to.
+    clock_type::time_point started() const {
+        return started_;
+    }
+
+    /// Identifies a new connection, from 1.
+    uint64_t next_connection() {
+        return connections_.fetch_add(1u, std::memory_order_relaxed) + 1u;
+    }
+
+    void record(uint64_t connection, query_trace const& trace) {
+        typedef detail::workload_format format;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto it = statements_.find(trace.statement);
+
+        if (it == statements_.end()) {
+            if (statements_.size() >= capacity_) {
+                statements_.clear();
+                buffer_.push_back(format::reset_statements);
+            }
+
+            uint64_t id = statements_.size();
+            it = statements_.emplace(trace.statement, id).first;
+
+            buffer_.push_back(format::define_statement);
+            format::put(buffer_, trace.statement.size());
+            buffer_.append(trace.statement);
+        }
+
+        buffer_.push_back(format::execute_statement);
+        format::put(buffer_, it->second);
+        format::put(buffer_, connection);
+        format::put(buffer_, nanoseconds(trace.issued - started_));
+        format::put(buffer_, nanoseconds(trace.total()));
+        format::put(buffer_, trace.rows);
+        format::put(buffer_, trace.fields);
+        format::put_signed(buffer_, trace.ec.value());
+
+        // Another thread may be writing already, in which case it writes
+        // this record as well if the buffer fills up meanwhile.
+        if (writing_ ||
+            (buffer_.size() < chunk_size_ &&
+             clock_type::now() - written_ < interval_))
+        {
+            return;
+        }
+
+        writing_ = true;
+        write(lock, chunk_size_, false);
+    }
+
+    bool good() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return good_;
+    }
+
+    /// Writes out the records buffered so far, and flushes the stream.
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return !writing_; });
+
+        writing_ = true;
+        write(lock, 1u, true);
+    }
+
+private:
+    std::ostream& out_;
+    std::size_t capacity_;
+    std::size_t chunk_size_;
+    clock_type::duration interval_;
+    clock_type::time_point started_;
+    std::atomic<uint64_t> connections_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, uint64_t> statements_;
+    std::string buffer_;
+
+    /// Time of the last write.
+    clock_type::time_point written_;
+
+    /// Whether a thread is writing to \c out_, which no other thread may
+    /// touch meanwhile.
+    bool writing_;
+
+    bool good_;
+
+    /// Signaled once the writing thread is done.
+    std::condition_variable idle_;
+
+    static uint64_t nanoseconds(clock_type::duration d) {
+        int64_t n = std::chrono::duration_cast<
+            std::chrono::nanoseconds>(d).count();
+        return n > 0 ? static_cast<uint64_t>(n) : 0u;
+    }
+
+    /// Writes out the buffer, then again as long as it holds \p threshold
+    /// bytes or more.
+    /**
+     * Called by the writing thread with \p lock held, which is released
+     * while writing.
+     */
+    void write(std::unique_lock<std::mutex>& lock,
+               std::size_t threshold,
+               bool flush_stream)
+    {
+        std::string chunk;
+
+        do {
+            chunk.swap(buffer_);
+            lock.unlock();
+
+            out_.write(chunk.data(), chunk.size());
+            chunk.clear();
+
+            lock.lock();
+        } while (buffer_.size() >= threshold);
+
+        if (flush_stream) {
+            lock.unlock();
+            out_.flush();
+            lock.lock();
+        }
+
+        good_ = out_.good();
+        written_ = clock_type::now();
+        writing_ = false;
+        idle_.notify_all();
+    }
+
+}; // class workload_recorder
+
+/// An observer of \c basic_connector capturing its statements into a \c
+/// workload_recorder.
+/**
+ * Each observer stands for a connection of the capture, so that replaying
+ * it runs as many connections as were captured.
+ *
+ * \code
+ * std::ofstream out("workload.amyw", std::ios::binary);
+ * amy::workload_recorder recorder(out);
+ *
+ * amy::basic_connector<amy::mysql_service, amy::recording_observer> connector(
+ *         io_service, amy::recording_observer(recorder));
+ * \endcode
+ */
+class recording_observer {
+public:
+    /// \p recorder must outlive the observer.
+    explicit recording_observer(workload_recorder& recorder) :
+        recorder_(&recorder),
+        connection_(recorder.next_connection())
+    {}
+
+    uint64_t connection() const {
+        return connection_;
+    }
+
+    void operator()(query_trace const& trace) const {
+        recorder_->record(connection_, trace);
+    }
+
+private:
+    workload_recorder* recorder_;
+    uint64_t connection_;
+
+}; // class recording_observer
+
+/// Reads back the statements written by \c workload_recorder, in the order
+/// they completed.
+class workload_reader : private detail::noncopyable {
+public:
+    /// \p in must outlive the reader, and be opened in binary mode.
+    /**
+     * Statement texts longer than \p max_statement_size bytes are taken for
+     * corruption, rather than allocated.  The default matches the largest \c
+     * max_allowed_packet of the server.
+     *
+     * \throw std::runtime_error if \p in does not hold a capture.
+     */
+    explicit workload_reader(std::istream& in,
+                             std::size_t max_statement_size = 1u << 30) :
+        in_(in),
+        max_statement_size_(max_statement_size)
+    {
+        typedef detail::workload_format format;
+
+        char magic[format::magic_size];
+        uint64_t version = 0u;
+
+        if (!in_.read(magic, format::magic_size) ||
+            std::string(magic, format::magic_size) != format::magic() ||
+            !format::get(in_, version))
+        {
+            throw std::runtime_error("not a workload capture");
+        }
+
+        if (version != format::version) {
+            throw std::runtime_error("unsupported workload capture version " +
+                                     std::to_string(version));
+        }
+    }
+
+    /// Reads the next statement into \p record.
+    /**
+     * \return false at the end of the capture.
+     *
+     * \throw std::runtime_error if the capture is corrupted.
+     */
+    bool next(workload_record& record) {
+        typedef detail::workload_format format;
+
+        for (;;) {
+            int tag = in_.get();
+
+            if (tag == std::char_traits<char>::eof()) {
+                return false;
+            }
+
+            switch (tag) {
+            case format::define_statement: {
+                uint64_t size = 0u;
+                require(format::get(in_, size) &&
+                        size <= max_statement_size_);
+
+                std::string text(static_cast<std::size_t>(size), '\0');
+                require(!!in_.read(&text[0], text.size()));
+                statements_.push_back(std::move(text));
+                break;
+            }
+
+            case format::reset_statements:
+                statements_.clear();
+                break;
+
+            case format::execute_statement: {
+                uint64_t id = 0u;
+                uint64_t issued = 0u;
+                uint64_t latency = 0u;
+                uint64_t fields = 0u;
+                int64_t error = 0;
+
+                require(format::get(in_, id) && id < statements_.size());
+                require(format::get(in_, record.connection) &&
+                        format::get(in_, issued) &&
+                        format::get(in_, latency) &&
+                        format::get(in_, record.rows) &&
+                        format::get(in_, fields) &&
+                        format::get_signed(in_, error));
+
+                record.statement = statements_[id];
+                record.issued = workload_record::duration(issued);
+                record.latency = workload_record::duration(latency);
+                record.fields = static_cast<uint32_t>(fields);
+                record.error = static_cast<int>(error);
+                return true;
+            }
+
+            default:
+                require(false);
+            }
+        }
+    }
+
+private:
+    std::istream& in_;
+    std::size_t max_statement_size_;
+    std::vector<std::string> statements_;
+
+    static void require(bool condition) {
+        if (!condition) {
+            throw std::runtime_error("corrupted workload capture");
+        }
+    }
+
+}; // class workload_reader
+
+} // namespace amy
+
+#endif // __AMY_WORKLOAD_CAPTURE_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
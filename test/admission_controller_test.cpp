@@ -0,0 +1,151 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/admission_controller.hpp>
+#include <amy/connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct admission_controller_test {
+    std::size_t succeeded = 0;
+    std::size_t rejected = 0;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set)
+    {
+        if (ec == amy::error::busy) {
+            ++rejected;
+        } else {
+            BOOST_CHECK(!ec);
+            ++succeeded;
+        }
+    }
+
+    void query(amy::admission_controller& controller,
+               amy::query_queue& queue)
+    {
+        controller.async_query_result(
+                queue,
+                "SELECT 1",
+                std::bind(&admission_controller_test::handle_query_result,
+                          this,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+}; // struct admission_controller_test
+
+namespace {
+
+/// A target holding on to its statements, so that they stay in flight.
+struct pending_target {
+    typedef std::function<void (AMY_SYSTEM_NS::error_code const&,
+                                amy::result_set)> handler_type;
+
+    std::vector<handler_type> handlers;
+
+    template<typename QueryResultHandler>
+    void async_query_result(std::string const&, QueryResultHandler handler) {
+        handlers.push_back(handler);
+    }
+
+}; // struct pending_target
+
+/// Admits statements up to the limit, which only grows while at least half
+/// of it is in use.
+void fill(amy::admission_controller& controller, pending_target& target) {
+    while (controller.in_flight() < controller.limit()) {
+        controller.async_query_result(
+                target,
+                "SELECT 1",
+                [](AMY_SYSTEM_NS::error_code const&, amy::result_set) {});
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_reject_queries_beyond_the_limit) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector c(io_service);
+
+    c.connect(amy::null_endpoint(),
+              amy::auth_info("amy", "amy"),
+              "test_amy",
+              amy::default_flags);
+
+    amy::query_queue queue(c);
+    amy::admission_controller controller(io_service, 2, 1, 2);
+    controller.max_queued(1);
+
+    admission_controller_test fixture;
+
+    for (int i = 0; i < 5; ++i) {
+        fixture.query(controller, queue);
+    }
+
+    BOOST_CHECK_EQUAL(2u, controller.in_flight());
+    BOOST_CHECK_EQUAL(1u, controller.queued());
+
+    io_service.run();
+
+    BOOST_CHECK_EQUAL(3u, fixture.succeeded);
+    BOOST_CHECK_EQUAL(2u, fixture.rejected);
+    BOOST_CHECK_EQUAL(2u, controller.rejected());
+    BOOST_CHECK_EQUAL(0u, controller.in_flight());
+}
+
+BOOST_AUTO_TEST_CASE(should_adapt_the_limit_to_latency_samples) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::admission_controller controller(io_service, 16, 4, 256);
+    pending_target target;
+
+    AMY_SYSTEM_NS::error_code ok;
+    std::chrono::milliseconds fast(1);
+    std::chrono::milliseconds slow(10);
+
+    // Grows while latency stays flat and the limit is in use.
+    std::size_t limit = controller.limit();
+
+    for (int i = 0; i < 20; ++i) {
+        fill(controller, target);
+        controller.record(ok, fast);
+    }
+
+    BOOST_CHECK_GT(controller.limit(), limit);
+    BOOST_CHECK_LE(controller.limit(), 256u);
+
+    // Shrinks once latency rises.
+    limit = controller.limit();
+
+    for (int i = 0; i < 20; ++i) {
+        controller.record(ok, slow);
+    }
+
+    BOOST_CHECK_LT(controller.limit(), limit);
+
+    // Statement errors, e.g. a duplicate key or a failed CHECK constraint, leave
+    // the limit alone, whatever their number.
+    limit = controller.limit();
+
+    for (int value : { 1062, 3819, 4025 }) {
+        controller.record(AMY_SYSTEM_NS::error_code(
+                              value, amy::error::get_client_category()),
+                          fast);
+        BOOST_CHECK_EQUAL(controller.limit(), limit);
+    }
+
+    // Halves on connection-level failures, down to the minimum.
+    controller.record(amy::error::server_lost, fast);
+    BOOST_CHECK_EQUAL(controller.limit(), limit / 2u);
+
+    for (int i = 0; i < 10; ++i) {
+        controller.record(amy::error::server_lost, fast);
+    }
+
+    BOOST_CHECK_EQUAL(controller.limit(), 4u);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
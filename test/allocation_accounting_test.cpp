@@ -0,0 +1,162 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/allocation_accounting.hpp>
+#include <amy/auth_info.hpp>
+#include <amy/connector.hpp>
+#include <amy/result_set.hpp>
+
+#include <functional>
+#include <vector>
+
+using amy::test::fake_result;
+using amy::test::fake_row;
+using amy::test::fake_server;
+
+namespace {
+
+const std::size_t rows = 100u;
+
+fake_result generated_rows() {
+    return fake_result::rows({ "a", "b", "c" }, rows,
+                             [](std::size_t n, fake_row& row) {
+                                 row.set(0, n);
+                                 row.set(1, "b");
+                                 row.set(2, 2.5);
+                             });
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_be_enabled_for_the_tests) {
+    BOOST_REQUIRE(amy::allocation_scope::enabled());
+}
+
+BOOST_AUTO_TEST_CASE(should_count_allocations_in_nested_scopes) {
+    amy::allocation_counters outer;
+    amy::allocation_counters inner;
+
+    {
+        amy::allocation_scope outer_scope(outer);
+        std::vector<int, amy::accounting_allocator<int>> v;
+        v.reserve(4u);
+
+        {
+            amy::allocation_scope inner_scope(inner);
+            std::vector<int, amy::accounting_allocator<int>> w;
+            w.reserve(2u);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(inner.allocations, 1u);
+    BOOST_CHECK_EQUAL(inner.deallocations, 1u);
+    BOOST_CHECK_EQUAL(inner.bytes, 2u * sizeof(int));
+
+    BOOST_CHECK_EQUAL(outer.allocations, 2u);
+    BOOST_CHECK_EQUAL(outer.deallocations, 2u);
+    BOOST_CHECK_EQUAL(outer.bytes, 6u * sizeof(int));
+}
+
+BOOST_AUTO_TEST_CASE(should_count_nothing_outside_of_scopes) {
+    amy::allocation_counters counters;
+
+    {
+        amy::allocation_scope scope(counters);
+    }
+
+    amy::result_set rs;
+    amy::result_set copy(rs);
+
+    BOOST_CHECK_EQUAL(counters.allocations, 0u);
+    BOOST_CHECK_EQUAL(counters.copies, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(should_count_the_allocations_of_an_empty_result_set) {
+    amy::allocation_counters counters;
+
+    {
+        amy::allocation_scope scope(counters);
+        amy::result_set rs;
+    }
+
+    // One allocation for the rows and the control block, and one for the
+    // fields information.
+    BOOST_CHECK_EQUAL(counters.allocations, 2u);
+    BOOST_CHECK_EQUAL(counters.deallocations, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(should_count_copies) {
+    amy::result_set rs;
+    amy::auth_info auth("amy", "amy");
+    amy::allocation_counters counters;
+
+    {
+        amy::allocation_scope scope(counters);
+        amy::result_set rs_copy(rs);
+        amy::auth_info auth_copy(auth);
+    }
+
+    BOOST_CHECK_EQUAL(counters.copies, 2u);
+    BOOST_CHECK_EQUAL(counters.allocations, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(should_allocate_once_per_row_when_storing_a_result) {
+    fake_server server(generated_rows());
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connector.connect(server.endpoint(), amy::auth_info("amy", "amy"), "",
+                      amy::default_flags);
+
+    amy::allocation_counters counters;
+    amy::result_set rs;
+
+    {
+        amy::allocation_scope scope(counters);
+        rs = connector.query_result("SELECT a, b, c FROM t");
+    }
+
+    BOOST_REQUIRE_EQUAL(rs.size(), rows);
+
+    // The fields of each row, the vectors of rows and of fields information,
+    // and the result set itself.
+    BOOST_CHECK_EQUAL(counters.allocations, rows + 5u);
+}
+
+BOOST_AUTO_TEST_CASE(should_account_allocations_to_the_observed_statement) {
+    typedef std::function<void (amy::query_trace const&)> observer_type;
+
+    fake_server server(generated_rows());
+
+    amy::allocation_counters allocations;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::basic_connector<amy::mysql_service, observer_type> connector(
+            io_service,
+            [&](amy::query_trace const& trace) {
+                allocations = trace.allocations;
+            });
+    connector.connect(server.endpoint(), amy::auth_info("amy", "amy"), "",
+                      amy::default_flags);
+
+    bool handled = false;
+
+    connector.async_query_result(
+            "SELECT a, b, c FROM t",
+            [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(rs.size(), rows);
+                handled = true;
+            });
+
+    io_service.run();
+
+    BOOST_REQUIRE(handled);
+    BOOST_CHECK_EQUAL(allocations.allocations, rows + 5u);
+    BOOST_CHECK_GE(allocations.copies, 1u);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,68 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+
+struct connector_group_test {
+    static const int queries = 64;
+
+    std::atomic<int> remaining{queries};
+    std::atomic<int> failures{0};
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::promise<void> done;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set rs)
+    {
+        if (ec || rs[0][0].as<amy::sql_bigint>() != 1) {
+            ++failures;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        }
+
+        if (--remaining == 0) {
+            done.set_value();
+        }
+    }
+
+}; // struct connector_group_test
+
+BOOST_AUTO_TEST_CASE(should_run_queries_on_all_shards) {
+    connector_group_test fixture;
+    amy::connector_group group(2, 2);
+
+    group.connect(amy::null_endpoint(),
+                  amy::auth_info("amy", "amy"),
+                  "test_amy",
+                  amy::default_flags);
+    group.run();
+
+    for (int i = 0; i < connector_group_test::queries; ++i) {
+        group.async_query_result(
+                "SELECT 1",
+                std::bind(&connector_group_test::handle_query_result,
+                          &fixture,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+    fixture.done.get_future().wait();
+    group.stop();
+
+    BOOST_CHECK_EQUAL(0, fixture.failures.load());
+    BOOST_CHECK_EQUAL(0u, group.load(0));
+    BOOST_CHECK_EQUAL(0u, group.load(1));
+    BOOST_CHECK_EQUAL(2u, fixture.threads.size());
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
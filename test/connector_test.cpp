@@ -4,6 +4,9 @@
 
 #include <amy/connector.hpp>
 
+#include <functional>
+#include <vector>
+
 BOOST_AUTO_TEST_CASE(should_construct_a_connector_instance) {
     AMY_ASIO_NS::io_service io_service;
     amy::connector connector(io_service);
@@ -28,4 +31,81 @@ BOOST_AUTO_TEST_CASE(should_be_closed_successfully) {
     BOOST_CHECK(!connector.is_open());
 }
 
+BOOST_AUTO_TEST_CASE(should_replay_idempotent_query_after_reconnect) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::auth_info auth("amy", "amy");
+
+    amy::connector connector(io_service);
+    connector.set_reconnect_policy(amy::reconnect_policy(3));
+    connector.connect(amy::null_endpoint(), auth, "test_amy",
+                      amy::default_flags);
+
+    amy::sql_bigint id = connector.query_result("SELECT CONNECTION_ID()")
+        [0][0].as<amy::sql_bigint>();
+
+    amy::connector killer(io_service);
+    killer.connect(amy::null_endpoint(), auth, "test_amy",
+                   amy::default_flags);
+    killer.query("KILL " + std::to_string(id));
+
+    AMY_SYSTEM_NS::error_code query_ec;
+    amy::sql_bigint new_id = id;
+
+    connector.async_query_result(
+            amy::idempotent("SELECT CONNECTION_ID()"),
+            [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+                query_ec = ec;
+
+                if (!ec) {
+                    new_id = rs[0][0].as<amy::sql_bigint>();
+                }
+            });
+
+    io_service.run();
+
+    BOOST_CHECK(!query_ec);
+    BOOST_CHECK_NE(id, new_id);
+}
+
+BOOST_AUTO_TEST_CASE(should_trace_the_phases_of_an_observed_query) {
+    typedef std::function<void (amy::query_trace const&)> observer_type;
+
+    std::vector<amy::query_trace> traces;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::basic_connector<amy::mysql_service, observer_type> connector(
+            io_service,
+            [&](amy::query_trace const& trace) { traces.push_back(trace); });
+
+    connector.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"),
+                      "test_amy", amy::default_flags);
+
+    bool handled = false;
+
+    connector.async_query_result(
+            "SELECT 1 UNION ALL SELECT 2",
+            [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(traces.size(), 1u);
+                handled = true;
+            });
+
+    io_service.run();
+
+    BOOST_REQUIRE(handled);
+
+    amy::query_trace const& trace = traces.front();
+    BOOST_CHECK_EQUAL(trace.statement_id, 1u);
+    BOOST_CHECK_EQUAL(trace.statement, "SELECT 1 UNION ALL SELECT 2");
+    BOOST_CHECK_EQUAL(trace.rows, 2u);
+    BOOST_CHECK(!trace.ec);
+
+    for (int p = 0; p < amy::query_trace::phase_count; ++p) {
+        amy::query_trace::phase phase = static_cast<amy::query_trace::phase>(p);
+        BOOST_CHECK(trace.reached(phase));
+        BOOST_CHECK(trace.duration(phase) >=
+                    amy::query_trace::clock_type::duration::zero());
+    }
+}
+
 // vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,873 @@
+#ifndef __AMY_TEST_FAKE_SERVER_HPP__
+#define __AMY_TEST_FAKE_SERVER_HPP__
+
+#include <amy/detail/noncopyable.hpp>
+
+#include <amy/asio.hpp>
+
+#if !defined(USE_BOOST_ASIO) || (USE_BOOST_ASIO == 0)
+#include <asio/read.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/write.hpp>
+#else
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace amy {
+namespace test {
+
+/// A column of a fake result set.
+struct fake_column {
+    /// \p type is a \c MYSQL_TYPE_* value, \c MYSQL_TYPE_VAR_STRING by
+    /// default.
+    fake_column(std::string name, unsigned char type = 0xfd) :
+        name(std::move(name)),
+        type(type)
+    {}
+
+    fake_column(char const* name, unsigned char type = 0xfd) :
+        name(name),
+        type(type)
+    {}
+
+    std::string name;
+    unsigned char type;
+
+}; // struct fake_column
+
+/// The values of a generated row, all \c NULL until set.
+class fake_row {
+public:
+    explicit fake_row(std::size_t columns) :
+        values_(columns),
+        nulls_(columns, true)
+    {}
+
+    std::size_t size() const {
+        return values_.size();
+    }
+
+    void set(std::size_t column, char const* value, std::size_t length) {
+        values_[column].assign(value, length);
+        nulls_[column] = false;
+    }
+
+    void set(std::size_t column, std::string const& value) {
+        set(column, value.data(), value.size());
+    }
+
+    void set(std::size_t column, char const* value) {
+        set(column, std::string(value));
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type
+    set(std::size_t column, T value) {
+        set(column, std::to_string(value));
+    }
+
+    void set_null(std::size_t column) {
+        nulls_[column] = true;
+    }
+
+    bool is_null(std::size_t column) const {
+        return nulls_[column];
+    }
+
+    std::string const& value(std::size_t column) const {
+        return values_[column];
+    }
+
+    /// Sets all the values back to \c NULL, keeping their buffers.
+    void clear() {
+        nulls_.assign(nulls_.size(), true);
+    }
+
+private:
+    std::vector<std::string> values_;
+    std::vector<bool> nulls_;
+
+}; // class fake_row
+
+/// One result of a statement: an OK packet, an error or a result set.
+struct fake_result {
+    /// Fills in row \p n of a result set, called once per row while the
+    /// result set is being sent.
+    typedef std::function<void (std::size_t n, fake_row& row)> row_generator;
+
+    enum kind_type {
+        ok_packet,
+        error_packet,
+        result_set
+    };
+
+    static fake_result ok(uint64_t affected_rows = 0u,
+                          uint64_t insert_id = 0u)
+    {
+        fake_result r(ok_packet);
+        r.affected_rows = affected_rows;
+        r.insert_id = insert_id;
+        return r;
+    }
+
+    static fake_result error(unsigned int code,
+                             std::string message,
+                             std::string sqlstate = "HY000")
+    {
+        fake_result r(error_packet);
+        r.error_code = code;
+        r.message = std::move(message);
+        r.sqlstate = std::move(sqlstate);
+        return r;
+    }
+
+    /// A result set of \p row_count rows, each filled in by \p generator, so
+    /// that large result sets cost no memory.
+    static fake_result rows(std::vector<fake_column> columns,
+                            std::size_t row_count,
+                            row_generator generator)
+    {
+        fake_result r(result_set);
+        r.columns = std::move(columns);
+        r.row_count = row_count;
+        r.generator = std::move(generator);
+        return r;
+    }
+
+    /// A result set of the given rows, without \c NULL values.
+    static fake_result rows(
+            std::vector<fake_column> columns,
+            std::vector<std::vector<std::string>> const& values)
+    {
+        auto table =
+            std::make_shared<std::vector<std::vector<std::string>>>(values);
+
+        return rows(std::move(columns), values.size(),
+                    [table](std::size_t n, fake_row& row) {
+                        std::vector<std::string> const& r = (*table)[n];
+
+                        for (std::size_t i = 0; i < r.size(); ++i) {
+                            row.set(i, r[i]);
+                        }
+                    });
+    }
+
+    kind_type kind;
+
+    uint64_t affected_rows;
+    uint64_t insert_id;
+
+    unsigned int error_code;
+    std::string message;
+    std::string sqlstate;
+
+    std::vector<fake_column> columns;
+    std::size_t row_count;
+    row_generator generator;
+
+private:
+    explicit fake_result(kind_type kind) :
+        kind(kind),
+        affected_rows(0u),
+        insert_id(0u),
+        error_code(0u),
+        row_count(0u)
+    {}
+
+}; // struct fake_result
+
+/// The reply to a query: one result per statement of the query, and how
+/// long to wait before replying.
+struct fake_response {
+    typedef std::chrono::nanoseconds duration;
+
+    fake_response() :
+        latency(duration::zero())
+    {}
+
+    fake_response(fake_result result,
+                  duration latency = duration::zero()) :
+        results(1u, std::move(result)),
+        latency(latency)
+    {}
+
+    fake_response(std::vector<fake_result> results,
+                  duration latency = duration::zero()) :
+        results(std::move(results)),
+        latency(latency)
+    {}
+
+    /// Sent as a multi-result reply, which stops at the first error.  No
+    /// result at all is sent as a single OK packet.
+    std::vector<fake_result> results;
+
+    /// Simulated server time, during which the connection waits without
+    /// holding up the other connections.
+    duration latency;
+
+}; // struct fake_response
+
+/// An in-process server speaking enough of the MySQL client/server protocol
+/// to run tests and benchmarks without a database.
+/**
+ * The server listens on a loopback port, ephemeral unless given, and runs
+ * its own \c io_service on a thread of its own.  It accepts any user and
+ * password, and answers each \c COM_QUERY with the \c fake_response returned
+ * by the handler for the query text.  Multi-statement queries reach the
+ * handler as a whole, which replies with one result per statement.
+ *
+ * Only the text protocol is supported: \c COM_QUERY, \c COM_PING, \c
+ * COM_INIT_DB, \c COM_SET_OPTION and \c COM_QUIT.  Other commands, like
+ * prepared statements, fail with \c ER_UNKNOWN_COM_ERROR.  TLS and
+ * compression are not offered to clients.
+ *
+ * \code
+ * amy::test::fake_server server(
+ *         [](std::string const& query) -> amy::test::fake_response {
+ *             return amy::test::fake_result::rows(
+ *                     { "n" }, 1000u,
+ *                     [](std::size_t n, amy::test::fake_row& row) {
+ *                         row.set(0, n);
+ *                     });
+ *         });
+ *
+ * connector.connect(server.endpoint(), amy::auth_info("amy", "amy"), "",
+ *                   amy::default_flags);
+ * \endcode
+ *
+ * The handler runs on the thread of the server, one query at a time.
+ */
+class fake_server : private detail::noncopyable {
+public:
+    typedef std::function<fake_response (std::string const& query)>
+        handler_type;
+
+    typedef AMY_ASIO_NS::ip::tcp::endpoint endpoint_type;
+
+    explicit fake_server(handler_type handler, unsigned short port = 0u) :
+        handler_(std::move(handler)),
+        acceptor_(io_service_,
+                  endpoint_type(AMY_ASIO_NS::ip::address_v4::loopback(),
+                                port)),
+        connections_(0u),
+        queries_(0u)
+    {
+        accept();
+        thread_ = std::thread([this] { io_service_.run(); });
+    }
+
+    /// Replies to every query with \p response.
+    explicit fake_server(fake_response response, unsigned short port = 0u) :
+        fake_server([response](std::string const&) { return response; },
+                    port)
+    {}
+
+    /// Drops all the connections.
+    ~fake_server() {
+        io_service_.stop();
+        thread_.join();
+    }
+
+    endpoint_type endpoint() const {
+        return acceptor_.local_endpoint();
+    }
+
+    /// Number of connections accepted so far.
+    uint64_t connections() const {
+        return connections_.load(std::memory_order_relaxed);
+    }
+
+    /// Number of queries received so far.
+    uint64_t queries() const {
+        return queries_.load(std::memory_order_relaxed);
+    }
+
+private:
+    class session;
+
+    AMY_ASIO_NS::io_service io_service_;
+    handler_type handler_;
+    AMY_ASIO_NS::ip::tcp::acceptor acceptor_;
+    std::atomic<uint64_t> connections_;
+    std::atomic<uint64_t> queries_;
+    std::thread thread_;
+
+    void accept();
+
+}; // class fake_server
+
+/// A client connection of \c fake_server.
+class fake_server::session : public std::enable_shared_from_this<session> {
+public:
+    session(fake_server& server, uint32_t id) :
+        server_(server),
+        socket_(server.io_service_),
+        timer_(server.io_service_),
+        id_(id),
+        state_(handshake),
+        sequence_(0u),
+        client_flags_(0u)
+    {}
+
+    AMY_ASIO_NS::ip::tcp::socket& socket() {
+        return socket_;
+    }
+
+    void start() {
+        socket_.set_option(AMY_ASIO_NS::ip::tcp::no_delay(true));
+        write_handshake();
+        send();
+    }
+
+private:
+    enum state_type {
+        handshake,
+        auth_switch,
+        command
+    };
+
+    // Protocol constants, spelled out so that the server does not depend on
+    // the headers of a client library.
+    enum {
+        client_long_password = 0x00000001,
+        client_found_rows = 0x00000002,
+        client_long_flag = 0x00000004,
+        client_connect_with_db = 0x00000008,
+        client_protocol_41 = 0x00000200,
+        client_transactions = 0x00002000,
+        client_secure_connection = 0x00008000,
+        client_multi_statements = 0x00010000,
+        client_multi_results = 0x00020000,
+        client_ps_multi_results = 0x00040000,
+        client_plugin_auth = 0x00080000,
+        client_connect_attrs = 0x00100000,
+        client_plugin_auth_lenenc_client_data = 0x00200000
+    };
+
+    enum {
+        server_status_autocommit = 0x0002,
+        server_more_results_exists = 0x0008
+    };
+
+    enum {
+        com_quit = 0x01,
+        com_init_db = 0x02,
+        com_query = 0x03,
+        com_ping = 0x0e,
+        com_set_option = 0x1b
+    };
+
+    static const uint32_t server_flags =
+        client_long_password | client_found_rows | client_long_flag |
+        client_connect_with_db | client_protocol_41 | client_transactions |
+        client_secure_connection | client_multi_statements |
+        client_multi_results | client_ps_multi_results | client_plugin_auth |
+        client_connect_attrs | client_plugin_auth_lenenc_client_data;
+
+    enum {
+        max_payload = 0xffffff
+    };
+
+    fake_server& server_;
+    AMY_ASIO_NS::ip::tcp::socket socket_;
+    AMY_ASIO_NS::steady_timer timer_;
+    uint32_t id_;
+    state_type state_;
+    unsigned char sequence_;
+    uint32_t client_flags_;
+
+    unsigned char header_[4];
+    std::string in_;
+    std::string out_;
+    std::size_t packet_start_;
+
+    static char const* auth_plugin() {
+        return "mysql_native_password";
+    }
+
+    static char const* scramble() {
+        return "0123456789abcdefghij";
+    }
+
+    // Reading.
+
+    void receive() {
+        in_.clear();
+        read_header();
+    }
+
+    void read_header() {
+        auto self = shared_from_this();
+
+        AMY_ASIO_NS::async_read(
+                socket_, AMY_ASIO_NS::buffer(header_),
+                [self](AMY_SYSTEM_NS::error_code const& ec, std::size_t) {
+                    if (!ec) {
+                        self->read_payload();
+                    }
+                });
+    }
+
+    void read_payload() {
+        std::size_t length = header_[0] | (header_[1] << 8) |
+                             (header_[2] << 16);
+        std::size_t offset = in_.size();
+
+        sequence_ = static_cast<unsigned char>(header_[3] + 1u);
+        in_.resize(offset + length);
+
+        auto self = shared_from_this();
+
+        AMY_ASIO_NS::async_read(
+                socket_, AMY_ASIO_NS::buffer(&in_[offset], length),
+                [self, length](AMY_SYSTEM_NS::error_code const& ec,
+                               std::size_t)
+                {
+                    if (ec) {
+                        return;
+                    }
+
+                    // A payload of 2^24 - 1 bytes continues in the next
+                    // packet.
+                    if (length == max_payload) {
+                        self->read_header();
+                    } else {
+                        self->handle_packet();
+                    }
+                });
+    }
+
+    void handle_packet() {
+        switch (state_) {
+        case handshake:
+            handle_handshake_response();
+            break;
+        case auth_switch:
+            write_ok();
+            state_ = command;
+            send();
+            break;
+        case command:
+            handle_command();
+            break;
+        }
+    }
+
+    void handle_handshake_response() {
+        std::size_t pos = 32u;
+
+        if (in_.size() < pos) {
+            socket_.close();
+            return;
+        }
+
+        client_flags_ = get_int(0u, 4u);
+
+        std::string plugin;
+
+        if (!skip_string(pos) ||                             // user
+            !skip_auth_response(pos) ||
+            ((client_flags_ & client_connect_with_db) &&
+             pos < in_.size() && !skip_string(pos)) ||      // database
+            ((client_flags_ & client_plugin_auth) &&
+             pos < in_.size() && !read_string(pos, plugin)))
+        {
+            socket_.close();
+            return;
+        }
+
+        // The password is not checked, but clients defaulting to another
+        // plugin are switched over, as real servers do.
+        if (plugin.empty() || plugin == auth_plugin()) {
+            write_ok();
+            state_ = command;
+        } else {
+            begin_packet();
+            put_int(0xfeu, 1u);
+            put_string(auth_plugin());
+            put_string(scramble());
+            end_packet();
+            state_ = auth_switch;
+        }
+
+        send();
+    }
+
+    void handle_command() {
+        unsigned char com = in_.empty() ? 0u : in_[0];
+
+        switch (com) {
+        case com_quit:
+            socket_.close();
+            return;
+        case com_query:
+            server_.queries_.fetch_add(1u, std::memory_order_relaxed);
+            reply(server_.handler_(in_.substr(1u)));
+            return;
+        case com_init_db:
+        case com_ping:
+            write_ok();
+            break;
+        case com_set_option:
+            write_eof(server_status_autocommit);
+            break;
+        default:
+            write_error(fake_result::error(1047u, "Unknown command",
+                                           "08S01"));
+            break;
+        }
+
+        send();
+    }
+
+    uint64_t get_int(std::size_t pos, std::size_t n) const {
+        uint64_t value = 0u;
+
+        for (std::size_t i = 0; i < n; ++i) {
+            value |= uint64_t(static_cast<unsigned char>(in_[pos + i]))
+                << (8u * i);
+        }
+
+        return value;
+    }
+
+    bool read_string(std::size_t& pos, std::string& value) const {
+        std::size_t end = in_.find('\0', pos);
+
+        if (end == std::string::npos) {
+            return false;
+        }
+
+        value.assign(in_, pos, end - pos);
+        pos = end + 1u;
+        return true;
+    }
+
+    bool skip_string(std::size_t& pos) const {
+        std::string ignored;
+        return read_string(pos, ignored);
+    }
+
+    bool skip_auth_response(std::size_t& pos) const {
+        uint64_t length = 0u;
+
+        if (client_flags_ & client_plugin_auth_lenenc_client_data) {
+            if (!read_length(pos, length)) {
+                return false;
+            }
+        } else if (client_flags_ & client_secure_connection) {
+            if (pos >= in_.size()) {
+                return false;
+            }
+
+            length = static_cast<unsigned char>(in_[pos++]);
+        } else {
+            return skip_string(pos);
+        }
+
+        if (length > in_.size() - pos) {
+            return false;
+        }
+
+        pos += static_cast<std::size_t>(length);
+        return true;
+    }
+
+    bool read_length(std::size_t& pos, uint64_t& length) const {
+        if (pos >= in_.size()) {
+            return false;
+        }
+
+        unsigned char first = in_[pos++];
+        std::size_t n = first == 0xfcu ? 2u :
+                        first == 0xfdu ? 3u :
+                        first == 0xfeu ? 8u : 0u;
+
+        if (n == 0u) {
+            length = first;
+            return true;
+        }
+
+        if (n > in_.size() - pos) {
+            return false;
+        }
+
+        length = get_int(pos, n);
+        pos += n;
+        return true;
+    }
+
+    // Writing.
+
+    void reply(fake_response const& response) {
+        if (response.results.empty()) {
+            write_ok();
+        }
+
+        for (std::size_t i = 0; i < response.results.size(); ++i) {
+            fake_result const& result = response.results[i];
+            bool more = i + 1u < response.results.size();
+
+            write_result(result, more);
+
+            if (result.kind == fake_result::error_packet) {
+                break;
+            }
+        }
+
+        if (response.latency <= fake_response::duration::zero()) {
+            send();
+            return;
+        }
+
+        auto self = shared_from_this();
+
+        timer_.expires_after(response.latency);
+        timer_.async_wait([self](AMY_SYSTEM_NS::error_code const& ec) {
+            if (!ec) {
+                self->send();
+            }
+        });
+    }
+
+    void send() {
+        auto self = shared_from_this();
+
+        AMY_ASIO_NS::async_write(
+                socket_, AMY_ASIO_NS::buffer(out_),
+                [self](AMY_SYSTEM_NS::error_code const& ec, std::size_t) {
+                    self->out_.clear();
+
+                    if (!ec && self->socket_.is_open()) {
+                        self->receive();
+                    }
+                });
+    }
+
+    void write_handshake() {
+        sequence_ = 0u;
+
+        begin_packet();
+        put_int(10u, 1u);                       // protocol version
+        put_string("5.7.99-amy-fake");
+        put_int(id_, 4u);
+        out_.append(scramble(), 8u);
+        put_int(0u, 1u);
+        put_int(server_flags & 0xffffu, 2u);
+        put_int(33u, 1u);                       // utf8_general_ci
+        put_int(server_status_autocommit, 2u);
+        put_int(server_flags >> 16, 2u);
+        put_int(21u, 1u);                       // scramble length
+        out_.append(10u, '\0');
+        put_string(scramble() + 8u);
+        put_string(auth_plugin());
+        end_packet();
+    }
+
+    void write_ok(uint64_t affected_rows = 0u,
+                  uint64_t insert_id = 0u,
+                  unsigned int status = server_status_autocommit)
+    {
+        begin_packet();
+        put_int(0u, 1u);
+        put_length(affected_rows);
+        put_length(insert_id);
+        put_int(status, 2u);
+        put_int(0u, 2u);                        // warnings
+        end_packet();
+    }
+
+    void write_eof(unsigned int status) {
+        begin_packet();
+        put_int(0xfeu, 1u);
+        put_int(0u, 2u);                        // warnings
+        put_int(status, 2u);
+        end_packet();
+    }
+
+    void write_error(fake_result const& result) {
+        std::string sqlstate = result.sqlstate;
+        sqlstate.resize(5u, '0');
+
+        begin_packet();
+        put_int(0xffu, 1u);
+        put_int(result.error_code, 2u);
+        out_ += '#';
+        out_ += sqlstate;
+        out_ += result.message;
+        end_packet();
+    }
+
+    void write_result(fake_result const& result, bool more) {
+        unsigned int status = server_status_autocommit;
+
+        if (more) {
+            status |= server_more_results_exists;
+        }
+
+        switch (result.kind) {
+        case fake_result::ok_packet:
+            write_ok(result.affected_rows, result.insert_id, status);
+            break;
+        case fake_result::error_packet:
+            write_error(result);
+            break;
+        case fake_result::result_set:
+            write_result_set(result, status);
+            break;
+        }
+    }
+
+    void write_result_set(fake_result const& result, unsigned int status) {
+        begin_packet();
+        put_length(result.columns.size());
+        end_packet();
+
+        for (fake_column const& column : result.columns) {
+            begin_packet();
+            put_length_string("def");
+            put_length_string("");              // schema
+            put_length_string("fake");          // table
+            put_length_string("fake");          // original table
+            put_length_string(column.name);
+            put_length_string(column.name);     // original name
+            put_length(0x0cu);
+            put_int(33u, 2u);                   // utf8_general_ci
+            put_int(255u, 4u);                  // column length
+            put_int(column.type, 1u);
+            put_int(0u, 2u);                    // flags
+            put_int(0u, 1u);                    // decimals
+            put_int(0u, 2u);
+            end_packet();
+        }
+
+        write_eof(server_status_autocommit);
+
+        fake_row row(result.columns.size());
+
+        for (std::size_t n = 0; n < result.row_count; ++n) {
+            row.clear();
+
+            if (result.generator) {
+                result.generator(n, row);
+            }
+
+            begin_packet();
+
+            for (std::size_t i = 0; i < row.size(); ++i) {
+                if (row.is_null(i)) {
+                    put_int(0xfbu, 1u);
+                } else {
+                    put_length_string(row.value(i));
+                }
+            }
+
+            end_packet();
+        }
+
+        write_eof(status);
+    }
+
+    void begin_packet() {
+        packet_start_ = out_.size();
+        out_.append(4u, '\0');
+    }
+
+    /// Fills in the header of the packet, splitting payloads of 2^24 - 1
+    /// bytes and more over several packets.
+    void end_packet() {
+        std::string payload = out_.substr(packet_start_ + 4u);
+        out_.resize(packet_start_);
+
+        std::size_t pos = 0u;
+
+        for (;;) {
+            std::size_t length = payload.size() - pos;
+
+            if (length > max_payload) {
+                length = max_payload;
+            }
+
+            put_int(length, 3u);
+            put_int(sequence_++, 1u);
+            out_.append(payload, pos, length);
+            pos += length;
+
+            if (length < max_payload) {
+                break;
+            }
+        }
+    }
+
+    void put_int(uint64_t value, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            out_ += static_cast<char>((value >> (8u * i)) & 0xffu);
+        }
+    }
+
+    void put_length(uint64_t value) {
+        if (value < 0xfbu) {
+            put_int(value, 1u);
+        } else if (value <= 0xffffu) {
+            put_int(0xfcu, 1u);
+            put_int(value, 2u);
+        } else if (value <= 0xffffffu) {
+            put_int(0xfdu, 1u);
+            put_int(value, 3u);
+        } else {
+            put_int(0xfeu, 1u);
+            put_int(value, 8u);
+        }
+    }
+
+    void put_length_string(std::string const& value) {
+        put_length(value.size());
+        out_ += value;
+    }
+
+    /// Appends a null-terminated string.
+    void put_string(char const* value) {
+        out_.append(value, std::strlen(value) + 1u);
+    }
+
+}; // class fake_server::session
+
+inline void fake_server::accept() {
+    auto s = std::make_shared<session>(
+            *this, static_cast<uint32_t>(connections_.load() + 1u));
+
+    acceptor_.async_accept(
+            s->socket(),
+            [this, s](AMY_SYSTEM_NS::error_code const& ec) {
+                if (!acceptor_.is_open()) {
+                    return;
+                }
+
+                if (!ec) {
+                    connections_.fetch_add(1u, std::memory_order_relaxed);
+                    s->start();
+                }
+
+                accept();
+            });
+}
+
+} // namespace test
+} // namespace amy
+
+#endif // __AMY_TEST_FAKE_SERVER_HPP__
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
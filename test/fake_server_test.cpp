@@ -0,0 +1,151 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using amy::test::fake_response;
+using amy::test::fake_result;
+using amy::test::fake_row;
+using amy::test::fake_server;
+
+namespace {
+
+void connect(amy::connector& connector, fake_server const& server,
+             amy::client_flags flags = amy::default_flags)
+{
+    connector.connect(server.endpoint(), amy::auth_info("amy", "amy"),
+                      "test_amy", flags);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_accept_any_credentials) {
+    fake_server server(fake_result::ok());
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connector.connect(server.endpoint(), amy::auth_info("nobody", "wrong"),
+                      "", amy::default_flags);
+
+    connector.query("DO 1");
+    BOOST_CHECK_EQUAL(server.connections(), 1u);
+    BOOST_CHECK_EQUAL(server.queries(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(should_pass_queries_to_the_handler) {
+    std::vector<std::string> queries;
+
+    fake_server server([&](std::string const& query) -> fake_response {
+        queries.push_back(query);
+        return fake_result::ok(3u, 42u);
+    });
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    connector.query("UPDATE t SET a = 1");
+    BOOST_CHECK_EQUAL(connector.affected_rows(), 3u);
+
+    BOOST_REQUIRE_EQUAL(queries.size(), 1u);
+    BOOST_CHECK_EQUAL(queries.front(), "UPDATE t SET a = 1");
+}
+
+BOOST_AUTO_TEST_CASE(should_send_generated_rows) {
+    fake_server server(fake_result::rows(
+            { "n", "name" }, 1000u,
+            [](std::size_t n, fake_row& row) {
+                row.set(0, n);
+
+                if (n % 2 == 0) {
+                    row.set(1, "even");
+                }
+            }));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    amy::result_set rs = connector.query_result("SELECT n, name FROM t");
+
+    BOOST_CHECK_EQUAL(rs.field_count(), 2u);
+    BOOST_REQUIRE_EQUAL(rs.size(), 1000u);
+    BOOST_CHECK_EQUAL(rs[999][0].as<amy::sql_bigint>(), 999);
+    BOOST_CHECK_EQUAL(rs[0][1].as<amy::sql_varchar>(), "even");
+    BOOST_CHECK(rs[1][1].is_null());
+}
+
+BOOST_AUTO_TEST_CASE(should_send_multiple_results) {
+    fake_server server(std::vector<fake_result> {
+        fake_result::ok(1u),
+        fake_result::rows({ "a" }, { { "x" }, { "y" } }),
+        fake_result::error(1146u, "Table 'test_amy.t' doesn't exist",
+                           "42S02"),
+        fake_result::ok()
+    });
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server, amy::client_multi_statements);
+
+    connector.query("INSERT INTO s VALUES (1); SELECT a FROM s; "
+                    "SELECT a FROM t; DO 1");
+
+    BOOST_CHECK_EQUAL(connector.store_result().affected_rows(), 1u);
+    BOOST_REQUIRE(connector.has_more_results());
+    BOOST_CHECK_EQUAL(connector.store_result().size(), 2u);
+    BOOST_REQUIRE(connector.has_more_results());
+
+    AMY_SYSTEM_NS::error_code ec;
+    connector.store_result(ec);
+    BOOST_CHECK_EQUAL(ec.value(), 1146);
+    BOOST_CHECK(!connector.has_more_results());
+}
+
+BOOST_AUTO_TEST_CASE(should_report_errors) {
+    fake_server server(fake_result::error(1064u, "Syntax error", "42000"));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    AMY_SYSTEM_NS::error_code ec;
+    connector.query("SELEC 1", ec);
+
+    BOOST_CHECK_EQUAL(ec.value(), 1064);
+    BOOST_CHECK(ec.category() == amy::error::get_client_category());
+}
+
+BOOST_AUTO_TEST_CASE(should_delay_responses_by_their_latency) {
+    auto latency = std::chrono::milliseconds(50);
+
+    fake_server server(fake_response(fake_result::ok(), latency));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector, server);
+
+    bool handled = false;
+    auto started = std::chrono::steady_clock::now();
+
+    connector.async_query(
+            "DO SLEEP(0.05)",
+            [&](AMY_SYSTEM_NS::error_code const& ec) {
+                BOOST_CHECK(!ec);
+                handled = true;
+            });
+
+    io_service.run();
+
+    BOOST_CHECK(handled);
+    BOOST_CHECK(std::chrono::steady_clock::now() - started >= latency);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
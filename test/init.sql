@@ -2,3 +2,4 @@ CREATE DATABASE test_amy;
 CREATE USER 'amy'@'localhost' IDENTIFIED BY 'amy';
 GRANT ALL PRIVILEGES ON test_amy.* TO 'amy'@'localhost';
 FLUSH PRIVILEGES;
+SET GLOBAL local_infile = 1;
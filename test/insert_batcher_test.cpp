@@ -0,0 +1,275 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using amy::test::fake_response;
+using amy::test::fake_result;
+using amy::test::fake_server;
+
+namespace {
+
+/// Remembers the statements it receives, failing the ones containing
+/// "fail".
+class recording_server {
+public:
+    recording_server() :
+        server_([this](std::string const& query) -> fake_response {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queries_.push_back(query);
+
+            if (query.find("fail") != std::string::npos) {
+                return fake_result::error(1062, "Duplicate entry");
+            }
+
+            return fake_result::ok();
+        })
+    {}
+
+    void connect(amy::connector& connector) {
+        connector.connect(server_.endpoint(), amy::auth_info("amy", "amy"),
+                          "test_amy", amy::default_flags);
+    }
+
+    std::vector<std::string> queries() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queries_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::string> queries_;
+    fake_server server_;
+
+}; // class recording_server
+
+/// Counts the flushes, and can only be moved.
+struct move_only_handler {
+    int* flushed;
+    std::unique_ptr<int> state;
+
+    void operator()(AMY_SYSTEM_NS::error_code const& ec) {
+        BOOST_CHECK(!ec);
+        ++*flushed;
+    }
+
+}; // struct move_only_handler
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_insert_rows_in_batches_of_max_rows) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<int, std::string> batcher(
+            connector, "INSERT INTO t (a, b)", 1u << 20, 3u);
+
+    std::vector<std::size_t> batches;
+    batcher.on_batch([&](AMY_SYSTEM_NS::error_code const& ec,
+                         std::size_t rows) {
+        BOOST_CHECK(!ec);
+        batches.push_back(rows);
+    });
+
+    for (int i = 0; i < 7; ++i) {
+        batcher.add(i, "r" + std::to_string(i));
+    }
+
+    BOOST_CHECK_EQUAL(batcher.buffered_rows(), 1u);
+    BOOST_CHECK(batcher.busy());
+
+    bool flushed = false;
+    batcher.async_flush([&](AMY_SYSTEM_NS::error_code const& ec) {
+        BOOST_CHECK(!ec);
+        flushed = true;
+    });
+
+    io_service.run();
+
+    BOOST_REQUIRE(flushed);
+    BOOST_CHECK_EQUAL(batcher.queued_batches(), 0u);
+    BOOST_CHECK(!batcher.busy());
+
+    std::vector<std::size_t> expected_batches = { 3u, 3u, 1u };
+    BOOST_CHECK_EQUAL_COLLECTIONS(batches.begin(), batches.end(),
+                                  expected_batches.begin(),
+                                  expected_batches.end());
+
+    auto queries = server.queries();
+    BOOST_REQUIRE_EQUAL(queries.size(), 3u);
+    BOOST_CHECK_EQUAL(queries[0], "INSERT INTO t (a, b) VALUES "
+                                  "(0,'r0'),(1,'r1'),(2,'r2')");
+    BOOST_CHECK_EQUAL(queries[2], "INSERT INTO t (a, b) VALUES (6,'r6')");
+}
+
+BOOST_AUTO_TEST_CASE(should_keep_statements_shorter_than_max_bytes) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    const std::size_t max_bytes = 100u;
+    amy::insert_batcher<int, std::nullptr_t> batcher(
+            connector, "INSERT INTO t", max_bytes);
+
+    for (int i = 0; i < 100; ++i) {
+        batcher.add(i, nullptr);
+    }
+
+    batcher.flush();
+    io_service.run();
+
+    std::string rows;
+
+    for (auto const& query : server.queries()) {
+        BOOST_CHECK_LT(query.size(), max_bytes);
+        BOOST_REQUIRE_EQUAL(query.compare(0u, 21u, "INSERT INTO t VALUES "),
+                            0);
+
+        if (!rows.empty()) {
+            rows += ',';
+        }
+
+        rows += query.substr(21u);
+    }
+
+    std::string expected;
+
+    for (int i = 0; i < 100; ++i) {
+        expected += (i ? ",(" : "(") + std::to_string(i) + ",NULL)";
+    }
+
+    BOOST_CHECK_EQUAL(rows, expected);
+}
+
+BOOST_AUTO_TEST_CASE(should_reject_rows_larger_than_max_bytes) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<std::string> batcher(connector, "INSERT INTO t", 32u);
+
+    BOOST_CHECK_THROW(batcher.add(std::string(32u, 'x')), std::length_error);
+    BOOST_CHECK_EQUAL(batcher.buffered_rows(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(should_flush_after_max_delay) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<int> batcher(connector, "INSERT INTO t", 1u << 20,
+                                     1000u, std::chrono::milliseconds(10));
+
+    batcher.add(1);
+    batcher.add(2);
+
+    auto started = std::chrono::steady_clock::now();
+    io_service.run();
+
+    BOOST_CHECK(std::chrono::steady_clock::now() - started >=
+                std::chrono::milliseconds(10));
+
+    auto queries = server.queries();
+    BOOST_REQUIRE_EQUAL(queries.size(), 1u);
+    BOOST_CHECK_EQUAL(queries[0], "INSERT INTO t VALUES (1),(2)");
+}
+
+BOOST_AUTO_TEST_CASE(should_report_failed_batches) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<std::string> batcher(connector, "INSERT INTO t",
+                                             1u << 20, 1u);
+
+    std::vector<bool> failed;
+    batcher.on_batch([&](AMY_SYSTEM_NS::error_code const& ec, std::size_t) {
+        failed.push_back(!!ec);
+    });
+
+    batcher.add("fail");
+    batcher.add("ok");
+
+    AMY_SYSTEM_NS::error_code flush_ec;
+    batcher.async_flush([&](AMY_SYSTEM_NS::error_code const& ec) {
+        flush_ec = ec;
+    });
+
+    io_service.run();
+
+    BOOST_REQUIRE_EQUAL(failed.size(), 2u);
+    BOOST_CHECK(failed[0]);
+    BOOST_CHECK(!failed[1]);
+    BOOST_CHECK_EQUAL(flush_ec.value(), 1062);
+    BOOST_CHECK_EQUAL(server.queries().size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(should_insert_non_finite_values_as_null) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<double, float> batcher(connector, "INSERT INTO t");
+
+    batcher.add(0.5, 0.25f);
+    batcher.add(std::numeric_limits<double>::quiet_NaN(),
+                std::numeric_limits<float>::infinity());
+    batcher.add(-std::numeric_limits<double>::infinity(), 1.0f);
+    batcher.flush();
+
+    io_service.run();
+
+    auto queries = server.queries();
+    BOOST_REQUIRE_EQUAL(queries.size(), 1u);
+    BOOST_CHECK_EQUAL(queries[0], "INSERT INTO t VALUES "
+                                  "(0.5,0.25),(NULL,NULL),(NULL,1)");
+}
+
+BOOST_AUTO_TEST_CASE(should_accept_move_only_flush_handlers) {
+    recording_server server;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    server.connect(connector);
+
+    amy::insert_batcher<int> batcher(connector, "INSERT INTO t");
+
+    int flushed = 0;
+
+    // Nothing to wait for, then a batch to wait for.
+    batcher.async_flush(move_only_handler{ &flushed, nullptr });
+
+    batcher.add(1);
+    batcher.async_flush(move_only_handler{ &flushed, nullptr });
+
+    io_service.run();
+
+    BOOST_CHECK_EQUAL(flushed, 2);
+    BOOST_CHECK_EQUAL(server.queries().size(), 1u);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,184 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+using amy::test::fake_response;
+using amy::test::fake_result;
+using amy::test::fake_server;
+
+namespace {
+
+fake_response select_one(std::chrono::milliseconds latency) {
+    return fake_response(fake_result::rows({ "1" }, { { "1" } }), latency);
+}
+
+std::size_t add_endpoint(amy::load_balancer& balancer, fake_server& server) {
+    return balancer.add_endpoint(server.endpoint(),
+                                 amy::auth_info("amy", "amy"),
+                                 "test_amy",
+                                 amy::default_flags);
+}
+
+/// Routes a statement and waits for it.
+AMY_SYSTEM_NS::error_code route(AMY_ASIO_NS::io_service& io_service,
+                                amy::load_balancer& balancer)
+{
+    AMY_SYSTEM_NS::error_code result;
+
+    balancer.async_query_result(
+            "SELECT 1",
+            [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+                result = ec;
+            });
+
+    io_service.run();
+    io_service.reset();
+
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_spread_unsampled_endpoints_by_in_flight) {
+    fake_server a(select_one(std::chrono::milliseconds(0)));
+    fake_server b(select_one(std::chrono::milliseconds(0)));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::load_balancer balancer(io_service);
+    add_endpoint(balancer, a);
+    add_endpoint(balancer, b);
+
+    auto ignore = [](AMY_SYSTEM_NS::error_code const&, amy::result_set) {};
+
+    for (int i = 0; i < 10; ++i) {
+        balancer.async_query_result("SELECT 1", ignore);
+    }
+
+    BOOST_CHECK_EQUAL(balancer.in_flight(0), 5u);
+    BOOST_CHECK_EQUAL(balancer.in_flight(1), 5u);
+
+    io_service.run();
+}
+
+BOOST_AUTO_TEST_CASE(should_pick_the_faster_of_two_endpoints) {
+    fake_server fast(select_one(std::chrono::milliseconds(0)));
+    fake_server slow(select_one(std::chrono::milliseconds(20)));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::load_balancer balancer(io_service);
+    balancer.eject_ratio(1000.0);
+    add_endpoint(balancer, fast);
+    add_endpoint(balancer, slow);
+
+    typedef amy::load_balancer::clock_type::duration duration;
+
+    // Until both endpoints have a latency sample.
+    for (int i = 0; i < 50 && (balancer.latency(0) == duration::zero() ||
+                               balancer.latency(1) == duration::zero()); ++i)
+    {
+        BOOST_REQUIRE(!route(io_service, balancer));
+    }
+
+    BOOST_REQUIRE(balancer.latency(1) > balancer.latency(0));
+
+    uint64_t slow_queries = slow.queries();
+
+    for (int i = 0; i < 20; ++i) {
+        BOOST_CHECK(!route(io_service, balancer));
+    }
+
+    BOOST_CHECK_EQUAL(slow.queries(), slow_queries);
+    BOOST_CHECK(!balancer.ejected(0));
+    BOOST_CHECK(!balancer.ejected(1));
+}
+
+BOOST_AUTO_TEST_CASE(should_eject_an_endpoint_slower_than_eject_ratio) {
+    fake_server fast(select_one(std::chrono::milliseconds(0)));
+    fake_server slow(select_one(std::chrono::milliseconds(50)));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::load_balancer balancer(io_service);
+    balancer.smoothing(1.0);
+    balancer.eject_ratio(4.0);
+    add_endpoint(balancer, fast);
+    add_endpoint(balancer, slow);
+
+    for (int i = 0; i < 50 && !balancer.ejected(1); ++i) {
+        BOOST_REQUIRE(!route(io_service, balancer));
+    }
+
+    BOOST_CHECK(balancer.ejected(1));
+    BOOST_CHECK(!balancer.ejected(0));
+
+    uint64_t slow_queries = slow.queries();
+
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(!route(io_service, balancer));
+    }
+
+    BOOST_CHECK_EQUAL(slow.queries(), slow_queries);
+}
+
+BOOST_AUTO_TEST_CASE(should_never_eject_the_last_healthy_endpoint) {
+    fake_server a(select_one(std::chrono::milliseconds(1)));
+    fake_server b(select_one(std::chrono::milliseconds(1)));
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::load_balancer balancer(io_service);
+    balancer.smoothing(1.0);
+    balancer.eject_duration(std::chrono::hours(1));
+
+    // Below 1, an endpoint is slower than the fastest one, itself, as soon as
+    // it has a sample.
+    balancer.eject_ratio(0.5);
+    add_endpoint(balancer, a);
+    add_endpoint(balancer, b);
+
+    for (int i = 0; i < 20; ++i) {
+        BOOST_REQUIRE(!route(io_service, balancer));
+    }
+
+    BOOST_CHECK_NE(balancer.ejected(0), balancer.ejected(1));
+}
+
+BOOST_AUTO_TEST_CASE(should_eject_after_failures_and_reinstate_after_probe) {
+    std::unique_ptr<fake_server> server(
+            new fake_server(select_one(std::chrono::milliseconds(0))));
+    unsigned short port = server->endpoint().port();
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::load_balancer balancer(io_service);
+    balancer.max_failures(2u);
+    balancer.eject_duration(std::chrono::milliseconds(0));
+    add_endpoint(balancer, *server);
+
+    // Drops the connection of the balancer.
+    server.reset();
+
+    BOOST_CHECK(route(io_service, balancer));
+    BOOST_CHECK(!balancer.ejected(0));
+    BOOST_CHECK(route(io_service, balancer));
+    BOOST_CHECK(balancer.ejected(0));
+
+    // The probe cannot reconnect while the server is down.
+    route(io_service, balancer);
+    BOOST_CHECK(balancer.ejected(0));
+
+    server.reset(new fake_server(select_one(std::chrono::milliseconds(0)),
+                                 port));
+
+    // The next statement triggers a reconnection, then a probe.
+    route(io_service, balancer);
+    BOOST_CHECK(!balancer.ejected(0));
+    BOOST_CHECK(!route(io_service, balancer));
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,244 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <amy/connector.hpp>
+#include <amy/load_data.hpp>
+#include <amy/options.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Reads all the rows of \p producer from a \c local_infile_source, in
+/// chunks of \p chunk bytes.
+template<typename Producer>
+std::string read_all(Producer& producer, unsigned int chunk) {
+    typedef amy::detail::local_infile_source<Producer> source_type;
+
+    amy::detail::mysql_handle mysql = ::mysql_init(nullptr);
+    std::string data;
+
+    {
+        source_type source(mysql, producer);
+        void* state = nullptr;
+        std::vector<char> buffer(chunk);
+
+        BOOST_REQUIRE_EQUAL(source_type::init(&state, "amy", &source), 0);
+
+        for (;;) {
+            int n = source_type::read(state, buffer.data(), chunk);
+            BOOST_REQUIRE_GE(n, 0);
+            BOOST_REQUIRE_LE(n, static_cast<int>(chunk));
+
+            if (n == 0) {
+                break;
+            }
+
+            data.append(buffer.data(), n);
+        }
+
+        source_type::end(state);
+    }
+
+    ::mysql_close(mysql);
+    return data;
+}
+
+/// Connects with local files allowed, and creates a temporary table.
+void connect(amy::connector& connector) {
+    connector.open();
+    connector.set_option(amy::options::local_infile(1u));
+    connector.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"),
+                      "test_amy", amy::default_flags);
+    connector.query("CREATE TEMPORARY TABLE load_data_test "
+                    "(id INT, name VARCHAR(16))");
+}
+
+amy::sql_bigint count_rows(amy::connector& connector) {
+    return connector.query_result("SELECT COUNT(*) FROM load_data_test")
+        [0][0].as<amy::sql_bigint>();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_separate_fields_with_tabs) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add("a").add(std::string("b")).add("cd", 1u);
+    BOOST_CHECK_EQUAL(row.fields(), 3u);
+
+    row.finish();
+    BOOST_CHECK_EQUAL(row.fields(), 0u);
+
+    row.add("e");
+    BOOST_CHECK_EQUAL(buffer, "a\tb\tc\ne");
+}
+
+BOOST_AUTO_TEST_CASE(should_escape_strings) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add(std::string("a\\b\tc\nd\re\0f", 11u));
+    BOOST_CHECK_EQUAL(buffer, "a\\\\b\\tc\\nd\\re\\0f");
+}
+
+BOOST_AUTO_TEST_CASE(should_format_values) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add(nullptr)
+       .add(true)
+       .add(false)
+       .add(0)
+       .add(-42)
+       .add(std::numeric_limits<int64_t>::min())
+       .add(std::numeric_limits<uint64_t>::max())
+       .add(0.5)
+       .add(0.25f);
+
+    BOOST_CHECK_EQUAL(buffer,
+                      "\\N\t1\t0\t0\t-42\t-9223372036854775808"
+                      "\t18446744073709551615\t0.5\t0.25");
+}
+
+BOOST_AUTO_TEST_CASE(should_format_non_finite_values_as_null) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add(std::numeric_limits<double>::quiet_NaN())
+       .add(-std::numeric_limits<double>::infinity())
+       .add(std::numeric_limits<float>::infinity())
+       .add(1.5);
+
+    BOOST_CHECK_EQUAL(buffer, "\\N\t\\N\t\\N\t1.5");
+}
+
+BOOST_AUTO_TEST_CASE(should_format_chars_as_strings) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add('a').add('\t');
+    BOOST_CHECK_EQUAL(buffer, "a\t\\t");
+}
+
+BOOST_AUTO_TEST_CASE(should_format_datetimes) {
+    std::string buffer;
+    amy::load_data_row row(buffer);
+
+    row.add(amy::sql_datetime(std::chrono::seconds(86400 + 3661)));
+    BOOST_CHECK_EQUAL(buffer, "1970-01-02 01:01:01.000000");
+}
+
+BOOST_AUTO_TEST_CASE(should_produce_rows_from_tuples) {
+    std::vector<std::tuple<int, std::string>> rows = {
+        std::make_tuple(1, "a"),
+        std::make_tuple(2, "b\tc")
+    };
+
+    auto producer = amy::produce_rows(rows);
+    BOOST_CHECK_EQUAL(read_all(producer, 4096u), "1\ta\n2\tb\\tc\n");
+
+    std::vector<std::pair<std::string, double>> pairs = {
+        std::make_pair("x", 1.5)
+    };
+
+    auto pair_producer = amy::produce_rows(pairs.begin(), pairs.end());
+    BOOST_CHECK_EQUAL(read_all(pair_producer, 4096u), "x\t1.5\n");
+}
+
+BOOST_AUTO_TEST_CASE(should_stream_rows_in_chunks) {
+    int n = 0;
+    auto producer = [&n](amy::load_data_row& row) {
+        if (n == 1000) {
+            return false;
+        }
+
+        row.add(n++).add("row");
+        return true;
+    };
+
+    std::string expected;
+
+    for (int i = 0; i < 1000; ++i) {
+        expected += std::to_string(i) + "\trow\n";
+    }
+
+    BOOST_CHECK_EQUAL(read_all(producer, 7u), expected);
+}
+
+BOOST_AUTO_TEST_CASE(should_abort_when_the_producer_throws) {
+    auto producer = [](amy::load_data_row&) -> bool {
+        throw std::logic_error("no more rows");
+    };
+
+    typedef amy::detail::local_infile_source<decltype(producer)>
+        source_type;
+
+    amy::detail::mysql_handle mysql = ::mysql_init(nullptr);
+
+    {
+        source_type source(mysql, producer);
+        void* state = nullptr;
+        char buffer[64];
+
+        source_type::init(&state, "amy", &source);
+        BOOST_CHECK_EQUAL(source_type::read(state, buffer, sizeof(buffer)),
+                          -1);
+        BOOST_CHECK_EQUAL(source_type::error(state, buffer, sizeof(buffer)),
+                          CR_UNKNOWN_ERROR);
+        BOOST_CHECK_THROW(source.rethrow(), std::logic_error);
+    }
+
+    ::mysql_close(mysql);
+}
+
+BOOST_AUTO_TEST_CASE(should_load_the_rows_of_a_producer) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector);
+
+    std::vector<std::tuple<int, std::string>> rows = {
+        std::make_tuple(1, "a"),
+        std::make_tuple(2, "b\tc"),
+        std::make_tuple(3, "d\\e")
+    };
+
+    connector.load_data("load_data_test", amy::produce_rows(rows));
+    BOOST_CHECK_EQUAL(connector.affected_rows(), 3u);
+
+    amy::result_set rs = connector.query_result(
+            "SELECT id, name FROM load_data_test ORDER BY id");
+    BOOST_REQUIRE_EQUAL(rs.size(), 3u);
+
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        BOOST_CHECK_EQUAL(rs[i][0].as<amy::sql_int>(), std::get<0>(rows[i]));
+        BOOST_CHECK_EQUAL(rs[i][1].as<amy::sql_varchar>(),
+                          std::get<1>(rows[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(should_abort_the_load_when_the_producer_throws) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::connector connector(io_service);
+    connect(connector);
+
+    auto producer = [](amy::load_data_row&) -> bool {
+        throw std::logic_error("no more rows");
+    };
+
+    BOOST_CHECK_THROW(connector.load_data("load_data_test", producer),
+                      std::logic_error);
+
+    // The connection is left usable, without any row loaded.
+    BOOST_CHECK_EQUAL(count_rows(connector), 0);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,79 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/mariadb_connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<std::size_t> allocations(0);
+} // namespace
+
+void* operator new(std::size_t size) {
+  ++allocations;
+
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+struct maria_allocation_test {
+  amy::mariadb_connector& connector;
+  int remaining;
+  std::size_t allocations_before = 0;
+
+  void start(int queries) {
+    remaining = queries;
+    allocations_before = allocations;
+    next();
+  }
+
+  void next() {
+    connector.async_query("DO 1",
+        std::bind(&maria_allocation_test::handle_query, this,
+            amy::placeholders::error));
+  }
+
+  void handle_query(AMY_SYSTEM_NS::error_code const& ec) {
+    BOOST_REQUIRE(!ec);
+
+    if (--remaining > 0) {
+      next();
+    }
+  }
+
+  std::size_t allocations_since_start() const {
+    return allocations - allocations_before;
+  }
+
+}; // struct maria_allocation_test
+
+BOOST_AUTO_TEST_CASE(should_maria_run_steady_state_queries_without_allocating) {
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+  c.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"), "test_amy",
+      amy::default_flags);
+
+  maria_allocation_test fixture{c, 0};
+
+  // Fills the connection pool and the reactor caches.
+  fixture.start(16);
+  io_service.run();
+  io_service.restart();
+
+  fixture.start(1000);
+  io_service.run();
+
+  BOOST_CHECK_EQUAL(0u, fixture.allocations_since_start());
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -1,8 +1,12 @@
 #include <boost/test/unit_test.hpp>
 
+#include <amy/mariadb_connect_all.hpp>
 #include <amy/mariadb_connector.hpp>
 #include <amy/placeholders.hpp>
 
+#include <chrono>
+#include <string>
+
 struct maria_async_connect_test {
   bool handler_invoked;
 
@@ -34,4 +38,72 @@ BOOST_AUTO_TEST_CASE(
   BOOST_CHECK(fixture.handler_invoked);
 }
 
+// The mariadb flavor of should_replay_idempotent_query_after_reconnect, see
+// connector_test.cpp: the new socket usually reuses the descriptor of the
+// lost one, which must be registered with the reactor again.
+BOOST_AUTO_TEST_CASE(should_maria_replay_idempotent_query_after_reconnect) {
+  AMY_ASIO_NS::io_service io_service;
+  amy::auth_info auth("amy", "amy");
+
+  amy::mariadb_connector c(io_service);
+  c.set_reconnect_policy(amy::reconnect_policy(3));
+
+  AMY_SYSTEM_NS::error_code connect_ec;
+  c.async_connect(amy::null_endpoint(), auth, "test_amy", amy::default_flags,
+      [&](AMY_SYSTEM_NS::error_code const& ec) { connect_ec = ec; });
+
+  io_service.run();
+  io_service.reset();
+
+  BOOST_REQUIRE(!connect_ec);
+
+  amy::sql_bigint id =
+      c.query_result("SELECT CONNECTION_ID()")[0][0].as<amy::sql_bigint>();
+
+  amy::mariadb_connector killer(io_service);
+  killer.connect(amy::null_endpoint(), auth, "test_amy", amy::default_flags);
+  killer.query("KILL " + std::to_string(id));
+
+  AMY_SYSTEM_NS::error_code query_ec;
+  amy::sql_bigint new_id = id;
+
+  c.async_query_result(amy::idempotent("SELECT CONNECTION_ID()"),
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+        query_ec = ec;
+
+        if (!ec) {
+          new_id = rs[0][0].as<amy::sql_bigint>();
+        }
+      });
+
+  io_service.run();
+
+  BOOST_CHECK(!query_ec);
+  BOOST_CHECK_NE(id, new_id);
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_connect_all_with_bounded_parallelism) {
+  AMY_ASIO_NS::io_service io_service;
+
+  AMY_SYSTEM_NS::error_code connect_ec;
+  amy::mariadb_connectors connectors;
+
+  amy::async_connect_all(io_service, 8, amy::null_endpoint(),
+      amy::auth_info("amy", "amy"), "test_amy", amy::default_flags, 3,
+      std::chrono::steady_clock::now() + std::chrono::seconds(10),
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::mariadb_connectors cs) {
+        connect_ec = ec;
+        connectors = std::move(cs);
+      });
+
+  io_service.run();
+
+  BOOST_CHECK(!connect_ec);
+  BOOST_REQUIRE_EQUAL(8u, connectors.size());
+
+  for (auto& c : connectors) {
+    c->query("DO 1");
+  }
+}
+
 // vim:ft=cpp sw=4 ts=4 tw=80 et
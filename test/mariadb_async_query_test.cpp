@@ -0,0 +1,248 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/mariadb_connector.hpp>
+#include <amy/placeholders.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/cancellation_signal.hpp>
+#endif
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct maria_async_query_test {
+  std::vector<int64_t> values;
+
+  void handle_connect(AMY_SYSTEM_NS::error_code const& ec) {
+    BOOST_CHECK(!ec);
+  }
+
+  void handle_query_result(
+      AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+    BOOST_REQUIRE(!ec);
+    values.push_back(rs[0][0].as<amy::sql_bigint>());
+  }
+
+}; // struct maria_async_query_test
+
+BOOST_AUTO_TEST_CASE(should_maria_run_concurrent_async_queries_in_order) {
+  maria_async_query_test fixture;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+
+  // None of the operations below waits for the previous one to complete.
+  c.async_connect(amy::null_endpoint(), amy::auth_info("amy", "amy"),
+      "test_amy", amy::default_flags,
+      std::bind(&maria_async_query_test::handle_connect, &fixture,
+          amy::placeholders::error));
+
+  for (int i = 0; i < 8; ++i) {
+    c.async_query_result("SELECT " + std::to_string(i),
+        std::bind(&maria_async_query_test::handle_query_result, &fixture,
+            amy::placeholders::error, amy::placeholders::result_set));
+  }
+
+  io_service.run();
+
+  BOOST_CHECK(fixture.values ==
+              std::vector<int64_t>({ 0, 1, 2, 3, 4, 5, 6, 7 }));
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_kill_query_past_its_deadline) {
+  maria_async_query_test fixture;
+  AMY_SYSTEM_NS::error_code query_ec;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+
+  c.async_connect(amy::null_endpoint(), amy::auth_info("amy", "amy"),
+      "test_amy", amy::default_flags,
+      std::bind(&maria_async_query_test::handle_connect, &fixture,
+          amy::placeholders::error));
+
+  auto started = std::chrono::steady_clock::now();
+
+  c.async_query_result("SELECT SLEEP(10)",
+      started + std::chrono::milliseconds(200),
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+        query_ec = ec;
+      });
+
+  // Must only run once the slow query has been killed.
+  c.async_query_result("SELECT 42",
+      std::bind(&maria_async_query_test::handle_query_result, &fixture,
+          amy::placeholders::error, amy::placeholders::result_set));
+
+  io_service.run();
+
+  BOOST_CHECK(query_ec == AMY_ASIO_NS::error::operation_aborted);
+  BOOST_CHECK(fixture.values == std::vector<int64_t>({ 42 }));
+  BOOST_CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_cancel_pending_query_immediately) {
+  AMY_SYSTEM_NS::error_code query_ec;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+  c.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"), "test_amy",
+      amy::default_flags);
+
+  auto started = std::chrono::steady_clock::now();
+
+  c.async_query_result("SELECT SLEEP(10)",
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+        query_ec = ec;
+      });
+
+  AMY_ASIO_NS::steady_timer timer(io_service, std::chrono::milliseconds(200));
+  timer.async_wait([&](AMY_SYSTEM_NS::error_code const&) { c.cancel(); });
+
+  io_service.run();
+
+  BOOST_CHECK(query_ec == AMY_ASIO_NS::error::operation_aborted);
+  BOOST_CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+}
+
+#if defined(AMY_ASIO_HAS_CANCELLATION_SLOT)
+BOOST_AUTO_TEST_CASE(should_maria_kill_query_canceled_through_its_slot) {
+  maria_async_query_test fixture;
+  AMY_SYSTEM_NS::error_code query_ec;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+  c.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"), "test_amy",
+      amy::default_flags);
+
+  AMY_ASIO_NS::cancellation_signal signal;
+
+  auto started = std::chrono::steady_clock::now();
+
+  c.async_query_result("SELECT SLEEP(10)",
+      AMY_ASIO_NS::bind_cancellation_slot(signal.slot(),
+          [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+            query_ec = ec;
+          }));
+
+  // Must only run once the slow query has been killed.
+  c.async_query_result("SELECT 42",
+      std::bind(&maria_async_query_test::handle_query_result, &fixture,
+          amy::placeholders::error, amy::placeholders::result_set));
+
+  AMY_ASIO_NS::steady_timer timer(io_service, std::chrono::milliseconds(200));
+  timer.async_wait([&](AMY_SYSTEM_NS::error_code const&) {
+    signal.emit(AMY_ASIO_NS::cancellation_type::terminal);
+  });
+
+  io_service.run();
+
+  BOOST_CHECK(query_ec == AMY_ASIO_NS::error::operation_aborted);
+  BOOST_CHECK(fixture.values == std::vector<int64_t>({ 42 }));
+  BOOST_CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(should_maria_trace_queries_outliving_their_connector) {
+  typedef std::function<void(amy::query_trace const&)> observer_type;
+
+  std::vector<amy::query_trace> traces;
+  AMY_SYSTEM_NS::error_code query_ec;
+  bool completed = false;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  std::unique_ptr<amy::basic_connector<amy::mariadb_service, observer_type>>
+      c(new amy::basic_connector<amy::mariadb_service, observer_type>(
+          io_service,
+          [&](amy::query_trace const& trace) { traces.push_back(trace); }));
+
+  c->connect(amy::null_endpoint(), amy::auth_info("amy", "amy"), "test_amy",
+      amy::default_flags);
+
+  c->async_query_result("SELECT SLEEP(10)",
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+        query_ec  = ec;
+        completed = true;
+      });
+
+  // The query completes after the connector, and its observer, are gone.
+  AMY_ASIO_NS::steady_timer timer(io_service, std::chrono::milliseconds(200));
+  timer.async_wait([&](AMY_SYSTEM_NS::error_code const&) { c.reset(); });
+
+  io_service.run();
+
+  BOOST_REQUIRE(completed);
+  BOOST_CHECK(query_ec == AMY_ASIO_NS::error::operation_aborted);
+  BOOST_REQUIRE_EQUAL(traces.size(), 1u);
+  BOOST_CHECK(traces.front().ec == AMY_ASIO_NS::error::operation_aborted);
+  BOOST_CHECK_EQUAL(traces.front().statement, "SELECT SLEEP(10)");
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_never_complete_within_initiating_function) {
+  AMY_SYSTEM_NS::error_code query_ec;
+  bool completed = false;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+
+  // Fails immediately, but io_service is not running on this thread.
+  c.async_query("SELECT 1", [&](AMY_SYSTEM_NS::error_code const& ec) {
+    query_ec  = ec;
+    completed = true;
+  });
+
+  BOOST_CHECK(!completed);
+
+  io_service.run();
+
+  BOOST_CHECK(completed);
+  BOOST_CHECK(query_ec == amy::error::not_initialized);
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+BOOST_AUTO_TEST_CASE(should_maria_await_async_queries) {
+  std::vector<int64_t> values;
+
+  AMY_ASIO_NS::io_service io_service;
+
+  amy::mariadb_connector c(io_service);
+
+  auto run = [&]() -> AMY_ASIO_NS::awaitable<void> {
+    co_await c.async_connect(amy::null_endpoint(),
+        amy::auth_info("amy", "amy"), "test_amy", amy::default_flags,
+        AMY_ASIO_NS::use_awaitable);
+
+    for (int i = 0; i < 3; ++i) {
+      amy::result_set rs = co_await c.async_query_result(
+          "SELECT " + std::to_string(i), AMY_ASIO_NS::use_awaitable);
+      values.push_back(rs[0][0].as<amy::sql_bigint>());
+    }
+  };
+
+  AMY_ASIO_NS::co_spawn(io_service, run(), AMY_ASIO_NS::detached);
+
+  io_service.run();
+
+  BOOST_CHECK(values == std::vector<int64_t>({ 0, 1, 2 }));
+}
+#endif
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,130 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/mariadb_hedged_reader.hpp>
+
+#include <chrono>
+
+BOOST_AUTO_TEST_CASE(should_maria_hedge_slow_reads_on_another_replica) {
+  AMY_ASIO_NS::io_service io_service;
+  amy::auth_info auth("amy", "amy");
+
+  // Both replicas are the test server, the first one is made slow by the
+  // statement itself.
+  amy::mariadb_hedged_reader reader(io_service);
+  reader.add_replica(amy::null_endpoint(), auth, "test_amy",
+      amy::default_flags);
+  reader.add_replica(amy::null_endpoint(), auth, "test_amy",
+      amy::default_flags);
+  reader.initial_delay(std::chrono::milliseconds(50));
+
+  reader.connector(0).query("SELECT CONNECTION_ID()");
+  auto slow_id =
+      reader.connector(0).store_result()[0][0].as<amy::sql_bigint>();
+
+  AMY_SYSTEM_NS::error_code query_ec;
+  amy::sql_bigint winner_id = 0;
+
+  auto started = std::chrono::steady_clock::now();
+
+  reader.async_query_result_hedged(
+      "SELECT CONNECTION_ID(), SLEEP(IF(CONNECTION_ID() = " +
+          std::to_string(slow_id) + ", 10, 0))",
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+        query_ec = ec;
+        winner_id = ec ? 0 : rs[0][0].as<amy::sql_bigint>();
+      });
+
+  io_service.run();
+
+  BOOST_CHECK(!query_ec);
+  BOOST_CHECK_NE(slow_id, winner_id);
+  BOOST_CHECK_EQUAL(1u, reader.hedged());
+  BOOST_CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_hedge_after_the_latency_percentile) {
+  using std::chrono::milliseconds;
+
+  AMY_ASIO_NS::io_service io_service;
+  amy::mariadb_hedged_reader reader(io_service);
+  reader.initial_delay(milliseconds(50));
+  reader.percentile(0.5);
+
+  // The delay is first computed once min_samples samples were gathered and
+  // update_interval more came in, here from 1 to 31 ms in shuffled order.
+  std::size_t samples = amy::mariadb_hedged_reader::min_samples +
+                        amy::mariadb_hedged_reader::update_interval - 1;
+  BOOST_REQUIRE_EQUAL(31u, samples);
+
+  for (std::size_t i = 0; i < samples; ++i) {
+    reader.record(milliseconds((i * 7) % samples + 1));
+
+    if (i + 1 < samples) {
+      BOOST_CHECK(reader.hedge_delay() == milliseconds(50));
+    }
+  }
+
+  BOOST_CHECK(reader.hedge_delay() == milliseconds(16));
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_clamp_the_hedge_delay) {
+  using std::chrono::milliseconds;
+
+  AMY_ASIO_NS::io_service io_service;
+  amy::mariadb_hedged_reader reader(io_service);
+  reader.min_delay(milliseconds(5));
+
+  for (std::size_t i = 0; i < amy::mariadb_hedged_reader::sample_window;
+       ++i) {
+    reader.record(std::chrono::microseconds(100));
+  }
+
+  BOOST_CHECK(reader.hedge_delay() == milliseconds(5));
+}
+
+BOOST_AUTO_TEST_CASE(should_maria_fail_reads_failing_before_the_hedge) {
+  AMY_ASIO_NS::io_service io_service;
+  amy::auth_info auth("amy", "amy");
+
+  amy::mariadb_hedged_reader reader(io_service);
+  reader.add_replica(amy::null_endpoint(), auth, "test_amy",
+      amy::default_flags);
+  reader.add_replica(amy::null_endpoint(), auth, "test_amy",
+      amy::default_flags);
+  reader.initial_delay(std::chrono::seconds(10));
+
+  AMY_SYSTEM_NS::error_code failed_ec;
+  AMY_SYSTEM_NS::error_code next_ec;
+  amy::sql_bigint next_value = 0;
+
+  auto started = std::chrono::steady_clock::now();
+
+  reader.async_query_result_hedged("SELECT * FROM no_such_table",
+      [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+        failed_ec = ec;
+
+        // The connection is available again.
+        reader.async_query_result_hedged("SELECT 42",
+            [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+              next_ec = ec;
+              next_value = ec ? 0 : rs[0][0].as<amy::sql_bigint>();
+            });
+      });
+
+  io_service.run();
+
+  // Reported without waiting for the hedge, which is never sent.
+  BOOST_CHECK(!!failed_ec);
+  BOOST_CHECK_EQUAL(0u, reader.hedged());
+  BOOST_CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+
+  // Failures are no latency samples.
+  BOOST_CHECK(reader.hedge_delay() == std::chrono::seconds(10));
+
+  BOOST_CHECK(!next_ec);
+  BOOST_CHECK_EQUAL(42, next_value);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,116 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <amy/connector.hpp>
+#include <amy/query_metrics.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(should_bucket_values_within_a_sixteenth) {
+    typedef amy::histogram_buckets buckets;
+
+    uint64_t values[] = { 0u, 1u, 31u, 32u, 33u, 1000u, 123456789u,
+                          buckets::max_value };
+
+    for (uint64_t v : values) {
+        std::size_t i = buckets::index(v);
+
+        BOOST_CHECK_LT(i, std::size_t(buckets::count));
+        BOOST_CHECK_LE(buckets::lower_bound(i), v);
+        BOOST_CHECK_GE(buckets::upper_bound(i), v);
+        BOOST_CHECK_LE(buckets::upper_bound(i) - buckets::lower_bound(i),
+                       v / 16u);
+    }
+
+    BOOST_CHECK_EQUAL(buckets::index(buckets::max_value), buckets::count - 1u);
+}
+
+BOOST_AUTO_TEST_CASE(should_report_percentiles_of_recorded_latencies) {
+    amy::latency_histogram histogram;
+
+    for (int i = 1; i <= 100; ++i) {
+        histogram.record(std::chrono::microseconds(i));
+    }
+
+    amy::histogram_snapshot s = histogram.snapshot();
+
+    BOOST_CHECK_EQUAL(s.count(), 100u);
+    BOOST_CHECK(s.max() == std::chrono::microseconds(100));
+
+    auto p50 = std::chrono::duration_cast<std::chrono::microseconds>(
+            s.percentile(50.0)).count();
+    BOOST_CHECK_GE(p50, 50);
+    BOOST_CHECK_LE(p50, 54);
+}
+
+BOOST_AUTO_TEST_CASE(should_record_concurrently) {
+    amy::latency_histogram histogram;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram] {
+            for (int i = 0; i < 10000; ++i) {
+                histogram.record(std::chrono::nanoseconds(i));
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    BOOST_CHECK_EQUAL(histogram.snapshot().count(), 40000u);
+}
+
+BOOST_AUTO_TEST_CASE(should_classify_errors_by_number) {
+    typedef amy::query_metrics_snapshot snapshot;
+
+    auto classify = [](int value) {
+        return amy::query_metrics::classify(AMY_SYSTEM_NS::error_code(
+                    value, amy::error::get_client_category()));
+    };
+
+    BOOST_CHECK_EQUAL(classify(1062), snapshot::server_error);
+    BOOST_CHECK_EQUAL(classify(2013), snapshot::client_error);
+
+    // Recent servers number their errors past the client ones.
+    BOOST_CHECK_EQUAL(classify(3819), snapshot::server_error);
+    BOOST_CHECK_EQUAL(classify(4025), snapshot::server_error);
+
+    BOOST_CHECK_EQUAL(amy::query_metrics::classify(amy::error::no_more_results),
+                      snapshot::misc_error);
+}
+
+BOOST_AUTO_TEST_CASE(should_count_queries_per_connector_and_service) {
+    amy::query_metrics service_metrics;
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::basic_connector<amy::mysql_service, amy::metrics_observer> connector(
+            io_service, amy::metrics_observer(&service_metrics));
+
+    connector.connect(amy::null_endpoint(), amy::auth_info("amy", "amy"),
+                      "test_amy", amy::default_flags);
+
+    auto ignore = [](AMY_SYSTEM_NS::error_code const&, amy::result_set) {};
+
+    connector.async_query_result("SELECT 1 UNION ALL SELECT 2", ignore);
+    connector.async_query_result("SELECT * FROM no_such_table", ignore);
+
+    io_service.run();
+
+    amy::query_metrics_snapshot s = connector.observer().metrics().snapshot();
+
+    BOOST_CHECK_EQUAL(s.queries, 2u);
+    BOOST_CHECK_EQUAL(s.rows, 2u);
+    BOOST_CHECK_EQUAL(s.errors[amy::query_metrics_snapshot::server_error], 1u);
+    BOOST_CHECK_EQUAL(s.latency.count(), 2u);
+    BOOST_CHECK_EQUAL(
+            s.phases[amy::query_trace::decode].count(), 1u);
+
+    BOOST_CHECK_EQUAL(service_metrics.snapshot().queries, 2u);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,87 @@
+#include <boost/test/unit_test.hpp>
+
+#include <amy/connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <vector>
+
+struct query_queue_test {
+    std::vector<int64_t> values;
+    std::vector<AMY_SYSTEM_NS::error_code> errors;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set rs)
+    {
+        errors.push_back(ec);
+        values.push_back(ec ? -1 : rs[0][0].as<amy::sql_bigint>());
+    }
+
+    void run(amy::client_flags flags, std::vector<std::string> const& stmts) {
+        AMY_ASIO_NS::io_service io_service;
+        amy::connector c(io_service);
+
+        c.connect(amy::null_endpoint(),
+                  amy::auth_info("amy", "amy"),
+                  "test_amy",
+                  flags);
+
+        amy::query_queue queue(c);
+
+        for (auto const& stmt : stmts) {
+            queue.async_query_result(
+                    stmt,
+                    std::bind(&query_queue_test::handle_query_result,
+                              this,
+                              amy::placeholders::error,
+                              amy::placeholders::result_set));
+        }
+
+        io_service.run();
+
+        BOOST_CHECK_EQUAL(0u, queue.size());
+    }
+
+}; // struct query_queue_test
+
+BOOST_AUTO_TEST_CASE(should_run_queued_queries_in_order) {
+    query_queue_test fixture;
+    fixture.run(amy::default_flags, { "SELECT 1", "SELECT 2", "SELECT 3" });
+
+    BOOST_CHECK(fixture.values == std::vector<int64_t>({ 1, 2, 3 }));
+}
+
+BOOST_AUTO_TEST_CASE(should_demultiplex_coalesced_queries) {
+    query_queue_test fixture;
+    fixture.run(amy::client_multi_statements,
+                { "SELECT 1;", "SELECT 2 -- comment", "SELECT 3" });
+
+    BOOST_CHECK(fixture.values == std::vector<int64_t>({ 1, 2, 3 }));
+}
+
+BOOST_AUTO_TEST_CASE(should_resubmit_queries_following_a_failed_one) {
+    query_queue_test fixture;
+    fixture.run(amy::client_multi_statements,
+                { "SELECT 1", "SELECT * FROM no_such_table", "SELECT 3" });
+
+    BOOST_CHECK(fixture.values == std::vector<int64_t>({ 1, -1, 3 }));
+    BOOST_CHECK(!fixture.errors[0]);
+    BOOST_CHECK(!!fixture.errors[1]);
+    BOOST_CHECK(!fixture.errors[2]);
+}
+
+BOOST_AUTO_TEST_CASE(should_resubmit_queries_following_a_recent_server_error) {
+    query_queue_test fixture;
+
+    // Server errors are numbered from 3000 on too, past the client ones.
+    fixture.run(amy::client_multi_statements,
+                { "SELECT 1",
+                  "SIGNAL SQLSTATE '45000' SET MYSQL_ERRNO = 4025",
+                  "SELECT 3" });
+
+    BOOST_CHECK(fixture.values == std::vector<int64_t>({ 1, -1, 3 }));
+    BOOST_CHECK(!fixture.errors[0]);
+    BOOST_CHECK_EQUAL(fixture.errors[1].value(), 4025);
+    BOOST_CHECK(!fixture.errors[2]);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,205 @@
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+#include <amy/placeholders.hpp>
+
+#include <string>
+#include <vector>
+
+using amy::test::fake_response;
+using amy::test::fake_result;
+using amy::test::fake_server;
+
+BOOST_AUTO_TEST_CASE(should_classify_statements) {
+    using namespace amy::detail;
+
+    BOOST_CHECK_EQUAL(statement_read, classify_statement("SELECT 1"));
+    BOOST_CHECK_EQUAL(statement_read,
+                      classify_statement("/* x */ select 'FOR UPDATE'"));
+    BOOST_CHECK_EQUAL(statement_read, classify_statement("SHOW TABLES"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("SELECT * FROM t FOR UPDATE"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("SELECT 1 INTO @x"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("SELECT LAST_INSERT_ID()"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("INSERT INTO t VALUES (1)"));
+    BOOST_CHECK_EQUAL(statement_write, classify_statement("SET @x = 1"));
+    BOOST_CHECK_EQUAL(statement_begin,
+                      classify_statement("START TRANSACTION"));
+    BOOST_CHECK_EQUAL(statement_begin, classify_statement("-- c\nBEGIN"));
+    BOOST_CHECK_EQUAL(statement_end, classify_statement("COMMIT"));
+    BOOST_CHECK_EQUAL(statement_end, classify_statement("rollback"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("ROLLBACK TO SAVEPOINT s"));
+    BOOST_CHECK_EQUAL(statement_autocommit_off,
+                      classify_statement("SET autocommit = 0"));
+    BOOST_CHECK_EQUAL(statement_autocommit_off,
+                      classify_statement("set session AUTOCOMMIT=OFF"));
+    BOOST_CHECK_EQUAL(statement_autocommit_off,
+                      classify_statement("SET @@autocommit = @mode"));
+    BOOST_CHECK_EQUAL(statement_autocommit_on,
+                      classify_statement("SET @x = 1, autocommit = 1"));
+    BOOST_CHECK_EQUAL(statement_autocommit_on,
+                      classify_statement("SET autocommit = true"));
+    BOOST_CHECK_EQUAL(statement_read, classify_statement("SELECT 1;"));
+    BOOST_CHECK_EQUAL(statement_read,
+                      classify_statement("SELECT ';' -- ; DELETE"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("SELECT 1; DELETE FROM t"));
+    BOOST_CHECK_EQUAL(statement_write,
+                      classify_statement("SELECT 1;SELECT 2"));
+    BOOST_CHECK_EQUAL(statement_write, classify_statement("BEGIN; COMMIT"));
+}
+
+struct query_router_test {
+    std::vector<amy::sql_bigint> connection_ids;
+
+    void handle_query_result(AMY_SYSTEM_NS::error_code const& ec,
+                             amy::result_set rs)
+    {
+        BOOST_REQUIRE(!ec);
+        connection_ids.push_back(
+                rs.empty() ? -1 : rs[0][0].as<amy::sql_bigint>());
+    }
+
+    void query(amy::query_router& router, std::string const& stmt) {
+        router.async_query_result(
+                stmt,
+                std::bind(&query_router_test::handle_query_result,
+                          this,
+                          amy::placeholders::error,
+                          amy::placeholders::result_set));
+    }
+
+}; // struct query_router_test
+
+namespace {
+
+/// Replies to SELECT statements with \p name, and fails \c BEGIN.
+fake_server::handler_type reply_as(std::string const& name) {
+    return [name](std::string const& query) -> fake_response {
+        if (query == "BEGIN") {
+            return fake_result::error(1205, "Lock wait timeout exceeded");
+        }
+
+        if (query.compare(0, 6, "SELECT") == 0) {
+            return fake_result::rows({ "name" }, { { name } });
+        }
+
+        return fake_result::ok();
+    };
+}
+
+struct fake_query_router_test {
+    fake_query_router_test() :
+        primary(reply_as("primary")),
+        replica(reply_as("replica")),
+        router(io_service)
+    {
+        amy::auth_info auth("amy", "amy");
+
+        router.connect_primary(primary.endpoint(), auth, "test_amy",
+                               amy::default_flags);
+        router.add_replica(replica.endpoint(), auth, "test_amy",
+                           amy::default_flags);
+    }
+
+    /// Runs \p stmt, and returns its error or the name of the server.
+    std::string query(std::string const& stmt) {
+        std::string result;
+
+        router.async_query_result(
+                stmt,
+                [&](AMY_SYSTEM_NS::error_code const& ec, amy::result_set rs) {
+                    result = ec ? "error"
+                        : rs.empty() ? ""
+                        : rs[0][0].as<amy::sql_varchar>();
+                });
+
+        io_service.run();
+        io_service.restart();
+
+        return result;
+    }
+
+    fake_server primary;
+    fake_server replica;
+    AMY_ASIO_NS::io_service io_service;
+    amy::query_router router;
+
+}; // struct fake_query_router_test
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_stay_out_of_transaction_when_begin_fails) {
+    fake_query_router_test fixture;
+
+    BOOST_CHECK_EQUAL(fixture.query("BEGIN"), "error");
+    BOOST_CHECK(!fixture.router.in_transaction());
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "replica");
+}
+
+BOOST_AUTO_TEST_CASE(should_route_reads_to_primary_without_autocommit) {
+    fake_query_router_test fixture;
+
+    BOOST_CHECK_EQUAL(fixture.query("SET autocommit = 0"), "");
+    BOOST_CHECK(fixture.router.in_transaction());
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "primary");
+
+    // COMMIT leaves autocommit disabled.
+    BOOST_CHECK_EQUAL(fixture.query("COMMIT"), "");
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "primary");
+
+    BOOST_CHECK_EQUAL(fixture.query("SET autocommit = 1"), "");
+    BOOST_CHECK(!fixture.router.in_transaction());
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "replica");
+
+    fixture.router.autocommit(false);
+    BOOST_CHECK(fixture.router.in_transaction());
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "primary");
+
+    fixture.router.autocommit(true);
+    BOOST_CHECK_EQUAL(fixture.query("SELECT 1"), "replica");
+}
+
+BOOST_AUTO_TEST_CASE(should_route_reads_to_replicas) {
+    AMY_ASIO_NS::io_service io_service;
+    amy::query_router router(io_service);
+    amy::auth_info auth("amy", "amy");
+
+    // Both connections go to the same server, told apart by their ids.
+    router.connect_primary(amy::null_endpoint(), auth, "test_amy",
+                           amy::default_flags);
+    router.add_replica(amy::null_endpoint(), auth, "test_amy",
+                       amy::default_flags);
+
+    query_router_test fixture;
+    fixture.query(router, "SELECT CONNECTION_ID()");
+    fixture.query(router, "BEGIN");
+    fixture.query(router, "SELECT CONNECTION_ID()");
+    fixture.query(router, "COMMIT");
+    io_service.run();
+    io_service.restart();
+
+    // The test server does not replicate, so the replica gets excluded.
+    router.async_check_replicas([](AMY_SYSTEM_NS::error_code const&) {});
+    io_service.run();
+    io_service.restart();
+
+    BOOST_CHECK(!router.replica_available(0));
+
+    fixture.query(router, "SELECT CONNECTION_ID()");
+    io_service.run();
+
+    BOOST_REQUIRE_EQUAL(5u, fixture.connection_ids.size());
+
+    amy::sql_bigint primary_id = fixture.connection_ids[2];
+    BOOST_CHECK_NE(primary_id, fixture.connection_ids[0]);
+    BOOST_CHECK_EQUAL(primary_id, fixture.connection_ids[4]);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
@@ -0,0 +1,81 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <amy/digest_table.hpp>
+#include <amy/statement_digest.hpp>
+
+#include <string>
+
+static std::string normalize(std::string const& stmt) {
+    return amy::statement_digest(stmt).text();
+}
+
+BOOST_AUTO_TEST_CASE(should_replace_literals) {
+    BOOST_CHECK_EQUAL(
+            normalize("SELECT * FROM t WHERE a = 1 AND b = 'x' OR c = -2.5e3"),
+            "select * from t where a = ? and b = ? or c = ?");
+
+    BOOST_CHECK_EQUAL(normalize("UPDATE t SET a=a-1, b=0x1F, c=X'FF'"),
+                      "update t set a = a - ?, b = ?, c = ?");
+}
+
+BOOST_AUTO_TEST_CASE(should_collapse_lists_of_literals) {
+    BOOST_CHECK_EQUAL(normalize("SELECT a FROM t WHERE id IN (1, 2, 3)"),
+                      normalize("select a from t where id in (4)"));
+
+    BOOST_CHECK_EQUAL(normalize("INSERT INTO t VALUES (1, 'a'), (2, 'b')"),
+                      "insert into t values (...), (...)");
+}
+
+BOOST_AUTO_TEST_CASE(should_ignore_comments_case_and_whitespace) {
+    amy::statement_digest d1("SELECT a,b FROM t WHERE c = 1;");
+    amy::statement_digest d2("select a, b /* hint */ from t\n"
+                             "where c='it''s' -- comment\n");
+
+    BOOST_CHECK(d1 == d2);
+    BOOST_CHECK_EQUAL(d1.hash(), d2.hash());
+    BOOST_CHECK_EQUAL(std::string(d1.text()), "select a, b from t where c = ?");
+}
+
+BOOST_AUTO_TEST_CASE(should_keep_quoted_identifiers) {
+    BOOST_CHECK_EQUAL(normalize("SELECT `Order` FROM `T`"),
+                      "select `Order` from `T`");
+}
+
+BOOST_AUTO_TEST_CASE(should_truncate_long_statements) {
+    std::string columns;
+
+    for (int i = 0; i < 500; ++i) {
+        columns += (i ? ", c" : "c") + std::to_string(i);
+    }
+
+    amy::statement_digest d1("SELECT " + columns + " FROM t");
+    amy::statement_digest d2("SELECT " + columns + " FROM u");
+
+    BOOST_CHECK(d1.truncated());
+    BOOST_CHECK_EQUAL(d1.size(), std::size_t(amy::statement_digest::max_size));
+    BOOST_CHECK(d1 != d2);
+}
+
+BOOST_AUTO_TEST_CASE(should_aggregate_digests_in_a_bounded_table) {
+    amy::digest_table table(2u);
+    amy::query_trace trace;
+    trace.rows = 3u;
+
+    table.record(amy::statement_digest("SELECT 1"), trace);
+    table.record(amy::statement_digest("SELECT 2"), trace);
+    table.record(amy::statement_digest("SELECT a FROM t"), trace);
+    table.record(amy::statement_digest("SELECT b FROM t"), trace);
+
+    std::vector<amy::digest_stats> stats = table.snapshot();
+
+    BOOST_REQUIRE_EQUAL(stats.size(), 2u);
+    BOOST_CHECK_EQUAL(table.overflow().count, 1u);
+
+    uint64_t count = stats[0].count + stats[1].count;
+    BOOST_CHECK_EQUAL(count, 3u);
+    BOOST_CHECK_EQUAL(stats[0].rows + stats[1].rows, 9u);
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et
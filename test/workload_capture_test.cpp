@@ -0,0 +1,237 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "fake_server.hpp"
+
+#include <amy/connector.hpp>
+#include <amy/workload_capture.hpp>
+
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using amy::test::fake_result;
+using amy::test::fake_server;
+
+namespace {
+
+amy::query_trace make_trace(amy::workload_recorder const& recorder,
+                            std::string statement,
+                            std::chrono::milliseconds issued,
+                            std::chrono::milliseconds latency)
+{
+    amy::query_trace trace;
+    trace.statement = std::move(statement);
+    trace.issued = recorder.started() + issued;
+    trace.ended[amy::query_trace::dispatch] = trace.issued + latency;
+    return trace;
+}
+
+std::vector<amy::workload_record> read_all(std::string const& capture) {
+    std::istringstream in(capture);
+    amy::workload_reader reader(in);
+    std::vector<amy::workload_record> records;
+    amy::workload_record record;
+
+    while (reader.next(record)) {
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(should_read_back_recorded_statements) {
+    using std::chrono::milliseconds;
+
+    std::ostringstream out;
+    amy::workload_recorder recorder(out);
+
+    amy::query_trace select = make_trace(recorder, "SELECT * FROM t",
+                                         milliseconds(5), milliseconds(2));
+    select.rows = 300u;
+    select.fields = 3u;
+
+    amy::query_trace insert = make_trace(recorder, "INSERT INTO t VALUES (1)",
+                                         milliseconds(7), milliseconds(1));
+    insert.ec = amy::error::make_error_code(amy::error::server_gone_error);
+
+    recorder.record(1u, select);
+    recorder.record(2u, insert);
+    recorder.flush();
+    BOOST_REQUIRE(recorder.good());
+
+    auto records = read_all(out.str());
+    BOOST_REQUIRE_EQUAL(records.size(), 2u);
+
+    BOOST_CHECK_EQUAL(records[0].connection, 1u);
+    BOOST_CHECK_EQUAL(records[0].statement, "SELECT * FROM t");
+    BOOST_CHECK(records[0].issued == milliseconds(5));
+    BOOST_CHECK(records[0].latency == milliseconds(2));
+    BOOST_CHECK_EQUAL(records[0].rows, 300u);
+    BOOST_CHECK_EQUAL(records[0].fields, 3u);
+    BOOST_CHECK_EQUAL(records[0].error, 0);
+
+    BOOST_CHECK_EQUAL(records[1].connection, 2u);
+    BOOST_CHECK_EQUAL(records[1].statement, "INSERT INTO t VALUES (1)");
+    BOOST_CHECK_EQUAL(records[1].error,
+                      static_cast<int>(amy::error::server_gone_error));
+}
+
+BOOST_AUTO_TEST_CASE(should_write_each_statement_text_once) {
+    std::string statement(200u, 'x');
+    std::ostringstream out;
+    amy::workload_recorder recorder(out);
+
+    for (int i = 0; i < 100; ++i) {
+        recorder.record(1u, make_trace(recorder, statement,
+                                       std::chrono::milliseconds(i),
+                                       std::chrono::milliseconds(1)));
+    }
+
+    recorder.flush();
+
+    // The text once, and a few bytes per execution.
+    BOOST_CHECK_LT(out.str().size(), statement.size() + 100u * 16u);
+
+    auto records = read_all(out.str());
+    BOOST_REQUIRE_EQUAL(records.size(), 100u);
+    BOOST_CHECK_EQUAL(records.back().statement, statement);
+}
+
+BOOST_AUTO_TEST_CASE(should_start_over_once_full) {
+    std::ostringstream out;
+    amy::workload_recorder recorder(out, 2u);
+
+    for (std::string statement : { "a", "b", "c", "a", "c" }) {
+        recorder.record(1u, make_trace(recorder, statement,
+                                       std::chrono::milliseconds(0),
+                                       std::chrono::milliseconds(0)));
+    }
+
+    recorder.flush();
+
+    auto records = read_all(out.str());
+    BOOST_REQUIRE_EQUAL(records.size(), 5u);
+    BOOST_CHECK_EQUAL(records[2].statement, "c");
+    BOOST_CHECK_EQUAL(records[3].statement, "a");
+    BOOST_CHECK_EQUAL(records[4].statement, "c");
+}
+
+BOOST_AUTO_TEST_CASE(should_write_records_in_chunks) {
+    std::ostringstream out;
+
+    {
+        amy::workload_recorder recorder(out, 4096u, 256u,
+                                        std::chrono::hours(1));
+
+        // Buffered until a chunk is full.
+        recorder.record(1u, make_trace(recorder, "SELECT 1",
+                                       std::chrono::milliseconds(0),
+                                       std::chrono::milliseconds(0)));
+        BOOST_CHECK(out.str().empty());
+
+        for (int i = 0; i < 100; ++i) {
+            recorder.record(1u, make_trace(recorder, "SELECT 1",
+                                           std::chrono::milliseconds(i),
+                                           std::chrono::milliseconds(0)));
+        }
+
+        BOOST_CHECK_GE(out.str().size(), 256u);
+        BOOST_CHECK_LT(read_all(out.str()).size(), 101u);
+    }
+
+    // The rest is written out on destruction.
+    BOOST_CHECK_EQUAL(read_all(out.str()).size(), 101u);
+}
+
+BOOST_AUTO_TEST_CASE(should_write_records_after_the_interval) {
+    std::ostringstream out;
+    amy::workload_recorder recorder(out, 4096u, 1u << 20,
+                                    std::chrono::milliseconds(0));
+
+    recorder.record(1u, make_trace(recorder, "SELECT 1",
+                                   std::chrono::milliseconds(0),
+                                   std::chrono::milliseconds(0)));
+
+    BOOST_CHECK_EQUAL(read_all(out.str()).size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(should_reject_other_data) {
+    std::istringstream in("SELECT 1");
+    BOOST_CHECK_THROW(amy::workload_reader reader(in), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(should_reject_truncated_captures) {
+    std::ostringstream out;
+    amy::workload_recorder recorder(out);
+    recorder.record(1u, make_trace(recorder, "SELECT 1",
+                                   std::chrono::milliseconds(1),
+                                   std::chrono::milliseconds(1)));
+    recorder.flush();
+
+    std::string capture = out.str();
+    std::istringstream in(capture.substr(0u, capture.size() - 2u));
+    amy::workload_reader reader(in);
+    amy::workload_record record;
+
+    BOOST_CHECK_THROW(reader.next(record), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(should_reject_oversized_statements) {
+    // A header, then a statement text claiming about 16 EiB.
+    std::string capture("AMYW\x01\x01", 6u);
+    capture.append(9u, '\xff');
+    capture.push_back('\x0f');
+
+    std::istringstream in(capture);
+    amy::workload_reader reader(in);
+    amy::workload_record record;
+
+    BOOST_CHECK_THROW(reader.next(record), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(should_capture_observed_statements) {
+    fake_server server(fake_result::rows({ "a", "b" },
+                                         { { "1", "2" }, { "3", "4" } }));
+
+    std::ostringstream out;
+    amy::workload_recorder recorder(out);
+
+    AMY_ASIO_NS::io_service io_service;
+    amy::basic_connector<amy::mysql_service, amy::recording_observer>
+        first(io_service, amy::recording_observer(recorder));
+    amy::basic_connector<amy::mysql_service, amy::recording_observer>
+        second(io_service, amy::recording_observer(recorder));
+
+    for (auto* connector : { &first, &second }) {
+        connector->connect(server.endpoint(), amy::auth_info("amy", "amy"),
+                           "", amy::default_flags);
+        connector->async_query_result(
+                "SELECT a, b FROM t",
+                [](AMY_SYSTEM_NS::error_code const& ec, amy::result_set) {
+                    BOOST_CHECK(!ec);
+                });
+    }
+
+    io_service.run();
+    recorder.flush();
+
+    auto records = read_all(out.str());
+    BOOST_REQUIRE_EQUAL(records.size(), 2u);
+    BOOST_CHECK_NE(records[0].connection, records[1].connection);
+
+    for (auto const& record : records) {
+        BOOST_CHECK_EQUAL(record.statement, "SELECT a, b FROM t");
+        BOOST_CHECK_EQUAL(record.rows, 2u);
+        BOOST_CHECK_EQUAL(record.fields, 2u);
+        BOOST_CHECK_EQUAL(record.error, 0);
+        BOOST_CHECK(record.latency > std::chrono::nanoseconds::zero());
+    }
+}
+
+// vim:ft=cpp sw=4 ts=4 tw=80 et